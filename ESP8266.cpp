@@ -19,6 +19,7 @@
  * THE SOFTWARE.
  */
 #include "ESP8266.h"
+#include "ESP8266Trace.h"
 
 #define LOG_OUTPUT_DEBUG            (1)
 #define LOG_OUTPUT_DEBUG_PREFIX     (1)
@@ -41,44 +42,410 @@
         }\
     } while(0)
 
+/*----------------------------------------------------------------------------*/
+/* Command descriptors(all in flash) */
+
+/*
+ * Formats of arguments: 's' - quoted string, 'r' - raw string, 'u' - number, 
+ * any other character is printed as is. 
+ */
+struct ESP8266Command {
+    const char *text;       /* Command text, NULL for waiting only */
+    const char *args;       /* Formats of arguments */
+    const char *ok;         /* Success token */
+    const char *ok2;        /* Alternative success token or NULL */
+    const char *fail;       /* Failure token or NULL */
+    uint16_t timeout;       /* ms */
+    uint8_t rtt;            /* Class of response time, RTT_FIXED for none */
+};
+
+#define RTT_NONE    (0xFFFF)
+
+static const char s_at[] PROGMEM = "AT";
+static const char s_rst[] PROGMEM = "AT+RST";
+static const char s_gmr[] PROGMEM = "AT+GMR";
+static const char s_cwmode_q[] PROGMEM = "AT+CWMODE?";
+static const char s_cwmode[] PROGMEM = "AT+CWMODE=";
+static const char s_cwmode_cur[] PROGMEM = "AT+CWMODE_CUR=";
+static const char s_cwjap[] PROGMEM = "AT+CWJAP=";
+static const char s_cwdhcp[] PROGMEM = "AT+CWDHCP=";
+static const char s_cwlap[] PROGMEM = "AT+CWLAP";
+static const char s_cwlap_ssid[] PROGMEM = "AT+CWLAP=";
+static const char s_cwlapopt[] PROGMEM = "AT+CWLAPOPT=";
+static const char s_cwqap[] PROGMEM = "AT+CWQAP";
+static const char s_cwsap[] PROGMEM = "AT+CWSAP=";
+static const char s_cwlif[] PROGMEM = "AT+CWLIF";
+static const char s_cipstatus[] PROGMEM = "AT+CIPSTATUS";
+static const char s_cipstart[] PROGMEM = "AT+CIPSTART=";
+static const char s_cipsend[] PROGMEM = "AT+CIPSEND=";
+static const char s_cipclose[] PROGMEM = "AT+CIPCLOSE";
+static const char s_cipclose_m[] PROGMEM = "AT+CIPCLOSE=";
+static const char s_cifsr[] PROGMEM = "AT+CIFSR";
+static const char s_cipmux[] PROGMEM = "AT+CIPMUX=";
+static const char s_cipserver_on[] PROGMEM = "AT+CIPSERVER=1,";
+static const char s_cipserver_off[] PROGMEM = "AT+CIPSERVER=0";
+static const char s_cipsto[] PROGMEM = "AT+CIPSTO=";
+static const char s_uart_cur[] PROGMEM = "AT+UART_CUR=";
+static const char s_ciobaud[] PROGMEM = "AT+CIOBAUD=";
+static const char s_sleep[] PROGMEM = "AT+SLEEP=";
+static const char s_gslp[] PROGMEM = "AT+GSLP=";
+static const char s_ciprecvmode[] PROGMEM = "AT+CIPRECVMODE=";
+static const char s_ciprecvlen[] PROGMEM = "AT+CIPRECVLEN?";
+static const char s_ciprecvdata[] PROGMEM = "AT+CIPRECVDATA=";
+
+static const char a_none[] PROGMEM = "";
+static const char a_u[] PROGMEM = "u";
+static const char a_uu[] PROGMEM = "u,u";
+static const char a_s[] PROGMEM = "s";
+static const char a_ss[] PROGMEM = "s,s";
+static const char a_ssuu[] PROGMEM = "s,s,u,u";
+static const char a_ssu[] PROGMEM = "s,s,u";
+static const char a_ussu[] PROGMEM = "u,s,s,u";
+static const char a_uart[] PROGMEM = "u,8,1,0,u";
+
+static const char t_ok[] PROGMEM = "OK";
+static const char t_error[] PROGMEM = "ERROR";
+static const char t_fail[] PROGMEM = "FAIL";
+static const char t_no_change[] PROGMEM = "no change";
+static const char t_already[] PROGMEM = "ALREADY CONNECT";
+static const char t_prompt[] PROGMEM = ">";
+static const char t_send_ok[] PROGMEM = "SEND OK";
+static const char t_link_not[] PROGMEM = "link is not";
+static const char t_link_builded[] PROGMEM = "Link is builded";
+static const char t_crcrlf[] PROGMEM = "\r\r\n";
+static const char t_ready[] PROGMEM = "ready";
+static const char t_got_ip[] PROGMEM = "WIFI GOT IP";
+static const char t_ciprecvdata[] PROGMEM = "+CIPRECVDATA";
+
+static const char l_ipd[] PROGMEM = "+IPD,";
+static const char l_wifi_disconnect[] PROGMEM = "WIFI DISCONNECT";
+static const char l_connect[] PROGMEM = "CONNECT";
+static const char l_closed[] PROGMEM = "CLOSED";
+
+/*
+ * Responses ending any command, checked after the tokens of the command. 
+ * Like all tokens they match at the start of a line only. 
+ */
+struct ESP8266Terminal {
+    const char *token;
+    uint8_t result;
+};
+
+static const char r_send_fail[] PROGMEM = "SEND FAIL";
+static const char r_busy[] PROGMEM = "busy ";
+static const char r_link_invalid[] PROGMEM = "link is not valid";
+
+static const ESP8266Terminal terminal_tokens[] PROGMEM = {
+    {r_send_fail,       ESP8266_RESULT_SEND_FAIL},
+    {t_error,           ESP8266_RESULT_ERROR},
+    {t_fail,            ESP8266_RESULT_FAIL},
+    {r_busy,            ESP8266_RESULT_BUSY},
+    {r_link_invalid,    ESP8266_RESULT_LINK_INVALID},
+    {t_ready,           ESP8266_RESULT_RESET},
+};
+
+const ESP8266Command ESP8266::s_commands[ESP8266::CMD_COUNT] PROGMEM = {
+    /* CMD_AT */            {s_at,              a_none, t_ok,       NULL,           NULL,           1000,  RTT_QUERY},
+    /* CMD_RST */           {s_rst,             a_none, t_ok,       NULL,           NULL,           1000,  RTT_QUERY},
+    /* CMD_GMR */           {s_gmr,             a_none, t_ok,       NULL,           NULL,           1000,  RTT_QUERY},
+    /* CMD_CWMODE_Q */      {s_cwmode_q,        a_none, t_ok,       NULL,           NULL,           1000,  RTT_QUERY},
+    /* CMD_CWMODE */        {s_cwmode,          a_u,    t_ok,       t_no_change,    NULL,           1000,  RTT_QUERY},
+    /* CMD_CWMODE_CUR */    {s_cwmode_cur,      a_u,    t_ok,       NULL,           t_error,        1000,  RTT_QUERY},
+    /* CMD_CWJAP */         {s_cwjap,           a_ss,   t_ok,       NULL,           t_fail,         10000, RTT_FIXED},
+    /* CMD_CWDHCP */        {s_cwdhcp,          a_uu,   t_ok,       NULL,           t_fail,         10000, RTT_QUERY},
+    /* CMD_CWLAP */         {s_cwlap,           a_none, t_ok,       NULL,           NULL,           10000, RTT_SCAN},
+    /* CMD_CWLAP_SSID */    {s_cwlap_ssid,      a_s,    t_ok,       NULL,           t_error,        10000, RTT_SCAN},
+    /* CMD_CWLAPOPT */      {s_cwlapopt,        a_uu,   t_ok,       NULL,           t_error,        1000,  RTT_QUERY},
+    /* CMD_CWQAP */         {s_cwqap,           a_none, t_ok,       NULL,           NULL,           1000,  RTT_QUERY},
+    /* CMD_CWSAP */         {s_cwsap,           a_ssuu, t_ok,       NULL,           t_error,        5000,  RTT_FIXED},
+    /* CMD_CWLIF */         {s_cwlif,           a_none, t_ok,       NULL,           NULL,           1000,  RTT_QUERY},
+    /* CMD_CIPSTATUS */     {s_cipstatus,       a_none, t_ok,       NULL,           NULL,           1000,  RTT_QUERY},
+    /* CMD_CIPSTART_S */    {s_cipstart,        a_ssu,  t_ok,       t_already,      t_error,        10000, RTT_FIXED},
+    /* CMD_CIPSTART_M */    {s_cipstart,        a_ussu, t_ok,       t_already,      t_error,        10000, RTT_FIXED},
+    /* CMD_CIPSEND_S */     {s_cipsend,         a_u,    t_prompt,   NULL,           NULL,           5000,  RTT_PROMPT},
+    /* CMD_CIPSEND_M */     {s_cipsend,         a_uu,   t_prompt,   NULL,           NULL,           5000,  RTT_PROMPT},
+    /* CMD_SEND_OK */       {NULL,              a_none, t_send_ok,  NULL,           NULL,           10000, RTT_FIXED},
+    /* CMD_CIPCLOSE_M */    {s_cipclose_m,      a_u,    t_ok,       t_link_not,     NULL,           5000,  RTT_CLOSE},
+    /* CMD_CIPCLOSE_S */    {s_cipclose,        a_none, t_ok,       NULL,           NULL,           5000,  RTT_CLOSE},
+    /* CMD_CIFSR */         {s_cifsr,           a_none, t_ok,       NULL,           NULL,           1000,  RTT_QUERY},
+    /* CMD_CIPMUX */        {s_cipmux,          a_u,    t_ok,       NULL,           t_link_builded, 1000,  RTT_QUERY},
+    /* CMD_CIPSERVER_ON */  {s_cipserver_on,    a_u,    t_ok,       t_no_change,    NULL,           1000,  RTT_QUERY},
+    /* CMD_CIPSERVER_OFF */ {s_cipserver_off,   a_none, t_crcrlf,   NULL,           NULL,           1000,  RTT_QUERY},
+    /* CMD_CIPSTO */        {s_cipsto,          a_u,    t_ok,       NULL,           NULL,           1000,  RTT_QUERY},
+    /* CMD_UART_CUR */      {s_uart_cur,        a_uart, t_ok,       NULL,           NULL,           1000,  RTT_QUERY},
+    /* CMD_CIOBAUD */       {s_ciobaud,         a_u,    t_ok,       NULL,           t_error,        1000,  RTT_QUERY},
+    /* CMD_SLEEP */         {s_sleep,           a_u,    t_ok,       NULL,           NULL,           1000,  RTT_QUERY},
+    /* CMD_GSLP */          {s_gslp,            a_u,    t_ok,       NULL,           NULL,           1000,  RTT_QUERY},
+    /* CMD_CIPRECVMODE */   {s_ciprecvmode,     a_u,    t_ok,       NULL,           t_error,        1000,  RTT_QUERY},
+    /* CMD_CIPRECVLEN */    {s_ciprecvlen,      a_none, t_ok,       NULL,           t_error,        1000,  RTT_QUERY},
+    /* CMD_CIPRECVDATA_S */ {s_ciprecvdata,     a_u,    t_ciprecvdata, NULL,        t_error,        3000,  RTT_RECVDATA},
+    /* CMD_CIPRECVDATA_M */ {s_ciprecvdata,     a_uu,   t_ciprecvdata, NULL,        t_error,        3000,  RTT_RECVDATA},
+    /* CMD_WAIT_READY */    {NULL,              a_none, t_ready,    NULL,           NULL,           5000,  RTT_FIXED},
+    /* CMD_WAIT_GOT_IP */   {NULL,              a_none, t_got_ip,   NULL,           NULL,           5000,  RTT_FIXED},
+};
+
+/*
+ * The first version of AT firmware having each capability, from the release 
+ * notes of Espressif(conservative where unsure). 
+ */
+struct ESP8266Capability {
+    uint16_t cap;
+    uint16_t at_version;    /* major * 100 + minor */
+};
+
+static const ESP8266Capability capabilities[] PROGMEM = {
+    {ESP8266_CAP_CIPSENDEX,     40},
+    {ESP8266_CAP_CUR,           50},
+    {ESP8266_CAP_CIPDINFO,      50},
+    {ESP8266_CAP_CWLAPOPT,      60},
+    {ESP8266_CAP_CIPRECVMODE,   105},
+};
+
 #ifdef ESP8266_USE_SOFTWARE_SERIAL
-ESP8266::ESP8266(SoftwareSerial &uart, uint32_t baud): m_puart(&uart)
+ESP8266::ESP8266(SoftwareSerial &uart, uint32_t baud): m_puart(&uart), m_pbase(&uart), m_pio(&uart)
 {
+    init();
     m_puart->begin(baud);
     rx_empty();
 }
 #else
-ESP8266::ESP8266(HardwareSerial &uart, uint32_t baud): m_puart(&uart)
+ESP8266::ESP8266(HardwareSerial &uart, uint32_t baud): m_puart(&uart), m_pbase(&uart), m_pio(&uart)
 {
+    init();
     m_puart->begin(baud);
     rx_empty();
 }
 #endif
 
+ESP8266::ESP8266(Stream &stream): m_puart(NULL), m_pbase(&stream), m_pio(&stream)
+{
+    init();
+    rx_empty();
+}
+
+void ESP8266::init(void)
+{
+    m_trace = NULL;
+    m_flow_mode = ESP8266_FLOW_NONE;
+    m_rts_pin = ESP8266_PIN_NONE;
+    m_cts_pin = ESP8266_PIN_NONE;
+    m_flow_chunk = 128;
+    m_flow_pause = 2;
+    m_mux_mode = 0xFF;
+    m_server_port = 0;
+    m_server_timeout = 0;
+    m_link_up = 0;
+    memset(m_clients, 0, sizeof(m_clients));
+    m_opr_mode = 0;
+    m_expect_reset = false;
+    m_ap_change = false;
+    m_fault = ESP8266_FAULT_NONE;
+    m_result = ESP8266_RESULT_OK;
+    m_sup_level = 0;
+    m_fault_since = 0;
+    m_sup_last = 0;
+    m_sup_wait = 0;
+    m_sup_interval = 10000;
+    m_sup_backoff_min = 1000;
+    m_sup_backoff_max = 60000;
+    memset(&m_sup_stats, 0, sizeof(m_sup_stats));
+    m_rtt_enabled = false;
+    m_rtt_floor = 100;
+    m_rtt_ceiling = 0;
+    memset(m_srtt, 0xFF, sizeof(m_srtt));
+    memset(m_rttvar, 0, sizeof(m_rttvar));
+    m_wait = NULL;
+    m_lock = NULL;
+    m_caps = 0;
+    m_at_version = 0;
+    m_passive = false;
+    m_passive_next = 0;
+    m_recv_handler = NULL;
+    m_line_len = 0;
+    m_ipd_id = 0;
+    m_ipd_left = 0;
+    m_park_len = 0;
+    memset(m_pending, 0, sizeof(m_pending));
+    m_scan_state = ESP8266_SCAN_IDLE;
+    m_scan_channel = 0;
+    m_scan_start = 0;
+    m_scan_timeout = 0;
+    m_scan_callback = NULL;
+    m_scan_results = NULL;
+    m_scan_size = 0;
+    m_scan_count = 0;
+}
+
+void ESP8266::setAdaptiveTimeout(bool enabled, uint32_t floor_ms, uint32_t ceiling_ms)
+{
+    m_rtt_enabled = enabled;
+    m_rtt_floor = floor_ms < RTT_NONE ? floor_ms : RTT_NONE - 1;
+    m_rtt_ceiling = ceiling_ms < RTT_NONE ? ceiling_ms : RTT_NONE - 1;
+}
+
+void ESP8266::setWaitHook(ESP8266WaitHook hook)
+{
+    m_wait = hook;
+}
+
+void ESP8266::setLock(ESP8266LockHook hook)
+{
+    m_lock = hook;
+}
+
+void ESP8266::lock(void)
+{
+    if (m_lock) {
+        m_lock(true);
+    }
+}
+
+void ESP8266::unlock(void)
+{
+    if (m_lock) {
+        m_lock(false);
+    }
+}
+
+uint16_t ESP8266::probeCapabilities(void)
+{
+    Guard guard(this);
+    ESP8266Capability cap;
+    String version;
+    int32_t index;
+    uint8_t i;
+    
+    m_caps = 0;
+    m_at_version = 0;
+    if (!eATGMR(version)) {
+        return 0;
+    }
+    index = version.indexOf(F("AT version:"));
+    if (index != -1) {
+        /* AT version:1.2.0.0(Jul  1 2016 20:04:45) */
+        index += 11;
+        m_at_version = version.substring(index).toInt() * 100;
+        index = version.indexOf('.', index);
+        if (index != -1) {
+            m_at_version += version.substring(index + 1).toInt();
+        }
+    } else if (version.length() >= 4) {
+        /* 0018000902: AT 0.18, SDK 0.9.2 */
+        m_at_version = version.substring(0, 2).toInt() * 100 + version.substring(2, 4).toInt();
+    }
+    for (i = 0; i < sizeof(capabilities) / sizeof(capabilities[0]); i++) {
+        memcpy_P(&cap, &capabilities[i], sizeof(cap));
+        if (m_at_version >= cap.at_version) {
+            m_caps |= cap.cap;
+        }
+    }
+    m_caps |= ESP8266_CAP_PROBED;
+    return m_caps;
+}
+
+uint16_t ESP8266::getCapabilities(void)
+{
+    return m_caps;
+}
+
+void ESP8266::setCapabilities(uint16_t caps)
+{
+    m_caps = caps | ESP8266_CAP_PROBED;
+}
+
+uint16_t ESP8266::getATVersion(void)
+{
+    return m_at_version;
+}
+
+bool ESP8266::setPassiveRecv(bool enabled)
+{
+    Guard guard(this);
+    if (enabled && !(caps() & ESP8266_CAP_CIPRECVMODE)) {
+        return false;
+    }
+    if (!sATCIPRECVMODE(enabled ? 1 : 0)) {
+        return false;
+    }
+    m_passive = enabled;
+    memset(m_pending, 0, sizeof(m_pending));
+    return true;
+}
+
+uint32_t ESP8266::getRecvPending(uint8_t mux_id, bool query)
+{
+    Guard guard(this);
+    uint32_t len = 0;
+    uint16_t i;
+    
+    if (mux_id >= ESP8266_MAX_LINKS) {
+        return 0;
+    }
+    if (!m_passive) {
+        for (i = 0; i < m_park_len; i += 2 + m_park[i + 1]) {
+            if (m_park[i] == mux_id) {
+                len += m_park[i + 1];
+            }
+        }
+        return len + (m_ipd_left > 0 && m_ipd_id == mux_id ? m_ipd_left : 0);
+    }
+    if (query) {
+        qATCIPRECVLEN();
+    }
+    return m_pending[mux_id];
+}
+
+uint16_t ESP8266::caps(void)
+{
+    if (!(m_caps & ESP8266_CAP_PROBED)) {
+        probeCapabilities();
+    }
+    return m_caps;
+}
+
 bool ESP8266::kick(void)
 {
+    Guard guard(this);
     return eAT();
 }
 
 bool ESP8266::restart(void)
+{
+    Guard guard(this);
+    if (reset_module()) {
+        state_clear();
+        return true;
+    }
+    return false;
+}
+
+bool ESP8266::reset_module(void)
 {
     unsigned long start;
+    bool ret = false;
+    
+    m_expect_reset = true; /* The boot "ready" is ours, not a fault */
     if (eATRST()) {
         delay(2000);
         start = millis();
         while (millis() - start < 3000) {
             if (eAT()) {
-                delay(1500); /* Waiting for stable */
-                return true;
+                ret = true;
+                break;
             }
             delay(100);
         }
     }
-    return false;
+    m_expect_reset = false;
+    if (ret) {
+        delay(1500); /* Waiting for stable */
+    }
+    return ret;
 }
 
 String ESP8266::getVersion(void)
 {
+    Guard guard(this);
     String version;
     eATGMR(version);
     return version;
@@ -86,7 +453,17 @@ String ESP8266::getVersion(void)
 
 bool ESP8266::setOprToStation(void)
 {
+    Guard guard(this);
     uint8_t mode;
+    if (caps() & ESP8266_CAP_CUR) {
+        /* No restart needed, but lost at reset: kept to set again */
+        if (!sATCWMODECUR(1)) {
+            return false;
+        }
+        m_opr_mode = 1;
+        return true;
+    }
+    m_opr_mode = 0;
     if (!qATCWMODE(&mode)) {
         return false;
     }
@@ -103,7 +480,17 @@ bool ESP8266::setOprToStation(void)
 
 bool ESP8266::setOprToSoftAP(void)
 {
+    Guard guard(this);
     uint8_t mode;
+    if (caps() & ESP8266_CAP_CUR) {
+        /* No restart needed, but lost at reset: kept to set again */
+        if (!sATCWMODECUR(2)) {
+            return false;
+        }
+        m_opr_mode = 2;
+        return true;
+    }
+    m_opr_mode = 0;
     if (!qATCWMODE(&mode)) {
         return false;
     }
@@ -120,7 +507,17 @@ bool ESP8266::setOprToSoftAP(void)
 
 bool ESP8266::setOprToStationSoftAP(void)
 {
+    Guard guard(this);
     uint8_t mode;
+    if (caps() & ESP8266_CAP_CUR) {
+        /* No restart needed, but lost at reset: kept to set again */
+        if (!sATCWMODECUR(3)) {
+            return false;
+        }
+        m_opr_mode = 3;
+        return true;
+    }
+    m_opr_mode = 0;
     if (!qATCWMODE(&mode)) {
         return false;
     }
@@ -137,33 +534,131 @@ bool ESP8266::setOprToStationSoftAP(void)
 
 String ESP8266::getAPList(void)
 {
+    Guard guard(this);
     String list;
     eATCWLAP(list);
     return list;
 }
 
+bool ESP8266::startScan(const char *ssid, uint8_t channel)
+{
+    Arg args[1];
+    
+    if (m_scan_state == ESP8266_SCAN_RUNNING) {
+        return false;
+    }
+    lock(); /* Held until the scan finished */
+    /* Sorted by RSSI, fields: ecn, ssid, rssi, mac, channel */
+    if ((caps() & ESP8266_CAP_CWLAPOPT) && !sATCWLAPOPT(1, 0x1F)) {
+        unlock();
+        return false;
+    }
+    m_scan_ssid = ssid ? ssid : "";
+    m_scan_channel = channel;
+    m_scan_line = "";
+    m_scan_count = 0;
+    if (ssid) {
+        args[0].s = ssid;
+        m_scan_timeout = rtt_timeout(RTT_SCAN, command(CMD_CWLAP_SSID, args));
+    } else {
+        m_scan_timeout = rtt_timeout(RTT_SCAN, command(CMD_CWLAP, NULL));
+    }
+    m_scan_start = millis();
+    m_scan_state = ESP8266_SCAN_RUNNING;
+    rts_set(true);
+    return true;
+}
+
+uint8_t ESP8266::pollScan(void)
+{
+    char a;
+    
+    if (m_scan_state != ESP8266_SCAN_RUNNING) {
+        return m_scan_state;
+    }
+    while (m_pio->available() > 0 && m_scan_state == ESP8266_SCAN_RUNNING) {
+        if (m_ipd_left > 0) {
+            ipd_deliver();
+            continue;
+        }
+        a = m_pio->read();
+        rx_char(a); /* Faults and links, on whole lines */
+        if (m_ipd_left > 0) {
+            m_scan_line = ""; /* "+IPD,<id>,<len>:" */
+        } else if (a == '\n') {
+            scan_line();
+            m_scan_line = "";
+        } else if (a != '\r' && m_scan_line.length() < 128) {
+            m_scan_line += a;
+        }
+    }
+    if (m_scan_state == ESP8266_SCAN_RUNNING && millis() - m_scan_start >= m_scan_timeout) {
+        m_scan_state = ESP8266_SCAN_FAILED;
+        m_result = ESP8266_RESULT_TIMEOUT;
+    }
+    if (m_scan_state != ESP8266_SCAN_RUNNING) {
+        rtt_update(RTT_SCAN, m_scan_state == ESP8266_SCAN_DONE, millis() - m_scan_start, 10000);
+        m_scan_line = "";
+        rts_set(false);
+        unlock();
+    }
+    return m_scan_state;
+}
+
+void ESP8266::setScanCallback(ESP8266ScanCallback callback)
+{
+    m_scan_callback = callback;
+}
+
+void ESP8266::setScanResults(ESP8266AP *aps, uint8_t size)
+{
+    m_scan_results = aps;
+    m_scan_size = aps ? size : 0;
+    m_scan_count = 0;
+}
+
+uint8_t ESP8266::getScanCount(void)
+{
+    return m_scan_count;
+}
+
 bool ESP8266::joinAP(String ssid, String pwd)
 {
-    return sATCWJAP(ssid, pwd);
+    Guard guard(this);
+    if (sATCWJAP(ssid, pwd)) {
+        m_ssid = ssid;
+        m_pwd = pwd;
+        return true;
+    }
+    return false;
 }
 
 bool ESP8266::enableClientDHCP(uint8_t mode, boolean enabled)
 {
+    Guard guard(this);
     return sATCWDHCP(mode, enabled);
 }
 
 bool ESP8266::leaveAP(void)
 {
-    return eATCWQAP();
+    Guard guard(this);
+    if (eATCWQAP()) {
+        m_ssid = "";
+        m_pwd = "";
+        return true;
+    }
+    return false;
 }
 
 bool ESP8266::setSoftAPParam(String ssid, String pwd, uint8_t chl, uint8_t ecn)
 {
+    Guard guard(this);
     return sATCWSAP(ssid, pwd, chl, ecn);
 }
 
 String ESP8266::getJoinedDeviceIP(void)
 {
+    Guard guard(this);
     String list;
     eATCWLIF(list);
     return list;
@@ -171,6 +666,7 @@ String ESP8266::getJoinedDeviceIP(void)
 
 String ESP8266::getIPStatus(void)
 {
+    Guard guard(this);
     String list;
     eATCIPSTATUS(list);
     return list;
@@ -178,6 +674,7 @@ String ESP8266::getIPStatus(void)
 
 String ESP8266::getLocalIP(void)
 {
+    Guard guard(this);
     String list;
     eATCIFSR(list);
     return list;
@@ -185,62 +682,140 @@ String ESP8266::getLocalIP(void)
 
 bool ESP8266::enableMUX(void)
 {
-    return sATCIPMUX(1);
+    Guard guard(this);
+    if (sATCIPMUX(1)) {
+        m_mux_mode = 1;
+        return true;
+    }
+    return false;
 }
 
 bool ESP8266::disableMUX(void)
 {
-    return sATCIPMUX(0);
+    Guard guard(this);
+    if (sATCIPMUX(0)) {
+        m_mux_mode = 0;
+        return true;
+    }
+    return false;
 }
 
 bool ESP8266::createTCP(String addr, uint32_t port)
 {
-    return sATCIPSTARTSingle("TCP", addr, port);
+    Guard guard(this);
+    if (sATCIPSTARTSingle(F("TCP"), addr, port)) {
+        m_link_up |= 1;
+        m_links[0].type = ESP8266_LINK_TCP;
+        m_links[0].addr = addr;
+        m_links[0].port = port;
+        return true;
+    }
+    return false;
 }
 
 bool ESP8266::releaseTCP(void)
 {
+    Guard guard(this);
+    m_links[0].type = ESP8266_LINK_NONE;
+    m_link_up &= ~1;
+    unpark(0, NULL, 0, NULL);
     return eATCIPCLOSESingle();
 }
 
 bool ESP8266::registerUDP(String addr, uint32_t port)
 {
-    return sATCIPSTARTSingle("UDP", addr, port);
+    Guard guard(this);
+    if (sATCIPSTARTSingle(F("UDP"), addr, port)) {
+        m_link_up |= 1;
+        m_links[0].type = ESP8266_LINK_UDP;
+        m_links[0].addr = addr;
+        m_links[0].port = port;
+        return true;
+    }
+    return false;
 }
 
 bool ESP8266::unregisterUDP(void)
 {
+    Guard guard(this);
+    m_links[0].type = ESP8266_LINK_NONE;
+    m_link_up &= ~1;
+    unpark(0, NULL, 0, NULL);
     return eATCIPCLOSESingle();
 }
 
 bool ESP8266::createTCP(uint8_t mux_id, String addr, uint32_t port)
 {
-    return sATCIPSTARTMultiple(mux_id, "TCP", addr, port);
+    Guard guard(this);
+    if (sATCIPSTARTMultiple(mux_id, F("TCP"), addr, port)) {
+        if (mux_id < ESP8266_MAX_LINKS) {
+            m_link_up |= (uint16_t)1 << mux_id;
+            m_links[mux_id].type = ESP8266_LINK_TCP;
+            m_links[mux_id].addr = addr;
+            m_links[mux_id].port = port;
+        }
+        return true;
+    }
+    return false;
 }
 
 bool ESP8266::releaseTCP(uint8_t mux_id)
 {
+    Guard guard(this);
+    if (mux_id < ESP8266_MAX_LINKS) {
+        m_links[mux_id].type = ESP8266_LINK_NONE;
+        m_link_up &= ~((uint16_t)1 << mux_id);
+        unpark(mux_id, NULL, 0, NULL);
+    }
     return sATCIPCLOSEMulitple(mux_id);
 }
 
 bool ESP8266::registerUDP(uint8_t mux_id, String addr, uint32_t port)
 {
-    return sATCIPSTARTMultiple(mux_id, "UDP", addr, port);
+    Guard guard(this);
+    if (sATCIPSTARTMultiple(mux_id, F("UDP"), addr, port)) {
+        if (mux_id < ESP8266_MAX_LINKS) {
+            m_link_up |= (uint16_t)1 << mux_id;
+            m_links[mux_id].type = ESP8266_LINK_UDP;
+            m_links[mux_id].addr = addr;
+            m_links[mux_id].port = port;
+        }
+        return true;
+    }
+    return false;
 }
 
 bool ESP8266::unregisterUDP(uint8_t mux_id)
 {
+    Guard guard(this);
+    if (mux_id < ESP8266_MAX_LINKS) {
+        m_links[mux_id].type = ESP8266_LINK_NONE;
+        m_link_up &= ~((uint16_t)1 << mux_id);
+        unpark(mux_id, NULL, 0, NULL);
+    }
     return sATCIPCLOSEMulitple(mux_id);
 }
 
+bool ESP8266::isConnected(uint8_t mux_id)
+{
+    return mux_id < ESP8266_MAX_LINKS && (m_link_up & ((uint16_t)1 << mux_id));
+}
+
 bool ESP8266::setTCPServerTimeout(uint32_t timeout)
 {
-    return sATCIPSTO(timeout);
+    Guard guard(this);
+    if (sATCIPSTO(timeout)) {
+        m_server_timeout = timeout;
+        return true;
+    }
+    return false;
 }
 
 bool ESP8266::startTCPServer(uint32_t port)
 {
+    Guard guard(this);
     if (sATCIPSERVER(1, port)) {
+        m_server_port = port;
         return true;
     }
     return false;
@@ -248,6 +823,7 @@ bool ESP8266::startTCPServer(uint32_t port)
 
 bool ESP8266::stopTCPServer(void)
 {
+    Guard guard(this);
     sATCIPSERVER(0);
     restart();
     return false;
@@ -263,482 +839,1509 @@ bool ESP8266::stopServer(void)
     return stopTCPServer();
 }
 
-bool ESP8266::send(const uint8_t *buffer, uint32_t len)
-{
-    return sATCIPSENDSingle(buffer, len);
-}
-
-bool ESP8266::send(uint8_t mux_id, const uint8_t *buffer, uint32_t len)
+void ESP8266::setTrace(ESP8266TraceRecorder *recorder)
 {
-    return sATCIPSENDMultiple(mux_id, buffer, len);
+    Guard guard(this);
+    if (m_trace) {
+        m_trace->end();
+    }
+    m_trace = recorder;
+    if (m_trace) {
+        m_trace->attach(*m_pbase);
+        m_pio = m_trace;
+    } else {
+        m_pio = m_pbase;
+    }
 }
 
-uint32_t ESP8266::recv(uint8_t *buffer, uint32_t buffer_size, uint32_t timeout)
+bool ESP8266::setUART(uint32_t baud, uint8_t flow_control)
 {
-    return recvPkg(buffer, buffer_size, NULL, timeout, NULL);
+    Guard guard(this);
+    if (flow_control == ESP8266_FLOW_HARDWARE
+        && (m_rts_pin == ESP8266_PIN_NONE || m_cts_pin == ESP8266_PIN_NONE)) {
+        return false;
+    }
+    if (caps() & ESP8266_CAP_CUR) {
+        if (!sATUARTCUR(baud, flow_control == ESP8266_FLOW_HARDWARE ? 3 : 0)) {
+            return false;
+        }
+    } else if (flow_control == ESP8266_FLOW_HARDWARE || !sATCIOBAUD(baud)) {
+        return false;
+    }
+    m_pio->flush();
+    if (m_puart) {
+        m_puart->begin(baud);
+    }
+    delay(20); /* Waiting for the module to switch */
+    rx_empty();
+    m_flow_mode = flow_control;
+    return true;
 }
 
-uint32_t ESP8266::recv(uint8_t mux_id, uint8_t *buffer, uint32_t buffer_size, uint32_t timeout)
+void ESP8266::setFlowControlPins(uint8_t rts_pin, uint8_t cts_pin)
 {
-    uint8_t id;
-    uint32_t ret;
-    ret = recvPkg(buffer, buffer_size, NULL, timeout, &id);
-    if (ret > 0 && id == mux_id) {
-        return ret;
+    m_rts_pin = rts_pin;
+    m_cts_pin = cts_pin;
+    if (m_rts_pin != ESP8266_PIN_NONE) {
+        pinMode(m_rts_pin, OUTPUT);
+        digitalWrite(m_rts_pin, HIGH);
+    }
+    if (m_cts_pin != ESP8266_PIN_NONE) {
+        pinMode(m_cts_pin, INPUT);
     }
-    return 0;
 }
 
-uint32_t ESP8266::recv(uint8_t *coming_mux_id, uint8_t *buffer, uint32_t buffer_size, uint32_t timeout)
+void ESP8266::setSoftwareFlowControl(uint16_t chunk, uint16_t pause_ms)
 {
-    return recvPkg(buffer, buffer_size, NULL, timeout, coming_mux_id);
+    m_flow_chunk = chunk > 0 ? chunk : 1;
+    m_flow_pause = pause_ms;
 }
 
-/*----------------------------------------------------------------------------*/
-/* +IPD,<id>,<len>:<data> */
-/* +IPD,<len>:<data> */
-
-uint32_t ESP8266::recvPkg(uint8_t *buffer, uint32_t buffer_size, uint32_t *data_len, uint32_t timeout, uint8_t *coming_mux_id)
+bool ESP8266::supervise(void)
 {
-    String data;
-    char a;
-    int32_t index_PIPDcomma = -1;
-    int32_t index_colon = -1; /* : */
-    int32_t index_comma = -1; /* , */
-    int32_t len = -1;
-    int8_t id = -1;
-    bool has_data = false;
-    uint32_t ret;
-    unsigned long start;
-    uint32_t i;
+    Guard guard(this);
+    unsigned long now = millis();
+    uint32_t elapsed;
     
-    if (buffer == NULL) {
-        return 0;
-    }
-    
-    start = millis();
-    while (millis() - start < timeout) {
-        if(m_puart->available() > 0) {
-            a = m_puart->read();
-            data += a;
+    if (m_fault == ESP8266_FAULT_NONE) {
+        if (now - m_sup_last < m_sup_interval) {
+            return true;
         }
-        
-        index_PIPDcomma = data.indexOf("+IPD,");
-        if (index_PIPDcomma != -1) {
-            index_colon = data.indexOf(':', index_PIPDcomma + 5);
-            if (index_colon != -1) {
-                index_comma = data.indexOf(',', index_PIPDcomma + 5);
-                /* +IPD,id,len:data */
-                if (index_comma != -1 && index_comma < index_colon) { 
-                    id = data.substring(index_PIPDcomma + 5, index_comma).toInt();
-                    if (id < 0 || id > 4) {
-                        return 0;
-                    }
-                    len = data.substring(index_comma + 1, index_colon).toInt();
-                    if (len <= 0) {
-                        return 0;
-                    }
-                } else { /* +IPD,len:data */
-                    len = data.substring(index_PIPDcomma + 5, index_colon).toInt();
-                    if (len <= 0) {
-                        return 0;
-                    }
-                }
-                has_data = true;
-                break;
-            }
+        m_sup_last = now;
+        if (!eAT()) {
+            fault_set(ESP8266_FAULT_NO_RESPONSE);
+        } else if (m_ssid.length() > 0 && getIPStatus().indexOf(F("STATUS:5")) != -1) {
+            fault_set(ESP8266_FAULT_AP_LOST);
+        }
+        if (m_fault == ESP8266_FAULT_NONE) {
+            return true;
         }
     }
     
-    if (has_data) {
-        i = 0;
-        ret = len > buffer_size ? buffer_size : len;
-        start = millis();
-        while (millis() - start < 3000) {
-            while(m_puart->available() > 0 && i < ret) {
-                a = m_puart->read();
-                buffer[i++] = a;
-            }
-            if (i == ret) {
-                rx_empty();
-                if (data_len) {
-                    *data_len = len;    
-                }
-                if (index_comma != -1 && coming_mux_id) {
-                    *coming_mux_id = id;
-                }
-                return ret;
-            }
+    if (m_sup_wait > 0 && now - m_sup_last < m_sup_wait) {
+        return false; /* Backing off */
+    }
+    m_sup_last = now;
+    m_sup_stats.attempts++;
+    
+    if (recover(m_sup_level)) {
+        elapsed = millis() - m_fault_since;
+        m_sup_stats.recoveries++;
+        m_sup_stats.last_recovery_ms = elapsed;
+        m_sup_stats.total_recovery_ms += elapsed;
+        if (elapsed > m_sup_stats.max_recovery_ms) {
+            m_sup_stats.max_recovery_ms = elapsed;
         }
+        m_fault = ESP8266_FAULT_NONE;
+        m_sup_level = 0;
+        m_sup_wait = 0;
+        m_sup_last = millis();
+        return true;
     }
-    return 0;
+    
+    if (m_sup_level < 2) {
+        m_sup_level++;
+    }
+    if (m_sup_wait == 0) {
+        m_sup_wait = m_sup_backoff_min;
+    } else if (m_sup_wait < m_sup_backoff_max / 2) {
+        m_sup_wait *= 2;
+    } else {
+        m_sup_wait = m_sup_backoff_max;
+    }
+    m_sup_last = millis();
+    return false;
 }
 
-void ESP8266::rx_empty(void) 
+void ESP8266::setSupervisorTiming(uint32_t check_interval, uint32_t backoff_min, uint32_t backoff_max)
 {
-    while(m_puart->available() > 0) {
-        m_puart->read();
-    }
+    m_sup_interval = check_interval;
+    m_sup_backoff_min = backoff_min;
+    m_sup_backoff_max = backoff_max < backoff_min ? backoff_min : backoff_max;
 }
 
-String ESP8266::recvString(String target, uint32_t timeout)
+uint8_t ESP8266::getLastFault(void)
 {
-    String data;
-    char a;
-    unsigned long start = millis();
-    while (millis() - start < timeout) {
-        while(m_puart->available() > 0) {
-            a = m_puart->read();
-			if(a == '\0') continue;
-            data += a;
-        }
-        if (data.indexOf(target) != -1) {
-            break;
-        }   
-    }
-    return data;
+    return m_fault;
 }
 
-String ESP8266::recvString(String target1, String target2, uint32_t timeout)
+uint8_t ESP8266::getLastResult(void)
 {
-    String data;
-    char a;
-    unsigned long start = millis();
-    while (millis() - start < timeout) {
-        while(m_puart->available() > 0) {
-            a = m_puart->read();
-			if(a == '\0') continue;
-            data += a;
-        }
-        if (data.indexOf(target1) != -1) {
-            break;
-        } else if (data.indexOf(target2) != -1) {
-            break;
-        }
-    }
-    return data;
+    return m_result;
 }
 
-String ESP8266::recvString(String target1, String target2, String target3, uint32_t timeout)
+const ESP8266SupervisorStats &ESP8266::getSupervisorStats(void)
 {
-    String data;
-    char a;
-    unsigned long start = millis();
-    while (millis() - start < timeout) {
-        while(m_puart->available() > 0) {
-            a = m_puart->read();
-			if(a == '\0') continue;
-            data += a;
+    return m_sup_stats;
+}
+
+bool ESP8266::setSleepMode(uint8_t mode)
+{
+    Guard guard(this);
+    return sATSLEEP(mode);
+}
+
+bool ESP8266::deepSleep(uint32_t ms)
+{
+    Guard guard(this);
+    if (sATGSLP(ms)) {
+        m_expect_reset = true;
+        state_clear();
+        return true;
+    }
+    return false;
+}
+
+bool ESP8266::waitWake(uint32_t timeout, bool wait_ip)
+{
+    Guard guard(this);
+    unsigned long start = millis();
+    uint32_t elapsed;
+    String data;
+    bool ret;
+    
+    m_expect_reset = true;
+    ret = execute(CMD_WAIT_READY, NULL, &data, timeout) || eAT(); /* eAT: woken already */
+    if (ret && wait_ip && data.indexOf(F("GOT IP")) == -1) {
+        elapsed = millis() - start;
+        ret = elapsed < timeout && execute(CMD_WAIT_GOT_IP, NULL, NULL, timeout - elapsed);
+    }
+    if (ret && m_opr_mode != 0) {
+        /* Woken with the mode saved in flash, after "GOT IP" not to miss it */
+        ret = sATCWMODECUR(m_opr_mode);
+    }
+    m_expect_reset = false;
+    return ret;
+}
+
+bool ESP8266::recover(uint8_t level)
+{
+    /* 
+     * Level 0: kick, restore only what a spontaneous reset dropped. 
+     * Level 1: kick and rejoin AP. 
+     * Level 2: restart and rejoin AP. 
+     */
+    if (level == 0 && m_fault != ESP8266_FAULT_NO_RESPONSE) {
+        if (!eAT()) {
+            return false;
+        }
+        if (m_fault == ESP8266_FAULT_BUSY) {
+            return true;
+        }
+        return state_restore(m_fault == ESP8266_FAULT_AP_LOST, m_fault == ESP8266_FAULT_RESET);
+    } else if (level <= 1) {
+        if (!eAT()) {
+            return false;
+        }
+        return state_restore(true, m_fault == ESP8266_FAULT_RESET);
+    }
+    m_sup_stats.restarts++;
+    if (!reset_module()) {
+        return false;
+    }
+    return state_restore(true, true);
+}
+
+bool ESP8266::state_restore(bool rejoin, bool reset)
+{
+    uint8_t i;
+    
+    /* Before joining: the mode set by "AT+CWMODE_CUR" is lost at reset */
+    if (reset && m_opr_mode != 0 && !sATCWMODECUR(m_opr_mode)) {
+        return false;
+    }
+    if (rejoin && m_ssid.length() > 0 && !sATCWJAP(m_ssid, m_pwd)) {
+        return false;
+    }
+    /* 
+     * Settings survive unless ESP8266 reset: "AT+CIPMUX" would even fail 
+     * with links up("Link is builded"). Links are dropped with the AP, 
+     * "ALREADY CONNECT" is fine for those still up. 
+     */
+    if (reset) {
+        if (m_mux_mode != 0xFF && !sATCIPMUX(m_mux_mode)) {
+            return false;
+        }
+        if (m_server_port != 0 && !sATCIPSERVER(1, m_server_port)) {
+            return false;
+        }
+        if (m_server_timeout != 0 && !sATCIPSTO(m_server_timeout)) {
+            return false;
+        }
+        memset(m_pending, 0, sizeof(m_pending));
+        if (m_passive && !sATCIPRECVMODE(1)) {
+            return false;
+        }
+    }
+    for (i = 0; i < ESP8266_MAX_LINKS; i++) {
+        if (m_links[i].type == ESP8266_LINK_NONE) {
+            continue;
+        }
+        String type = m_links[i].type == ESP8266_LINK_TCP ? F("TCP") : F("UDP");
+        if (m_mux_mode == 1) {
+            if (!sATCIPSTARTMultiple(i, type, m_links[i].addr, m_links[i].port)) {
+                return false;
+            }
+        } else if (!sATCIPSTARTSingle(type, m_links[i].addr, m_links[i].port)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ESP8266::state_clear(void)
+{
+    uint8_t i;
+    m_mux_mode = 0xFF;
+    m_server_port = 0;
+    m_server_timeout = 0;
+    m_link_up = 0;
+    m_passive = false;
+    m_park_len = 0;
+    memset(m_pending, 0, sizeof(m_pending));
+    for (i = 0; i < ESP8266_MAX_LINKS; i++) {
+        m_links[i].type = ESP8266_LINK_NONE;
+    }
+}
+
+void ESP8266::fault_set(uint8_t fault)
+{
+    if (m_fault == ESP8266_FAULT_NONE) {
+        m_fault = fault;
+        m_fault_since = millis();
+        m_sup_level = 0;
+        m_sup_wait = 0;
+        m_sup_stats.faults++;
+    }
+}
+
+void ESP8266::fault_check(const char *line)
+{
+    if (strncmp_P(line, r_busy, 5) == 0) {
+        fault_set(ESP8266_FAULT_BUSY);
+    } else if (!m_expect_reset && strcmp_P(line, t_ready) == 0) {
+        fault_set(ESP8266_FAULT_RESET);
+    } else if (!m_ap_change && m_ssid.length() > 0 && strcmp_P(line, l_wifi_disconnect) == 0) {
+        fault_set(ESP8266_FAULT_AP_LOST);
+    }
+}
+
+bool ESP8266::send(const uint8_t *buffer, uint32_t len)
+{
+    Guard guard(this);
+    return sATCIPSENDSingle(buffer, len);
+}
+
+bool ESP8266::send(uint8_t mux_id, const uint8_t *buffer, uint32_t len)
+{
+    Guard guard(this);
+    return sATCIPSENDMultiple(mux_id, buffer, len);
+}
+
+bool ESP8266::sendAsync(uint8_t mux_id, const uint8_t *buffer, uint32_t len)
+{
+    Guard guard(this);
+    return sATCIPSENDMultipleAsync(mux_id, buffer, len);
+}
+
+bool ESP8266::sendWait(uint32_t timeout)
+{
+    Guard guard(this);
+    return execute(CMD_SEND_OK, NULL, NULL, timeout);
+}
+
+bool ESP8266::send(const ESP8266Segment *segments, uint8_t count)
+{
+    Guard guard(this);
+    return sATCIPSENDSingle(segments, count);
+}
+
+bool ESP8266::send(uint8_t mux_id, const ESP8266Segment *segments, uint8_t count)
+{
+    Guard guard(this);
+    return sATCIPSENDMultiple(mux_id, segments, count);
+}
+
+bool ESP8266::send(Stream &src, uint32_t len)
+{
+    Guard guard(this);
+    return sATCIPSENDSource(0xFF, &src, NULL, len);
+}
+
+bool ESP8266::send(uint8_t mux_id, Stream &src, uint32_t len)
+{
+    Guard guard(this);
+    return sATCIPSENDSource(mux_id, &src, NULL, len);
+}
+
+bool ESP8266::send(ESP8266Producer producer, uint32_t len)
+{
+    Guard guard(this);
+    return sATCIPSENDSource(0xFF, NULL, producer, len);
+}
+
+bool ESP8266::send(uint8_t mux_id, ESP8266Producer producer, uint32_t len)
+{
+    Guard guard(this);
+    return sATCIPSENDSource(mux_id, NULL, producer, len);
+}
+
+uint32_t ESP8266::recv(uint8_t *buffer, uint32_t buffer_size, uint32_t timeout)
+{
+    Guard guard(this);
+    if (m_passive) {
+        return recvPassive(0, buffer, buffer_size, timeout, NULL);
+    }
+    return recvPkg(0xFF, buffer, buffer_size, timeout, NULL);
+}
+
+uint32_t ESP8266::recv(uint8_t mux_id, uint8_t *buffer, uint32_t buffer_size, uint32_t timeout)
+{
+    Guard guard(this);
+    if (m_passive) {
+        return recvPassive(mux_id, buffer, buffer_size, timeout, NULL);
+    }
+    return recvPkg(mux_id, buffer, buffer_size, timeout, NULL);
+}
+
+uint32_t ESP8266::recv(uint8_t *coming_mux_id, uint8_t *buffer, uint32_t buffer_size, uint32_t timeout)
+{
+    Guard guard(this);
+    if (m_passive) {
+        return recvPassive(0xFF, buffer, buffer_size, timeout, coming_mux_id);
+    }
+    return recvPkg(0xFF, buffer, buffer_size, timeout, coming_mux_id);
+}
+
+void ESP8266::setRecvHandler(ESP8266RecvHandler handler)
+{
+    m_recv_handler = handler;
+}
+
+uint32_t ESP8266::poll(uint32_t timeout)
+{
+    Guard guard(this);
+    uint8_t stage[ESP8266_STAGE_SIZE];
+    uint32_t delivered = 0;
+    unsigned long start = millis();
+    uint32_t n;
+    uint8_t id;
+    
+    /* Parked while a command was waiting, and older than the rest */
+    while (m_recv_handler && (n = unpark(0xFF, stage, sizeof(stage), &id)) > 0) {
+        m_recv_handler(id, stage, n);
+        delivered += n;
+    }
+    if (delivered > 0) {
+        return delivered;
+    }
+    
+    rts_set(true);
+    do {
+        while (m_pio->available() > 0) {
+            if (m_ipd_left > 0) {
+                delivered += ipd_deliver();
+            } else {
+                rx_char(m_pio->read());
+            }
+        }
+        if (delivered > 0 && m_ipd_left == 0) {
+            break;
+        }
+        io_wait(start, timeout);
+    } while (millis() - start < timeout);
+    rts_set(false);
+    return delivered;
+}
+
+/*----------------------------------------------------------------------------*/
+/* +IPD,<id>,<len>:<data> */
+/* +IPD,<len>:<data> */
+
+uint32_t ESP8266::recvPkg(uint8_t mux_id, uint8_t *buffer, uint32_t buffer_size, uint32_t timeout, uint8_t *coming_mux_id)
+{
+    unsigned long start;
+    uint32_t ret;
+    uint32_t limit;
+    uint32_t gap = 0;           /* Longest gap between bytes of data */
+    uint32_t i = 0;
+    
+    if (buffer == NULL || buffer_size == 0) {
+        return 0;
+    }
+    ret = unpark(mux_id, buffer, buffer_size, coming_mux_id);
+    if (ret > 0) {
+        return ret;
+    }
+    
+    rts_set(true);
+    start = millis();
+    while (m_ipd_left == 0 || m_ipd_id == ESP8266_MAX_LINKS) {
+        if (m_pio->available() > 0) {
+            if (m_ipd_left > 0) {
+                ipd_deliver(); /* Dropped */
+            } else {
+                rx_char(m_pio->read());
+            }
+        } else if (millis() - start < timeout) {
+            io_wait(start, timeout);
+        } else {
+            rts_set(false);
+            return 0;
+        }
+    }
+    if (mux_id != 0xFF && m_ipd_id != mux_id) {
+        rts_set(false);
+        return 0; /* Left for the recv of its link */
+    }
+    
+    /* The rest of a payload longer than buffer is kept for next call */
+    ret = m_ipd_left < buffer_size ? m_ipd_left : buffer_size;
+    limit = rtt_timeout(RTT_PAYLOAD, 3000);
+    start = millis();
+    while (i < ret) {
+        if (m_pio->available() > 0) {
+            buffer[i++] = m_pio->read();
+            m_ipd_left--;
+            if (millis() - start > gap) {
+                gap = millis() - start;
+            }
+            start = millis();
+        } else if (millis() - start < limit) {
+            io_wait(start, limit);
+        } else {
+            /* Bytes lost on uart, give up the payload */
+            rtt_update(RTT_PAYLOAD, false, limit, 3000);
+            m_ipd_left = 0;
+            break;
+        }
+    }
+    if (i == ret) {
+        rtt_update(RTT_PAYLOAD, true, gap, 3000);
+    }
+    if (coming_mux_id) {
+        *coming_mux_id = m_ipd_id;
+    }
+    rts_set(false);
+    return i;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Passive mode: +IPD,<id>,<len> or +IPD,<len> notifies, AT+CIPRECVDATA pulls */
+
+uint32_t ESP8266::recvPassive(uint8_t mux_id, uint8_t *buffer, uint32_t buffer_size, uint32_t timeout, uint8_t *coming_mux_id)
+{
+    unsigned long start;
+    uint32_t ret;
+    uint8_t i;
+    uint8_t id;
+    
+    if (buffer == NULL || buffer_size == 0 || (mux_id != 0xFF && mux_id >= ESP8266_MAX_LINKS)) {
+        return 0;
+    }
+    start = millis();
+    while (true) {
+        for (i = 0; i < ESP8266_MAX_LINKS; i++) {
+            id = mux_id != 0xFF ? mux_id : (m_passive_next + i) % ESP8266_MAX_LINKS;
+            if (m_pending[id] > 0) {
+                ret = recvPassiveData(id, buffer, buffer_size);
+                if (ret > 0) {
+                    m_passive_next = (id + 1) % ESP8266_MAX_LINKS;
+                    if (coming_mux_id) {
+                        *coming_mux_id = id;
+                    }
+                    return ret;
+                }
+            }
+            if (mux_id != 0xFF) {
+                break;
+            }
+        }
+        if (millis() - start >= timeout) {
+            break;
+        }
+        /* Wait for a notification */
+        if (m_pio->available() > 0) {
+            rx_char(m_pio->read());
+        } else {
+            io_wait(start, timeout);
+        }
+    }
+    return 0;
+}
+
+uint32_t ESP8266::recvPassiveData(uint8_t mux_id, uint8_t *buffer, uint32_t buffer_size)
+{
+    String head;
+    String resp;
+    Arg args[2];
+    uint32_t want;
+    int32_t index = -1;
+    int32_t len = -1;
+    uint32_t i = 0;
+    uint32_t limit;
+    unsigned long start;
+    char a;
+    
+    want = m_pending[mux_id] < buffer_size ? m_pending[mux_id] : buffer_size;
+    want = want < ESP8266_SEND_MAX ? want : ESP8266_SEND_MAX;
+    if (m_flow_mode == ESP8266_FLOW_SOFTWARE && want > m_flow_chunk) {
+        want = m_flow_chunk; /* No more than mainboard takes at once */
+    }
+    if (m_mux_mode == 1) {
+        args[0].u = mux_id;
+        args[1].u = want;
+        limit = command(CMD_CIPRECVDATA_M, args);
+    } else {
+        args[0].u = want;
+        limit = command(CMD_CIPRECVDATA_S, args);
+    }
+    
+    /* +CIPRECVDATA,<len>:<data> or +CIPRECVDATA:<len>,<data> */
+    rts_set(true);
+    start = millis();
+    while (millis() - start < limit && len < 0) {
+        if (m_pio->available() <= 0) {
+            io_wait(start, limit);
+            continue;
+        }
+        a = m_pio->read();
+        head += a;
+        rx_char(a);
+        if (index == -1) {
+            index = head.indexOf(F("+CIPRECVDATA"));
+            if (index == -1 && head.endsWith(F("ERROR"))) {
+                break;
+            }
+        } else if ((a == ':' || a == ',') && (int32_t)head.length() > index + 14) {
+            len = head.substring(index + 13, head.length() - 1).toInt();
+            m_line_len = 0; /* Raw data follows */
+        }
+    }
+    if (len < 0) {
+        rts_set(false);
+        return 0;
+    }
+    
+    limit = rtt_timeout(RTT_PAYLOAD, 3000);
+    start = millis();
+    while (i < (uint32_t)len && millis() - start < limit) {
+        if (m_pio->available() > 0) {
+            a = m_pio->read();
+            if (i < buffer_size) {
+                buffer[i] = a;
+            }
+            i++;
+            start = millis();
+        } else {
+            io_wait(start, limit);
+        }
+    }
+    rts_set(false);
+    recvToken(resp, t_ok, NULL, t_error, 1000);
+    
+    if ((uint32_t)len < want || (uint32_t)len >= m_pending[mux_id]) {
+        m_pending[mux_id] = 0; /* Drained(the notifications were more than data) */
+    } else {
+        m_pending[mux_id] -= len;
+    }
+    return i < buffer_size ? i : buffer_size;
+}
+
+/*
+ * Copy the field at p(quoted or not) to out and return the next field. 
+ */
+static const char *scan_field(const char *p, char *out, uint8_t size)
+{
+    uint8_t n = 0;
+    bool quoted = *p == '"';
+    
+    if (quoted) {
+        p++;
+    }
+    while (*p != '\0') {
+        if (quoted ? (p[0] == '"' && (p[1] == ',' || p[1] == ')' || p[1] == '\0')) 
+            : (*p == ',' || *p == ')')) {
+            break;
+        }
+        if (n + 1 < size) {
+            out[n++] = *p;
+        }
+        p++;
+    }
+    out[n] = '\0';
+    if (quoted && *p == '"') {
+        p++;
+    }
+    return *p == ',' ? p + 1 : NULL;
+}
+
+static uint8_t scan_hex(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return 0;
+}
+
+/* +CWLAP:(<ecn>,"<ssid>",<rssi>,"<mac>",<channel>,...) */
+
+void ESP8266::scan_line(void)
+{
+    ESP8266AP ap;
+    char field[33];
+    const char *p;
+    uint8_t k;
+    uint8_t i;
+    
+    if (m_scan_line == F("OK")) {
+        m_scan_state = ESP8266_SCAN_DONE;
+        m_result = ESP8266_RESULT_OK;
+        return;
+    }
+    if (m_scan_line == F("ERROR") || m_scan_line == F("FAIL") || m_scan_line.startsWith(F("busy "))) {
+        m_scan_state = ESP8266_SCAN_FAILED;
+        m_result = m_scan_line == F("ERROR") ? ESP8266_RESULT_ERROR 
+            : m_scan_line == F("FAIL") ? ESP8266_RESULT_FAIL : ESP8266_RESULT_BUSY;
+        return;
+    }
+    if (!m_scan_line.startsWith(F("+CWLAP:("))) {
+        return;
+    }
+    
+    memset(&ap, 0, sizeof(ap));
+    p = m_scan_line.c_str() + 8;
+    for (k = 0; p != NULL && k < 5; k++) {
+        p = scan_field(p, k == 1 ? ap.ssid : field, k == 1 ? sizeof(ap.ssid) : sizeof(field));
+        if (k == 0) {
+            ap.ecn = atoi(field);
+        } else if (k == 2) {
+            ap.rssi = atoi(field);
+        } else if (k == 3) {
+            for (i = 0; i < 6 && (size_t)(i * 3 + 1) < strlen(field); i++) {
+                ap.mac[i] = (scan_hex(field[i * 3]) << 4) | scan_hex(field[i * 3 + 1]);
+            }
+        } else if (k == 4) {
+            ap.channel = atoi(field);
+        }
+    }
+    if ((m_scan_channel != 0 && ap.channel != m_scan_channel)
+        || (m_scan_ssid.length() > 0 && m_scan_ssid != ap.ssid)) {
+        return;
+    }
+    
+    if (m_scan_callback) {
+        m_scan_callback(ap);
+    }
+    if (m_scan_results) {
+        /* Insert sorted, the weakest falls off when full */
+        for (i = m_scan_count; i > 0 && m_scan_results[i - 1].rssi < ap.rssi; i--) {
+            if (i < m_scan_size) {
+                m_scan_results[i] = m_scan_results[i - 1];
+            }
+        }
+        if (i < m_scan_size) {
+            m_scan_results[i] = ap;
+            if (m_scan_count < m_scan_size) {
+                m_scan_count++;
+            }
+        }
+    }
+}
+
+void ESP8266::rx_char(char c)
+{
+    char *comma;
+    long len;
+    long id = 0;
+    
+    if (c == '\n') {
+        m_line[m_line_len] = '\0';
+        rx_line();
+        m_line_len = 0;
+        return;
+    }
+    if (c == '\r' || c == '\0') {
+        return;
+    }
+    if (m_line_len < sizeof(m_line) - 1) {
+        m_line[m_line_len++] = c;
+    }
+    if (c != ':' || m_line_len < 7 || strncmp_P(m_line, l_ipd, 5) != 0 
+        || m_line[5] < '0' || m_line[5] > '9') {
+        return;
+    }
+    
+    /* +IPD,<id>,<len>: or +IPD,<len>:(maybe followed by the remote of AT+CIPDINFO) */
+    m_line[m_line_len] = '\0';
+    m_line_len = 0;
+    comma = strchr(m_line + 5, ',');
+    if (comma && m_mux_mode != 0) {
+        id = atol(m_line + 5);
+        len = atol(comma + 1);
+    } else {
+        len = atol(m_line + 5);
+    }
+    if (len > 0) {
+        /* Still consumed beyond ESP8266_MAX_LINKS, not to be parsed as lines */
+        m_ipd_id = id < ESP8266_MAX_LINKS ? id : ESP8266_MAX_LINKS;
+        m_ipd_left = len;
+    }
+}
+
+void ESP8266::rx_line(void)
+{
+    const char *p = m_line;
+    char *comma;
+    uint32_t len;
+    uint8_t id = 0;
+    
+    fault_check(m_line);
+    
+    /* <id>,CONNECT or <id>,CLOSED(CONNECT or CLOSED in single mode) */
+    if (m_line[0] >= '0' && m_line[0] <= '9' && (comma = strchr(m_line, ',')) != NULL) {
+        id = atoi(m_line);
+        p = comma + 1;
+    }
+    if (id < ESP8266_MAX_LINKS) {
+        if (strcmp_P(p, l_connect) == 0) {
+            m_link_up |= (uint16_t)1 << id;
+        } else if (strcmp_P(p, l_closed) == 0) {
+            m_link_up &= ~((uint16_t)1 << id);
+        }
+    }
+    
+    if (m_passive && strncmp_P(m_line, l_ipd, 5) == 0) {
+        /* +IPD,<id>,<len> or +IPD,<len> */
+        comma = strchr(m_line + 5, ',');
+        if (comma) {
+            id = atoi(m_line + 5);
+            len = atol(comma + 1);
+        } else {
+            id = 0;
+            len = atol(m_line + 5);
+        }
+        if (id < ESP8266_MAX_LINKS) {
+            len += m_pending[id];
+            m_pending[id] = len < 0xFFFF ? len : 0xFFFF;
+        }
+    }
+}
+
+uint32_t ESP8266::ipd_deliver(void)
+{
+    uint8_t stage[ESP8266_STAGE_SIZE];
+    uint16_t n = 0;
+    uint32_t done = 0;
+    
+    while (m_ipd_left > 0 && m_pio->available() > 0) {
+        stage[n++] = m_pio->read();
+        m_ipd_left--;
+        /* Hand over what arrived so far instead of waiting for a full slice */
+        if (n == sizeof(stage) || m_ipd_left == 0 || m_pio->available() <= 0) {
+            if (m_ipd_id == ESP8266_MAX_LINKS) {
+                /* Dropped, of a link beyond ESP8266_MAX_LINKS */
+            } else if (m_recv_handler) {
+                m_recv_handler(m_ipd_id, stage, n);
+                done += n;
+            } else {
+                park(m_ipd_id, stage, n);
+                done += n;
+            }
+            n = 0;
         }
-        if (data.indexOf(target1) != -1) {
-            break;
-        } else if (data.indexOf(target2) != -1) {
-            break;
-        } else if (data.indexOf(target3) != -1) {
+    }
+    return done;
+}
+
+void ESP8266::park(uint8_t mux_id, const uint8_t *data, uint16_t len)
+{
+    uint16_t n;
+    
+    while (len > 0 && m_park_len + 2u < sizeof(m_park)) {
+        n = sizeof(m_park) - m_park_len - 2;
+        if (n > len) {
+            n = len;
+        }
+        if (n > 0xFF) {
+            n = 0xFF;
+        }
+        m_park[m_park_len] = mux_id;
+        m_park[m_park_len + 1] = n;
+        memcpy(m_park + m_park_len + 2, data, n);
+        m_park_len += 2 + n;
+        data += n;
+        len -= n;
+    }
+}
+
+uint32_t ESP8266::unpark(uint8_t mux_id, uint8_t *buffer, uint32_t buffer_size, uint8_t *coming_mux_id)
+{
+    uint32_t done = 0;
+    uint16_t i = 0;
+    uint16_t n;
+    
+    while (i < m_park_len) {
+        if (mux_id != 0xFF && m_park[i] != mux_id) {
+            i += 2 + m_park[i + 1];
+            continue;
+        }
+        mux_id = m_park[i]; /* The rest from the same link only */
+        n = m_park[i + 1];
+        if (buffer) {
+            if (done == buffer_size) {
+                break;
+            }
+            if (n > buffer_size - done) {
+                n = buffer_size - done;
+            }
+            memcpy(buffer + done, m_park + i + 2, n);
+        }
+        done += n;
+        if (n < m_park[i + 1]) {
+            /* Keep the rest of the record */
+            m_park[i + 1] -= n;
+            memmove(m_park + i + 2, m_park + i + 2 + n, m_park_len - i - 2 - n);
+            m_park_len -= n;
             break;
         }
+        memmove(m_park + i, m_park + i + 2 + n, m_park_len - i - 2 - n);
+        m_park_len -= 2 + n;
     }
-    return data;
+    if (done > 0 && coming_mux_id) {
+        *coming_mux_id = mux_id;
+    }
+    return done;
 }
 
-bool ESP8266::recvFind(String target, uint32_t timeout)
+bool ESP8266::uart_write(const uint8_t *buffer, uint32_t len)
 {
-    String data_tmp;
-    data_tmp = recvString(target, timeout);
-    if (data_tmp.indexOf(target) != -1) {
-        return true;
+    uint32_t i;
+    uint32_t n;
+    unsigned long start;
+    
+    if (m_flow_mode == ESP8266_FLOW_HARDWARE && m_cts_pin != ESP8266_PIN_NONE) {
+        for (i = 0; i < len; i += n) {
+            /* The tx buffer goes out whatever CTS says, let it empty first */
+            m_pio->flush();
+            start = millis();
+            while (digitalRead(m_cts_pin) == HIGH) {
+                if (millis() - start >= 1000) {
+                    m_result = ESP8266_RESULT_TIMEOUT;
+                    fault_set(ESP8266_FAULT_NO_RESPONSE);
+                    return false;
+                }
+                /* ESP8266 is busy, hold on */
+                if (m_wait) {
+                    m_wait(1);
+                }
+            }
+            n = len - i < ESP8266_CTS_BLOCK ? len - i : ESP8266_CTS_BLOCK;
+            m_pio->write(buffer + i, n);
+        }
+    } else if (m_flow_mode == ESP8266_FLOW_SOFTWARE) {
+        for (i = 0; i < len; i++) {
+            m_pio->write(buffer[i]);
+            if ((i + 1) % m_flow_chunk == 0 && i + 1 < len) {
+                m_pio->flush();
+                delay(m_flow_pause);
+            }
+        }
+    } else {
+        m_pio->write(buffer, len);
     }
-    return false;
+    return true;
 }
 
-bool ESP8266::recvFindAndFilter(String target, String begin, String end, String &data, uint32_t timeout)
+bool ESP8266::uart_write(const ESP8266Segment *segments, uint8_t count)
 {
-    String data_tmp;
-    data_tmp = recvString(target, timeout);
-    if (data_tmp.indexOf(target) != -1) {
-        int32_t index1 = data_tmp.indexOf(begin);
-        int32_t index2 = data_tmp.indexOf(end);
-        if (index1 != -1 && index2 != -1) {
-            index1 += begin.length();
-            data = data_tmp.substring(index1, index2);
-            return true;
+    uint8_t tmp[16];
+    uint32_t i;
+    uint32_t n;
+    uint8_t k;
+    
+    for (k = 0; k < count; k++) {
+        if (!segments[k].progmem) {
+            if (!uart_write(segments[k].data, segments[k].len)) {
+                return false;
+            }
+            continue;
+        }
+        for (i = 0; i < segments[k].len; i += n) {
+            n = segments[k].len - i;
+            if (n > sizeof(tmp)) {
+                n = sizeof(tmp);
+            }
+            memcpy_P(tmp, segments[k].data + i, n);
+            if (!uart_write(tmp, n)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void ESP8266::rts_set(bool ready)
+{
+    if (m_flow_mode == ESP8266_FLOW_HARDWARE && m_rts_pin != ESP8266_PIN_NONE) {
+        digitalWrite(m_rts_pin, ready ? LOW : HIGH);
+    }
+}
+
+void ESP8266::io_wait(unsigned long start, uint32_t timeout)
+{
+    uint32_t elapsed;
+    if (m_wait && m_pio->available() <= 0) {
+        elapsed = millis() - start;
+        if (elapsed < timeout) {
+            m_wait(timeout - elapsed);
+        }
+    }
+}
+
+void ESP8266::rx_empty(void) 
+{
+    /* Through the parser: notifications and faults are not to be lost */
+    while(m_pio->available() > 0) {
+        if (m_ipd_left > 0) {
+            ipd_deliver();
+        } else {
+            rx_char(m_pio->read());
+        }
+    }
+}
+
+uint16_t ESP8266::command(uint8_t id, const Arg *args)
+{
+    ESP8266Command cmd;
+    const char *p;
+    char f;
+    
+    memcpy_P(&cmd, &s_commands[id], sizeof(cmd));
+    if (cmd.text) {
+        rx_empty();
+        m_pio->print((const __FlashStringHelper *)cmd.text);
+        for (p = cmd.args; (f = pgm_read_byte(p)) != '\0'; p++) {
+            if (f == 's') {
+                m_pio->print('"');
+                m_pio->print(args->s);
+                m_pio->print('"');
+                args++;
+            } else if (f == 'r') {
+                m_pio->print(args->s);
+                args++;
+            } else if (f == 'u') {
+                m_pio->print(args->u);
+                args++;
+            } else {
+                m_pio->print(f);
+            }
         }
+        m_pio->println();
     }
-    data = "";
+    return cmd.timeout;
+}
+
+bool ESP8266::execute(uint8_t id, const Arg *args, String *data, uint32_t timeout)
+{
+    ESP8266Command cmd;
+    String resp;
+    unsigned long start;
+    uint32_t limit;
+    
+    command(id, args);
+    memcpy_P(&cmd, &s_commands[id], sizeof(cmd));
+    start = millis();
+    limit = timeout ? timeout : rtt_timeout(cmd.rtt, cmd.timeout);
+    /* Waiting for an event, not a response: only its own token ends it */
+    m_result = recvToken(resp, cmd.ok, cmd.ok2, cmd.fail, limit, 
+        id != CMD_WAIT_READY && id != CMD_WAIT_GOT_IP);
+    if (m_result != ESP8266_RESULT_TIMEOUT || timeout == 0) {
+        rtt_update(cmd.rtt, m_result != ESP8266_RESULT_TIMEOUT, 
+            m_result != ESP8266_RESULT_TIMEOUT ? millis() - start : limit, cmd.timeout);
+    }
+    if (data) {
+        *data = resp;
+    }
+    return m_result == ESP8266_RESULT_OK;
+}
+
+uint32_t ESP8266::rtt_timeout(uint8_t cls, uint32_t fixed)
+{
+    uint32_t rto;
+    if (m_rtt_ceiling != 0 && m_rtt_ceiling < fixed) {
+        fixed = m_rtt_ceiling;
+    }
+    if (!m_rtt_enabled || cls >= RTT_COUNT || m_srtt[cls] == RTT_NONE) {
+        return fixed;
+    }
+    rto = (uint32_t)m_srtt[cls] + 4 * (uint32_t)m_rttvar[cls];
+    if (rto < m_rtt_floor) {
+        rto = m_rtt_floor;
+    }
+    return rto < fixed ? rto : fixed;
+}
+
+void ESP8266::rtt_update(uint8_t cls, bool ok, uint32_t elapsed, uint32_t fixed)
+{
+    uint32_t delta;
+    if (cls >= RTT_COUNT) {
+        return;
+    }
+    if (elapsed >= RTT_NONE) {
+        elapsed = RTT_NONE - 1;
+    }
+    if (!ok) {
+        /* Back off: srtt + 4 * rttvar becomes 3 times of the timeout expired */
+        if (m_srtt[cls] != RTT_NONE) {
+            m_srtt[cls] = elapsed < fixed ? elapsed : fixed;
+            m_rttvar[cls] = m_srtt[cls] / 2;
+        }
+    } else if (m_srtt[cls] == RTT_NONE) {
+        m_srtt[cls] = elapsed;
+        m_rttvar[cls] = elapsed / 2;
+    } else {
+        /* rttvar = 3/4 rttvar + 1/4 |srtt - r|, srtt = 7/8 srtt + 1/8 r */
+        delta = m_srtt[cls] > elapsed ? m_srtt[cls] - elapsed : elapsed - m_srtt[cls];
+        m_rttvar[cls] = (3 * (uint32_t)m_rttvar[cls] + delta) / 4;
+        m_srtt[cls] = (7 * (uint32_t)m_srtt[cls] + elapsed) / 8;
+    }
+}
+
+uint8_t ESP8266::recvToken(String &data, const char *t0, const char *t1, const char *t2, 
+    uint32_t timeout, bool terminals)
+{
+    ESP8266Terminal term;
+    uint8_t result = ESP8266_RESULT_TIMEOUT;
+    uint8_t i;
+    char a;
+    uint32_t line_start = 0;
+    const char *line;
+    uint32_t len;
+    bool eol;
+    unsigned long start = millis();
+    
+    rts_set(true);
+    while (millis() - start < timeout && result == ESP8266_RESULT_TIMEOUT) {
+        while(result == ESP8266_RESULT_TIMEOUT && m_pio->available() > 0) {
+            if (m_ipd_left > 0) {
+                ipd_deliver(); /* Payload is not a response */
+                continue;
+            }
+            a = m_pio->read();
+			if(a == '\0') continue;
+            data += a;
+            rx_char(a);
+            if (m_ipd_left > 0) {
+                data.remove(line_start); /* "+IPD,<id>,<len>:" */
+                continue;
+            }
+            /* Only the newest line, as each byte arrives */
+            line = data.c_str() + line_start;
+            len = data.length() - line_start;
+            eol = a == '\n';
+            if (token_match(line, len, eol, t0) || token_match(line, len, eol, t1)) {
+                result = ESP8266_RESULT_OK;
+            }
+            for (i = 0; result == ESP8266_RESULT_TIMEOUT && terminals 
+                && i < sizeof(terminal_tokens) / sizeof(terminal_tokens[0]); i++) {
+                memcpy_P(&term, &terminal_tokens[i], sizeof(term));
+                if (token_match(line, len, eol, term.token)) {
+                    result = term.result;
+                }
+            }
+            if (result == ESP8266_RESULT_TIMEOUT && token_match(line, len, eol, t2)) {
+                result = t2 == t_fail ? ESP8266_RESULT_FAIL : ESP8266_RESULT_ERROR;
+            }
+            if (eol) {
+                line_start = data.length();
+            }
+        }
+        if (result == ESP8266_RESULT_TIMEOUT) {
+            io_wait(start, timeout);
+        }
+    }
+    rts_set(false);
+    return result;
+}
+
+bool ESP8266::token_match(const char *line, uint32_t len, bool eol, const char *token)
+{
+    uint32_t n;
+    if (token == NULL) {
+        return false;
+    }
+    n = strlen_P(token);
+    if (pgm_read_byte(token) == '\r') {
+        /* Line endings like "\r\r\n" of an echo: at the end of a line */
+        return eol && len >= n && strcmp_P(line + len - n, token) == 0;
+    }
+    /* Decided once, when the line gets as long as the token */
+    return len == n && strncmp_P(line, token, n) == 0;
+}
+
+bool ESP8266::filter(const String &data, const __FlashStringHelper *begin, 
+    const __FlashStringHelper *end, String &out)
+{
+    String b(begin);
+    int32_t index1 = data.indexOf(b);
+    int32_t index2 = data.indexOf(String(end));
+    if (index1 != -1 && index2 != -1) {
+        index1 += b.length();
+        out = data.substring(index1, index2);
+        return true;
+    }
+    out = "";
     return false;
 }
 
 bool ESP8266::eAT(void)
 {
-    rx_empty();
-    m_puart->println("AT");
-    return recvFind("OK");
+    return execute(CMD_AT);
 }
 
 bool ESP8266::eATRST(void) 
 {
-    rx_empty();
-    m_puart->println("AT+RST");
-    return recvFind("OK");
+    return execute(CMD_RST);
 }
 
 bool ESP8266::eATGMR(String &version)
 {
-    rx_empty();
-    m_puart->println("AT+GMR");
-    return recvFindAndFilter("OK", "\r\r\n", "\r\n\r\nOK", version); 
+    String data;
+    if (!execute(CMD_GMR, NULL, &data)) {
+        version = "";
+        return false;
+    }
+    return filter(data, F("\r\r\n"), F("\r\n\r\nOK"), version); 
 }
 
 bool ESP8266::qATCWMODE(uint8_t *mode) 
 {
+    String data;
     String str_mode;
-    bool ret;
     if (!mode) {
         return false;
     }
-    rx_empty();
-    m_puart->println("AT+CWMODE?");
-    ret = recvFindAndFilter("OK", "+CWMODE:", "\r\n\r\nOK", str_mode); 
-    if (ret) {
+    if (execute(CMD_CWMODE_Q, NULL, &data) 
+        && filter(data, F("+CWMODE:"), F("\r\n\r\nOK"), str_mode)) {
         *mode = (uint8_t)str_mode.toInt();
         return true;
-    } else {
-        return false;
     }
+    return false;
 }
 
 bool ESP8266::sATCWMODE(uint8_t mode)
 {
-    String data;
-    rx_empty();
-    m_puart->print("AT+CWMODE=");
-    m_puart->println(mode);
-    
-    data = recvString("OK", "no change");
-    if (data.indexOf("OK") != -1 || data.indexOf("no change") != -1) {
-        return true;
-    }
-    return false;
+    Arg args[1];
+    args[0].u = mode;
+    return execute(CMD_CWMODE, args);
+}
+
+bool ESP8266::sATCWMODECUR(uint8_t mode)
+{
+    Arg args[1];
+    args[0].u = mode;
+    return execute(CMD_CWMODE_CUR, args);
 }
 
 bool ESP8266::sATCWJAP(String ssid, String pwd)
 {
-    String data;
-    rx_empty();
-    m_puart->print("AT+CWJAP=\"");
-    m_puart->print(ssid);
-    m_puart->print("\",\"");
-    m_puart->print(pwd);
-    m_puart->println("\"");
-    
-    data = recvString("OK", "FAIL", 10000);
-    if (data.indexOf("OK") != -1) {
-        return true;
-    }
-    return false;
+    Arg args[2];
+    bool ret;
+    args[0].s = ssid.c_str();
+    args[1].s = pwd.c_str();
+    m_ap_change = true; /* Leaving the AP joined before is not a fault */
+    ret = execute(CMD_CWJAP, args);
+    m_ap_change = false;
+    return ret;
 }
 
 bool ESP8266::sATCWDHCP(uint8_t mode, boolean enabled)
 {
-	String strEn = "0";
-	if (enabled) {
-		strEn = "1";
-	}
-	
-	
-    String data;
-    rx_empty();
-    m_puart->print("AT+CWDHCP=");
-    m_puart->print(strEn);
-    m_puart->print(",");
-    m_puart->println(mode);
-    
-    data = recvString("OK", "FAIL", 10000);
-    if (data.indexOf("OK") != -1) {
-        return true;
-    }
-    return false;
+    Arg args[2];
+    args[0].u = enabled ? 1 : 0;
+    args[1].u = mode;
+    return execute(CMD_CWDHCP, args);
 }
 
 bool ESP8266::eATCWLAP(String &list)
 {
     String data;
-    rx_empty();
-    m_puart->println("AT+CWLAP");
-    return recvFindAndFilter("OK", "\r\r\n", "\r\n\r\nOK", list, 10000);
+    if (!execute(CMD_CWLAP, NULL, &data)) {
+        list = "";
+        return false;
+    }
+    return filter(data, F("\r\r\n"), F("\r\n\r\nOK"), list);
 }
 
 bool ESP8266::eATCWQAP(void)
 {
-    String data;
-    rx_empty();
-    m_puart->println("AT+CWQAP");
-    return recvFind("OK");
+    bool ret;
+    m_ap_change = true;
+    ret = execute(CMD_CWQAP);
+    m_ap_change = false;
+    return ret;
 }
 
 bool ESP8266::sATCWSAP(String ssid, String pwd, uint8_t chl, uint8_t ecn)
 {
-    String data;
-    rx_empty();
-    m_puart->print("AT+CWSAP=\"");
-    m_puart->print(ssid);
-    m_puart->print("\",\"");
-    m_puart->print(pwd);
-    m_puart->print("\",");
-    m_puart->print(chl);
-    m_puart->print(",");
-    m_puart->println(ecn);
-    
-    data = recvString("OK", "ERROR", 5000);
-    if (data.indexOf("OK") != -1) {
-        return true;
-    }
-    return false;
+    Arg args[4];
+    args[0].s = ssid.c_str();
+    args[1].s = pwd.c_str();
+    args[2].u = chl;
+    args[3].u = ecn;
+    return execute(CMD_CWSAP, args);
 }
 
 bool ESP8266::eATCWLIF(String &list)
 {
     String data;
-    rx_empty();
-    m_puart->println("AT+CWLIF");
-    return recvFindAndFilter("OK", "\r\r\n", "\r\n\r\nOK", list);
+    if (!execute(CMD_CWLIF, NULL, &data)) {
+        list = "";
+        return false;
+    }
+    return filter(data, F("\r\r\n"), F("\r\n\r\nOK"), list);
 }
 bool ESP8266::eATCIPSTATUS(String &list)
 {
     String data;
     delay(100);
-    rx_empty();
-    m_puart->println("AT+CIPSTATUS");
-    return recvFindAndFilter("OK", "\r\r\n", "\r\n\r\nOK", list);
+    if (!execute(CMD_CIPSTATUS, NULL, &data)) {
+        list = "";
+        return false;
+    }
+    return filter(data, F("\r\r\n"), F("\r\n\r\nOK"), list);
 }
 bool ESP8266::sATCIPSTARTSingle(String type, String addr, uint32_t port)
 {
-    String data;
-    rx_empty();
-    m_puart->print("AT+CIPSTART=\"");
-    m_puart->print(type);
-    m_puart->print("\",\"");
-    m_puart->print(addr);
-    m_puart->print("\",");
-    m_puart->println(port);
-    
-    data = recvString("OK", "ERROR", "ALREADY CONNECT", 10000);
-    if (data.indexOf("OK") != -1 || data.indexOf("ALREADY CONNECT") != -1) {
-        return true;
+    Arg args[3];
+    args[0].s = type.c_str();
+    args[1].s = addr.c_str();
+    args[2].u = port;
+    return execute(CMD_CIPSTART_S, args);
+}
+bool ESP8266::sATCIPSTARTMultiple(uint8_t mux_id, String type, String addr, uint32_t port)
+{
+    Arg args[4];
+    args[0].u = mux_id;
+    args[1].s = type.c_str();
+    args[2].s = addr.c_str();
+    args[3].u = port;
+    return execute(CMD_CIPSTART_M, args);
+}
+bool ESP8266::sATCIPSENDSingle(const uint8_t *buffer, uint32_t len)
+{
+    Arg args[1];
+    args[0].u = len;
+    if (execute(CMD_CIPSEND_S, args)) {
+        rx_empty();
+        return uart_write(buffer, len) && execute(CMD_SEND_OK);
     }
     return false;
 }
-bool ESP8266::sATCIPSTARTMultiple(uint8_t mux_id, String type, String addr, uint32_t port)
+bool ESP8266::sATCIPSENDMultiple(uint8_t mux_id, const uint8_t *buffer, uint32_t len)
 {
-    String data;
-    rx_empty();
-    m_puart->print("AT+CIPSTART=");
-    m_puart->print(mux_id);
-    m_puart->print(",\"");
-    m_puart->print(type);
-    m_puart->print("\",\"");
-    m_puart->print(addr);
-    m_puart->print("\",");
-    m_puart->println(port);
-    
-    data = recvString("OK", "ERROR", "ALREADY CONNECT", 10000);
-    if (data.indexOf("OK") != -1 || data.indexOf("ALREADY CONNECT") != -1) {
-        return true;
+    if (sATCIPSENDMultipleAsync(mux_id, buffer, len)) {
+        return execute(CMD_SEND_OK);
     }
     return false;
 }
-bool ESP8266::sATCIPSENDSingle(const uint8_t *buffer, uint32_t len)
+bool ESP8266::sATCIPSENDMultipleAsync(uint8_t mux_id, const uint8_t *buffer, uint32_t len)
 {
-    rx_empty();
-    m_puart->print("AT+CIPSEND=");
-    m_puart->println(len);
-    if (recvFind(">", 5000)) {
+    Arg args[2];
+    args[0].u = mux_id;
+    args[1].u = len;
+    if (execute(CMD_CIPSEND_M, args)) {
         rx_empty();
-        for (uint32_t i = 0; i < len; i++) {
-            m_puart->write(buffer[i]);
-        }
-        return recvFind("SEND OK", 10000);
+        return uart_write(buffer, len);
     }
     return false;
 }
-bool ESP8266::sATCIPSENDMultiple(uint8_t mux_id, const uint8_t *buffer, uint32_t len)
+bool ESP8266::sATCIPSENDSingle(const ESP8266Segment *segments, uint8_t count)
 {
-    rx_empty();
-    m_puart->print("AT+CIPSEND=");
-    m_puart->print(mux_id);
-    m_puart->print(",");
-    m_puart->println(len);
-    if (recvFind(">", 5000)) {
+    Arg args[1];
+    args[0].u = 0;
+    for (uint8_t k = 0; k < count; k++) {
+        args[0].u += segments[k].len;
+    }
+    if (execute(CMD_CIPSEND_S, args)) {
         rx_empty();
-        for (uint32_t i = 0; i < len; i++) {
-            m_puart->write(buffer[i]);
-        }
-        return recvFind("SEND OK", 10000);
+        return uart_write(segments, count) && execute(CMD_SEND_OK);
     }
     return false;
 }
-bool ESP8266::sATCIPCLOSEMulitple(uint8_t mux_id)
+bool ESP8266::sATCIPSENDMultiple(uint8_t mux_id, const ESP8266Segment *segments, uint8_t count)
 {
-    String data;
-    rx_empty();
-    m_puart->print("AT+CIPCLOSE=");
-    m_puart->println(mux_id);
-    
-    data = recvString("OK", "link is not", 5000);
-    if (data.indexOf("OK") != -1 || data.indexOf("link is not") != -1) {
-        return true;
+    Arg args[2];
+    args[0].u = mux_id;
+    args[1].u = 0;
+    for (uint8_t k = 0; k < count; k++) {
+        args[1].u += segments[k].len;
+    }
+    if (execute(CMD_CIPSEND_M, args)) {
+        rx_empty();
+        return uart_write(segments, count) && execute(CMD_SEND_OK);
     }
     return false;
 }
+bool ESP8266::sATCIPSENDSource(uint8_t mux_id, Stream *src, ESP8266Producer producer, uint32_t len)
+{
+    uint8_t stage[ESP8266_STAGE_SIZE];
+    Arg args[2];
+    uint32_t offset = 0;
+    uint32_t chunk;
+    uint32_t n;
+    uint32_t got;
+    bool short_read = false;
+    
+    while (offset < len) {
+        chunk = len - offset < ESP8266_SEND_MAX ? len - offset : ESP8266_SEND_MAX;
+        if (mux_id == 0xFF) {
+            args[0].u = chunk;
+            if (!execute(CMD_CIPSEND_S, args)) {
+                return false;
+            }
+        } else {
+            args[0].u = mux_id;
+            args[1].u = chunk;
+            if (!execute(CMD_CIPSEND_M, args)) {
+                return false;
+            }
+        }
+        rx_empty();
+        while (chunk > 0) {
+            n = chunk < sizeof(stage) ? chunk : sizeof(stage);
+            got = 0;
+            if (!short_read) {
+                if (src) {
+                    got = src->readBytes(stage, n);
+                } else {
+                    got = producer(offset, stage, n);
+                    got = got > n ? n : got;
+                }
+            }
+            if (got < n) {
+                /* The length is promised already, pad the rest */
+                short_read = true;
+                memset(stage + got, 0, n - got);
+            }
+            if (!uart_write(stage, n)) {
+                return false;
+            }
+            offset += n;
+            chunk -= n;
+        }
+        if (short_read) {
+            break;
+        }
+        if (!execute(CMD_SEND_OK)) {
+            return false;
+        }
+    }
+    if (short_read) {
+        /* The peer got the padding as data, drop the link rather than go on */
+        execute(CMD_SEND_OK);
+        if (mux_id == 0xFF) {
+            releaseTCP();
+        } else {
+            releaseTCP(mux_id);
+        }
+        return false;
+    }
+    return true;
+}
+bool ESP8266::sATCIPCLOSEMulitple(uint8_t mux_id)
+{
+    Arg args[1];
+    args[0].u = mux_id;
+    return execute(CMD_CIPCLOSE_M, args);
+}
 bool ESP8266::eATCIPCLOSESingle(void)
 {
-    rx_empty();
-    m_puart->println("AT+CIPCLOSE");
-    return recvFind("OK", 5000);
+    return execute(CMD_CIPCLOSE_S);
 }
 bool ESP8266::eATCIFSR(String &list)
 {
-    rx_empty();
-    m_puart->println("AT+CIFSR");
-    return recvFindAndFilter("OK", "\r\r\n", "\r\n\r\nOK", list);
+    String data;
+    if (!execute(CMD_CIFSR, NULL, &data)) {
+        list = "";
+        return false;
+    }
+    return filter(data, F("\r\r\n"), F("\r\n\r\nOK"), list);
 }
 bool ESP8266::sATCIPMUX(uint8_t mode)
 {
-    String data;
-    rx_empty();
-    m_puart->print("AT+CIPMUX=");
-    m_puart->println(mode);
-    
-    data = recvString("OK", "Link is builded");
-    if (data.indexOf("OK") != -1) {
-        return true;
-    }
-    return false;
+    Arg args[1];
+    args[0].u = mode;
+    return execute(CMD_CIPMUX, args);
 }
 bool ESP8266::sATCIPSERVER(uint8_t mode, uint32_t port)
 {
-    String data;
+    Arg args[1];
     if (mode) {
-        rx_empty();
-        m_puart->print("AT+CIPSERVER=1,");
-        m_puart->println(port);
-        
-        data = recvString("OK", "no change");
-        if (data.indexOf("OK") != -1 || data.indexOf("no change") != -1) {
-            return true;
-        }
-        return false;
+        args[0].u = port;
+        return execute(CMD_CIPSERVER_ON, args);
     } else {
-        rx_empty();
-        m_puart->println("AT+CIPSERVER=0");
-        return recvFind("\r\r\n");
+        return execute(CMD_CIPSERVER_OFF);
     }
 }
 bool ESP8266::sATCIPSTO(uint32_t timeout)
 {
-    rx_empty();
-    m_puart->print("AT+CIPSTO=");
-    m_puart->println(timeout);
-    return recvFind("OK");
+    Arg args[1];
+    args[0].u = timeout;
+    return execute(CMD_CIPSTO, args);
+}
+bool ESP8266::sATSLEEP(uint8_t mode)
+{
+    Arg args[1];
+    args[0].u = mode;
+    return execute(CMD_SLEEP, args);
+}
+bool ESP8266::sATGSLP(uint32_t ms)
+{
+    Arg args[1];
+    args[0].u = ms;
+    return execute(CMD_GSLP, args);
+}
+bool ESP8266::sATCIPRECVMODE(uint8_t mode)
+{
+    Arg args[1];
+    args[0].u = mode;
+    return execute(CMD_CIPRECVMODE, args);
+}
+bool ESP8266::sATCWLAPOPT(uint8_t sort, uint16_t mask)
+{
+    Arg args[2];
+    args[0].u = sort;
+    args[1].u = mask;
+    return execute(CMD_CWLAPOPT, args);
+}
+bool ESP8266::qATCIPRECVLEN(void)
+{
+    String data;
+    int32_t index;
+    uint8_t i;
+    /* +CIPRECVLEN:<len0>,<len1>,... */
+    if (!execute(CMD_CIPRECVLEN, NULL, &data) || (index = data.indexOf(F("+CIPRECVLEN:"))) == -1) {
+        return false;
+    }
+    index += 12;
+    for (i = 0; i < ESP8266_MAX_LINKS && index > 0; i++) {
+        m_pending[i] = data.substring(index).toInt();
+        index = data.indexOf(',', index) + 1;
+    }
+    return true;
+}
+bool ESP8266::sATCIOBAUD(uint32_t baud)
+{
+    Arg args[1];
+    args[0].u = baud;
+    return execute(CMD_CIOBAUD, args);
+}
+bool ESP8266::sATUARTCUR(uint32_t baud, uint8_t flow_control)
+{
+    Arg args[2];
+    args[0].u = baud;
+    args[1].u = flow_control;
+    return execute(CMD_UART_CUR, args);
 }
-
@@ -32,6 +32,204 @@
 #endif
 
 
+/*
+ * The number of links(mux_id 0 ~ ESP8266_MAX_LINKS - 1) supported. 
+ *
+ * All per-link state is sized by it. Lower it(e.g. 2 on UNO) to save RAM, 
+ * or raise it(up to 16) for firmware allowing more links. It can be changed 
+ * here or defined by the build flags. 
+ */
+#ifndef ESP8266_MAX_LINKS
+#define ESP8266_MAX_LINKS       (5)
+#endif
+
+#if ESP8266_MAX_LINKS < 1 || ESP8266_MAX_LINKS > 16
+#error "ESP8266_MAX_LINKS must be 1 ~ 16"
+#endif
+
+
+/*
+ * The size of the buffer staging data from a Stream or a producer to uart. 
+ */
+#ifndef ESP8266_STAGE_SIZE
+#define ESP8266_STAGE_SIZE      (64)
+#endif
+
+/*
+ * The longest response line kept for matching(only its beginning matters). 
+ */
+#ifndef ESP8266_LINE_SIZE
+#define ESP8266_LINE_SIZE       (32)
+#endif
+
+/*
+ * The buffer keeping payload arriving while a command waits for its 
+ * response(e.g. an ack during "AT+CIPSEND"), for recv to return later. 
+ */
+#ifndef ESP8266_PARK_SIZE
+#define ESP8266_PARK_SIZE       (64)
+#endif
+
+#if ESP8266_PARK_SIZE < 3 || ESP8266_PARK_SIZE > 0xFFFF
+#error "ESP8266_PARK_SIZE must be 3 ~ 65535"
+#endif
+
+/*
+ * The bytes written per check of CTS in hardware flow control, i.e. the most 
+ * still sent after ESP8266 raised RTS(its uart FIFO holds 128). 
+ */
+#ifndef ESP8266_CTS_BLOCK
+#define ESP8266_CTS_BLOCK       (16)
+#endif
+
+#define ESP8266_SEND_MAX        (2048) /* The most bytes sent by one "AT+CIPSEND" */
+
+#define ESP8266_FLOW_NONE       (0) /* No flow control */
+#define ESP8266_FLOW_HARDWARE   (1) /* RTS/CTS on both sides */
+#define ESP8266_FLOW_SOFTWARE   (2) /* Paced writes for boards without spare pins */
+
+#define ESP8266_PIN_NONE        (0xFF)
+
+#define ESP8266_FAULT_NONE          (0) /* Healthy */
+#define ESP8266_FAULT_BUSY          (1) /* "busy p..." or "busy s..." */
+#define ESP8266_FAULT_RESET         (2) /* Spontaneous reset("ready" out of the blue) */
+#define ESP8266_FAULT_AP_LOST       (3) /* "WIFI DISCONNECT" or not connected to AP */
+#define ESP8266_FAULT_NO_RESPONSE   (4) /* No answer to "AT" */
+
+#define ESP8266_SLEEP_NONE      (0) /* Always awake */
+#define ESP8266_SLEEP_LIGHT     (1) /* Light sleep */
+#define ESP8266_SLEEP_MODEM     (2) /* Modem sleep(AP link kept) */
+#define ESP8266_SLEEP_DEEP      (3) /* Deep sleep by "AT+GSLP"(GPIO16 wired to RST) */
+
+#define ESP8266_LINK_NONE       (0)
+#define ESP8266_LINK_TCP        (1)
+#define ESP8266_LINK_UDP        (2)
+
+/*
+ * Capabilities of AT firmware, detected from "AT+GMR". 
+ */
+#define ESP8266_CAP_CUR         (0x0001) /* AT+CWMODE_CUR, AT+UART_CUR(not saved to flash) */
+#define ESP8266_CAP_CIPSENDEX   (0x0002) /* AT+CIPSENDEX */
+#define ESP8266_CAP_CIPDINFO    (0x0004) /* AT+CIPDINFO */
+#define ESP8266_CAP_CWLAPOPT    (0x0008) /* AT+CWLAPOPT */
+#define ESP8266_CAP_CIPRECVMODE (0x0010) /* AT+CIPRECVMODE(passive receiving) */
+#define ESP8266_CAP_PROBED      (0x8000) /* Set once detected or given */
+
+/*
+ * Results of the last command(see getLastResult). 
+ */
+#define ESP8266_RESULT_OK           (0) /* OK(or an equivalent like "no change") */
+#define ESP8266_RESULT_ERROR        (1) /* ERROR: rejected */
+#define ESP8266_RESULT_FAIL         (2) /* FAIL: e.g. AP not joined */
+#define ESP8266_RESULT_SEND_FAIL    (3) /* SEND FAIL: data not sent */
+#define ESP8266_RESULT_BUSY         (4) /* busy p.../busy s...: ignored, retry later */
+#define ESP8266_RESULT_LINK_INVALID (5) /* link is not valid */
+#define ESP8266_RESULT_RESET        (6) /* ESP8266 reset itself while running */
+#define ESP8266_RESULT_TIMEOUT      (7) /* No response in time */
+
+#define ESP8266_SCAN_IDLE       (0) /* No scan started */
+#define ESP8266_SCAN_RUNNING    (1)
+#define ESP8266_SCAN_DONE       (2)
+#define ESP8266_SCAN_FAILED     (3)
+
+
+class ESP8266TraceRecorder;
+class ESP8266Client;
+struct ESP8266Command;
+
+/**
+ * Wait for data from uart. 
+ *
+ * Called by the busy loops of ESP8266 when nothing is readable. It may 
+ * sleep(e.g. on an event of uart or a semaphore of RTOS) but must return 
+ * after max_ms at most, or as soon as data is readable. 
+ *
+ * @param max_ms - the longest time to wait in milliseconds. 
+ */
+typedef void (*ESP8266WaitHook)(uint32_t max_ms);
+
+/**
+ * Acquire(lock true) or release(lock false) the lock of ESP8266. 
+ *
+ * Must be recursive: a method holding the lock may call others which 
+ * acquire it again. 
+ */
+typedef void (*ESP8266LockHook)(bool lock);
+
+/**
+ * Produce data to send. 
+ *
+ * @param offset - the offset of data requested from the beginning. 
+ * @param buffer - the buffer to fill. 
+ * @param len - the most bytes to fill. 
+ * @return the bytes filled, 0 if no more data. 
+ */
+typedef uint32_t (*ESP8266Producer)(uint32_t offset, uint8_t *buffer, uint32_t len);
+
+/**
+ * Metrics of the link supervisor. 
+ *
+ * All durations are in milliseconds. 
+ */
+struct ESP8266SupervisorStats {
+    uint32_t faults;            /**< Faults detected */
+    uint32_t attempts;          /**< Recovery attempts in total */
+    uint32_t recoveries;        /**< Successful recoveries */
+    uint32_t restarts;          /**< Restarts issued by the supervisor */
+    uint32_t last_recovery_ms;  /**< Duration of the last recovery(fault detected to restored) */
+    uint32_t max_recovery_ms;   /**< Longest recovery */
+    uint32_t total_recovery_ms; /**< Sum of all recoveries */
+};
+
+/**
+ * A segment of data to send, in RAM or in flash(PROGMEM). 
+ *
+ * An array of segments is sent under one "AT+CIPSEND" with the total length, 
+ * so a header, a body and a trailer need not be copied into one buffer. 
+ */
+struct ESP8266Segment {
+    const uint8_t *data;    /**< Address of data */
+    uint32_t len;           /**< Length of data */
+    bool progmem;           /**< true if data is in flash(PROGMEM) */
+};
+
+/*
+ * A TCP or UDP link remembered for restoring after recovery. 
+ */
+struct ESP8266Link {
+    uint8_t type;   /* ESP8266_LINK_* */
+    uint32_t port;
+    String addr;
+};
+
+/**
+ * An AP found by scanning. 
+ */
+struct ESP8266AP {
+    uint8_t ecn;        /**< Encryption(0: open, 1: WEP, 2: WPA_PSK, 3: WPA2_PSK, 4: WPA_WPA2_PSK) */
+    char ssid[33];      /**< SSID(null-terminated) */
+    int8_t rssi;        /**< Signal strength in dBm */
+    uint8_t mac[6];     /**< BSSID */
+    uint8_t channel;    /**< Channel(0 if not reported by old firmware) */
+};
+
+/**
+ * Receive an AP found by scanning, called as soon as its line arrives. 
+ *
+ * @param ap - the AP found. 
+ */
+typedef void (*ESP8266ScanCallback)(const ESP8266AP &ap);
+
+/**
+ * Receive a slice of data arriving on a link. 
+ *
+ * @param mux_id - the identifier of the link(0 in single mode). 
+ * @param data - the bytes, copied to a stack buffer of ESP8266, valid only during the call. 
+ * @param len - the number of bytes(1 ~ ESP8266_STAGE_SIZE). 
+ */
+typedef void (*ESP8266RecvHandler)(uint8_t mux_id, const uint8_t *data, size_t len);
+
+
 /**
  * Provide an easy-to-use way to manipulate ESP8266. 
  */
@@ -60,6 +258,13 @@ class ESP8266 {
     ESP8266(HardwareSerial &uart, uint32_t baud = 9600);
 #endif
     
+    /*
+     * Constuctor on any Stream already set up(e.g. a trace replay or a host serial port). 
+     *
+     * @param stream - an reference of Stream object. 
+     */
+    ESP8266(Stream &stream);
+    
     
     /** 
      * Verify ESP8266 whether live or not. 
@@ -121,6 +326,57 @@ class ESP8266 {
      */
     String getAPList(void);
     
+    /**
+     * Start searching APs without blocking. 
+     *
+     * Results are parsed line by line by pollScan as they arrive, passed to 
+     * the callback and kept in the array of setScanResults, so the whole list 
+     * is never buffered. Sorting by RSSI and the fields returned are set by 
+     * "AT+CWLAPOPT" if supported. No other method of this object should be 
+     * called until pollScan returns ESP8266_SCAN_DONE or ESP8266_SCAN_FAILED. 
+     * The lock of setLock is held from here until then, across calls of 
+     * pollScan, so other tasks calling this object wait for the scan(a few 
+     * seconds). "+IPD" arriving meanwhile goes to the handler of 
+     * setRecvHandler(or is parked for recv). 
+     *
+     * @param ssid - only the AP of this SSID(default: NULL for all). 
+     * @param channel - only APs on this channel(default: 0 for all). 
+     * @retval true - started.
+     * @retval false - failure. 
+     * @see pollScan
+     */
+    bool startScan(const char *ssid = NULL, uint8_t channel = 0);
+    
+    /**
+     * Parse the results of scanning arrived. Call it in loop() after startScan. 
+     *
+     * @return ESP8266_SCAN_* 
+     */
+    uint8_t pollScan(void);
+    
+    /**
+     * Set the callback receiving every AP found by scanning. 
+     *
+     * @param callback - the callback(NULL for none). 
+     */
+    void setScanCallback(ESP8266ScanCallback callback);
+    
+    /**
+     * Keep the strongest APs found by scanning, sorted by RSSI(strongest first). 
+     *
+     * @param aps - the array(NULL for none). 
+     * @param size - the number of elements of aps. 
+     * @see getScanCount
+     */
+    void setScanResults(ESP8266AP *aps, uint8_t size);
+    
+    /**
+     * Get the number of APs kept in the array of setScanResults. 
+     *
+     * @return the number of APs. 
+     */
+    uint8_t getScanCount(void);
+    
     /**
      * Join in AP. 
      *
@@ -246,7 +502,7 @@ class ESP8266 {
     /**
      * Create TCP connection in multiple mode. 
      * 
-     * @param mux_id - the identifier of this TCP(available value: 0 - 4). 
+     * @param mux_id - the identifier of this TCP(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
      * @param addr - the IP or domain name of the target host. 
      * @param port - the port number of the target host. 
      * @retval true - success.
@@ -257,7 +513,7 @@ class ESP8266 {
     /**
      * Release TCP connection in multiple mode. 
      * 
-     * @param mux_id - the identifier of this TCP(available value: 0 - 4). 
+     * @param mux_id - the identifier of this TCP(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
      * @retval true - success.
      * @retval false - failure.
      */
@@ -266,7 +522,7 @@ class ESP8266 {
     /**
      * Register UDP port number in multiple mode.
      * 
-     * @param mux_id - the identifier of this TCP(available value: 0 - 4). 
+     * @param mux_id - the identifier of this TCP(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
      * @param addr - the IP or domain name of the target host. 
      * @param port - the port number of the target host. 
      * @retval true - success.
@@ -277,13 +533,26 @@ class ESP8266 {
     /**
      * Unregister UDP port number in multiple mode. 
      * 
-     * @param mux_id - the identifier of this TCP(available value: 0 - 4). 
+     * @param mux_id - the identifier of this TCP(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
      * @retval true - success.
      * @retval false - failure.
      */
     bool unregisterUDP(uint8_t mux_id);
 
 
+    /**
+     * Whether a link is up, as told by the responses read so far. 
+     *
+     * Set when the link is created or accepted by the server("<id>,CONNECT"), 
+     * cleared by "<id>,CLOSED" or releasing it. Responses are read by recv, 
+     * poll and every command. 
+     *
+     * @param mux_id - the identifier of link(0 in single mode). 
+     * @retval true - up.
+     * @retval false - closed or never created.
+     */
+    bool isConnected(uint8_t mux_id);
+    
     /**
      * Set the timeout of TCP Server. 
      * 
@@ -337,6 +606,268 @@ class ESP8266 {
      * @retval false - failure.
      */
     bool stopServer(void);
+    
+    /**
+     * Change the baud rate and flow control of the UART on both sides. 
+     *
+     * The module is configured by "AT+UART_CUR"(not saved to flash), or by 
+     * "AT+CIOBAUD"(without flow control) on old firmware, and then the UART 
+     * of mainboard is restarted at the new baud rate. 
+     * 
+     * @note "AT+CIOBAUD" is saved to flash: after a reset the module keeps 
+     *  talking at the new baud rate, so begin the uart at it next time. 
+     *
+     * @param baud - the new baud rate(e.g. 115200, 921600). 
+     * @param flow_control - ESP8266_FLOW_NONE, ESP8266_FLOW_HARDWARE or ESP8266_FLOW_SOFTWARE. 
+     * @retval true - success.
+     * @retval false - failure.
+     * @note ESP8266_FLOW_HARDWARE needs setFlowControlPins to be called before. 
+     *  ESP8266_FLOW_SOFTWARE leaves the module without flow control and paces 
+     *  the writes of mainboard instead(see setSoftwareFlowControl). Without 
+     *  pins nothing holds back data from ESP8266 in active mode: use passive 
+     *  receiving(setPassiveRecv) for that. 
+     */
+    bool setUART(uint32_t baud, uint8_t flow_control = ESP8266_FLOW_NONE);
+    
+    /**
+     * Set the pins of mainboard used by hardware flow control. 
+     *
+     * RTS(output, to CTS of ESP8266) is held high while the library is not 
+     * reading from uart, so the module buffers incoming data instead of 
+     * overrunning the serial buffer of mainboard. CTS(input, from RTS of ESP8266) 
+     * is checked before every ESP8266_CTS_BLOCK bytes of payload written, once 
+     * the uart of mainboard has sent what it holds. If CTS stays high for 1 
+     * second, the send fails with ESP8266_RESULT_TIMEOUT and the fault 
+     * ESP8266_FAULT_NO_RESPONSE. 
+     *
+     * @param rts_pin - the pin connected to CTS of ESP8266(ESP8266_PIN_NONE for unused). 
+     * @param cts_pin - the pin connected to RTS of ESP8266(ESP8266_PIN_NONE for unused). 
+     */
+    void setFlowControlPins(uint8_t rts_pin, uint8_t cts_pin);
+    
+    /**
+     * Set the pacing of software flow control. 
+     *
+     * Payload is written in blocks of chunk bytes. After each block, the 
+     * library waits for the uart to finish transmitting and pauses pause_ms 
+     * milliseconds to let the module drain its buffer. In passive receiving 
+     * (setPassiveRecv), data is pulled from the module in blocks of chunk bytes 
+     * too, so the serial buffer of mainboard is not overrun by "+CIPRECVDATA". 
+     *
+     * @param chunk - the size of block in bytes(default: 128). 
+     * @param pause_ms - the pause between blocks in milliseconds(default: 2). 
+     */
+    void setSoftwareFlowControl(uint16_t chunk = 128, uint16_t pause_ms = 2);
+    
+    /**
+     * Supervise the health of ESP8266 and recover it when wedged. 
+     *
+     * Call this method in loop(). Faults are classified from the responses 
+     * of every command(busy, spontaneous reset, AP lost) and by a periodic 
+     * "AT" check. Recovery escalates through kick, rejoining AP and restart 
+     * with exponential backoff between attempts. After recovery, the AP and 
+     * the TCP/UDP links created before are restored, and the mode of MUX and 
+     * the server too if ESP8266 reset. "WIFI DISCONNECT" while joinAP or 
+     * leaveAP is running is not a fault. 
+     *
+     * @retval true - healthy.
+     * @retval false - fault pending, recovery not finished yet. 
+     * @see getLastFault
+     * @see getSupervisorStats
+     */
+    bool supervise(void);
+    
+    /**
+     * Set the timing of the link supervisor. 
+     *
+     * @param check_interval - the interval of health check when healthy(default: 10000ms). 
+     * @param backoff_min - the delay before the second recovery attempt(default: 1000ms). 
+     * @param backoff_max - the limit of delay between attempts(default: 60000ms). 
+     */
+    void setSupervisorTiming(uint32_t check_interval = 10000, 
+        uint32_t backoff_min = 1000, uint32_t backoff_max = 60000);
+    
+    /**
+     * Get the fault classified most recently. 
+     *
+     * @return ESP8266_FAULT_* (ESP8266_FAULT_NONE after recovered). 
+     */
+    uint8_t getLastFault(void);
+    
+    /**
+     * Get the metrics of the link supervisor. 
+     *
+     * @return the metrics. 
+     */
+    const ESP8266SupervisorStats &getSupervisorStats(void);
+    
+    /**
+     * Get the result of the last command sent to ESP8266. 
+     *
+     * Every command stops waiting at the first terminal response, so a 
+     * method returning false can be told apart: ESP8266_RESULT_BUSY is worth 
+     * retrying soon, ESP8266_RESULT_TIMEOUT hints a dead module, and so on. 
+     *
+     * @return ESP8266_RESULT_* 
+     */
+    uint8_t getLastResult(void);
+    
+    /**
+     * Set the sleep mode of ESP8266 by "AT+SLEEP". 
+     *
+     * @param mode - ESP8266_SLEEP_NONE, ESP8266_SLEEP_LIGHT or ESP8266_SLEEP_MODEM. 
+     * @retval true - success.
+     * @retval false - failure.
+     */
+    bool setSleepMode(uint8_t mode);
+    
+    /**
+     * Put ESP8266 into deep sleep by "AT+GSLP". 
+     *
+     * ESP8266 resets itself when the time is up(GPIO16 must be wired to RST). 
+     * Links and server are lost, call waitWake before using it again. 
+     *
+     * @param ms - the time to sleep in milliseconds. 
+     * @retval true - success.
+     * @retval false - failure.
+     */
+    bool deepSleep(uint32_t ms);
+    
+    /**
+     * Wait for ESP8266 waking up from deep sleep. 
+     *
+     * Much faster than restart and joinAP: returns as soon as "ready" is seen 
+     * and, if wait_ip, the AP saved is joined again automatically("WIFI GOT IP"). 
+     * The mode set by setOprToStation and the like is set again. 
+     *
+     * @param timeout - the time waiting in milliseconds(default: 5000). 
+     * @param wait_ip - also wait for the IP from AP(default: true). 
+     * @retval true - awake(and got IP if wait_ip).
+     * @retval false - timeout.
+     */
+    bool waitWake(uint32_t timeout = 5000, bool wait_ip = true);
+    
+    /**
+     * Record every byte crossing the uart. 
+     *
+     * @param recorder - the recorder(NULL to stop recording). 
+     * @see ESP8266TraceRecorder
+     */
+    void setTrace(ESP8266TraceRecorder *recorder);
+    
+    /**
+     * Derive the timeouts of commands from the response times observed. 
+     *
+     * A smoothed round trip time and its variance are tracked for each class 
+     * of command(queries and settings, scans, the prompt of "AT+CIPSEND", 
+     * closing links, passive receive, and the gap between bytes of received 
+     * data) like the retransmission timer of TCP, and the timeout is srtt + 
+     * 4 * rttvar, limited by floor_ms and the fixed timeout of the command. 
+     * A timeout expired triples the estimate, so a slow response is waited 
+     * for longer next time. "SEND OK", "AT+CWJAP", "AT+CIPSTART", "AT+CWSAP" 
+     * and the waits for "ready" and "GOT IP" keep their fixed timeouts, as 
+     * their times follow the payload length and the network. 
+     * Disabled by default: the fixed timeouts are used. 
+     *
+     * @param enabled - use the timeouts derived or the fixed ones. 
+     * @param floor_ms - the lower limit of timeouts(default: 100ms). 
+     * @param ceiling_ms - the upper limit of timeouts, 0 for the fixed timeout 
+     *  of each command(default: 0). 
+     */
+    void setAdaptiveTimeout(bool enabled, uint32_t floor_ms = 100, uint32_t ceiling_ms = 0);
+    
+    /**
+     * Detect the capabilities of AT firmware from its version. 
+     *
+     * Called automatically before the first command which has variants, so 
+     * calling it is only needed to read the capabilities early. 
+     *
+     * @return ESP8266_CAP_* or-ed, 0 if the version cannot be read. 
+     * @see getCapabilities
+     */
+    uint16_t probeCapabilities(void);
+    
+    /**
+     * Get the capabilities detected(or given by setCapabilities). 
+     *
+     * @return ESP8266_CAP_* or-ed(ESP8266_CAP_PROBED not set if not detected yet). 
+     */
+    uint16_t getCapabilities(void);
+    
+    /**
+     * Give the capabilities instead of detecting, e.g. for a custom firmware. 
+     *
+     * @param caps - ESP8266_CAP_* or-ed. 
+     */
+    void setCapabilities(uint16_t caps);
+    
+    /**
+     * Get the version of AT firmware detected. 
+     *
+     * @return major * 100 + minor(e.g. 102 for "AT version:1.2.0.0"), 0 for unknown. 
+     */
+    uint16_t getATVersion(void);
+    
+    /**
+     * Switch the receiving of data between passive and active mode. 
+     *
+     * In passive mode("AT+CIPRECVMODE=1") data stays in ESP8266 until pulled 
+     * by recv("AT+CIPRECVDATA"), never more than the buffer given, so a busy 
+     * mainboard pushes back on the sender by TCP flow control instead of 
+     * losing data on uart. 
+     *
+     * @param enabled - true for passive mode, false for active mode(default of ESP8266). 
+     * @retval true - success.
+     * @retval false - failure(or passive mode not supported, see ESP8266_CAP_CIPRECVMODE). 
+     */
+    bool setPassiveRecv(bool enabled);
+    
+    /**
+     * Get the length of data pending in ESP8266 in passive mode. 
+     *
+     * In active mode, get the rest of the "+IPD" payload arriving on the 
+     * link, i.e. left unread by recv of another link. 
+     *
+     * @param mux_id - the identifier of link(0 in single mode). 
+     * @param query - query ESP8266 by "AT+CIPRECVLEN?" instead of counting 
+     *  the notifications seen(default: false). 
+     * @return the length of data pending. 
+     */
+    uint32_t getRecvPending(uint8_t mux_id, bool query = false);
+    
+    /**
+     * Set the hook waiting for data from uart instead of spinning. 
+     *
+     * @param hook - the hook(NULL for spinning, the default). 
+     * @see ESP8266WaitHook
+     */
+    void setWaitHook(ESP8266WaitHook hook);
+    
+    /**
+     * Set the lock serializing the methods of this object between tasks. 
+     *
+     * Every method talking to ESP8266 holds the lock from its first command 
+     * to its last response, so the commands of two tasks never interleave 
+     * on the uart. 
+     *
+     * @param hook - the lock(NULL for none, the default). 
+     * @see ESP8266LockHook
+     * @see lock
+     */
+    void setLock(ESP8266LockHook hook);
+    
+    /**
+     * Acquire the lock set by setLock(nothing if none). 
+     *
+     * Hold it around a sequence of calls that must not be interleaved with 
+     * other tasks, e.g. sendAsync and sendWait. 
+     */
+    void lock(void);
+    
+    /**
+     * Release the lock acquired by lock. 
+     */
+    void unlock(void);
 
     /**
      * Send data based on TCP or UDP builded already in single mode. 
@@ -351,7 +882,7 @@ class ESP8266 {
     /**
      * Send data based on one of TCP or UDP builded already in multiple mode. 
      * 
-     * @param mux_id - the identifier of this TCP(available value: 0 - 4). 
+     * @param mux_id - the identifier of this TCP(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
      * @param buffer - the buffer of data to send. 
      * @param len - the length of data to send. 
      * @retval true - success.
@@ -359,6 +890,104 @@ class ESP8266 {
      */
     bool send(uint8_t mux_id, const uint8_t *buffer, uint32_t len);
     
+    /**
+     * Send segments of data as one package in single mode. 
+     * 
+     * @param segments - the array of segments. 
+     * @param count - the number of segments. 
+     * @retval true - success.
+     * @retval false - failure.
+     */
+    bool send(const ESP8266Segment *segments, uint8_t count);
+    
+    /**
+     * Send segments of data as one package in multiple mode. 
+     * 
+     * @param mux_id - the identifier of this TCP(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
+     * @param segments - the array of segments. 
+     * @param count - the number of segments. 
+     * @retval true - success.
+     * @retval false - failure.
+     */
+    bool send(uint8_t mux_id, const ESP8266Segment *segments, uint8_t count);
+    
+    /**
+     * Start sending data in multiple mode without waiting for "SEND OK". 
+     *
+     * Returns as soon as the data is written to uart, so the mainboard can 
+     * serve other modules meanwhile. sendWait must be called before any other 
+     * method of this object. 
+     * 
+     * @param mux_id - the identifier of this TCP(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
+     * @param buffer - the buffer of data to send. 
+     * @param len - the length of data to send. 
+     * @retval true - data written, sendWait pending.
+     * @retval false - failure.
+     */
+    bool sendAsync(uint8_t mux_id, const uint8_t *buffer, uint32_t len);
+    
+    /**
+     * Wait for "SEND OK" of the data started by sendAsync. 
+     * 
+     * @param timeout - the time waiting(default: 10000ms). 
+     * @retval true - success.
+     * @retval false - failure.
+     */
+    bool sendWait(uint32_t timeout = 10000);
+    
+    /**
+     * Send data read from a stream(e.g. a file on SD card) in single mode. 
+     *
+     * Data is pulled through a small buffer(ESP8266_STAGE_SIZE) into 
+     * "AT+CIPSEND" of up to ESP8266_SEND_MAX bytes each, so it needs not fit 
+     * in RAM. 
+     *
+     * @param src - the stream to read(its timeout applies to each read). 
+     * @param len - the length of data to send. 
+     * @retval true - success.
+     * @retval false - failure, or src ran short(the link is closed then, as the rest 
+     *  of its chunk promised to "AT+CIPSEND" went out padded with 0). 
+     */
+    bool send(Stream &src, uint32_t len);
+    
+    /**
+     * Send data read from a stream in multiple mode. 
+     *
+     * @param mux_id - the identifier of this TCP(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
+     * @param src - the stream to read(its timeout applies to each read). 
+     * @param len - the length of data to send. 
+     * @retval true - success.
+     * @retval false - failure, or src ran short(the link is closed then, as the rest 
+     *  of its chunk promised to "AT+CIPSEND" went out padded with 0). 
+     * @see send(Stream &, uint32_t)
+     */
+    bool send(uint8_t mux_id, Stream &src, uint32_t len);
+    
+    /**
+     * Send data filled by a producer in single mode. 
+     *
+     * @param producer - the producer. 
+     * @param len - the length of data to send. 
+     * @retval true - success.
+     * @retval false - failure, or producer ran short(the link is closed then, as the rest 
+     *  of its chunk promised to "AT+CIPSEND" went out padded with 0). 
+     * @see ESP8266Producer
+     */
+    bool send(ESP8266Producer producer, uint32_t len);
+    
+    /**
+     * Send data filled by a producer in multiple mode. 
+     *
+     * @param mux_id - the identifier of this TCP(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
+     * @param producer - the producer. 
+     * @param len - the length of data to send. 
+     * @retval true - success.
+     * @retval false - failure, or producer ran short(the link is closed then, as the rest 
+     *  of its chunk promised to "AT+CIPSEND" went out padded with 0). 
+     * @see ESP8266Producer
+     */
+    bool send(uint8_t mux_id, ESP8266Producer producer, uint32_t len);
+    
     /**
      * Receive data from TCP or UDP builded already in single mode. 
      *
@@ -372,7 +1001,11 @@ class ESP8266 {
     /**
      * Receive data from one of TCP or UDP builded already in multiple mode. 
      *
-     * @param mux_id - the identifier of this TCP(available value: 0 - 4). 
+     * Returns 0 at once if the data arriving belongs to another link: it is 
+     * left for the recv of that link. Payload which arrived while a command 
+     * was waiting for its response is returned first. 
+     *
+     * @param mux_id - the identifier of this TCP(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
      * @param buffer - the buffer for storing data. 
      * @param buffer_size - the length of the buffer. 
      * @param timeout - the time waiting data. 
@@ -393,50 +1026,288 @@ class ESP8266 {
      * @return the length of data received actually. 
      */
     uint32_t recv(uint8_t *coming_mux_id, uint8_t *buffer, uint32_t buffer_size, uint32_t timeout = 1000);
+    
+    /**
+     * Set the handler receiving data by poll. 
+     *
+     * @param handler - the handler(NULL for none). 
+     * @see poll
+     */
+    void setRecvHandler(ESP8266RecvHandler handler);
+    
+    /**
+     * Pass data arriving to the handler of setRecvHandler. 
+     *
+     * The payload of "+IPD" is copied through a stack buffer of 
+     * ESP8266_STAGE_SIZE bytes and handed over slice by slice as soon as it 
+     * is readable, so no buffer sized for the largest frame is needed. A 
+     * frame may come in several slices, and a frame cut by the timeout 
+     * continues at the next call(or at recv, which shares the parser). Lines 
+     * between frames are handled as responses(faults, notifications). Payload 
+     * arriving while a command waits for its response is passed to the 
+     * handler too, or kept in a buffer of ESP8266_PARK_SIZE bytes if none 
+     * (for recv, or for the handler at the next call), the overflow dropped. 
+     * Active receiving mode only. 
+     *
+     * @param timeout - the time waiting for data(default: 0, only what arrived already). 
+     * @return the number of bytes passed. 
+     */
+    uint32_t poll(uint32_t timeout = 0);
 
  private:
 
+    /*
+     * Hold the lock in the scope. 
+     */
+    class Guard {
+     public:
+        Guard(ESP8266 *esp): m_esp(esp) { m_esp->lock(); }
+        ~Guard() { m_esp->unlock(); }
+     private:
+        ESP8266 *m_esp;
+    };
+    
+    /*
+     * Commands of the table in ESP8266.cpp. 
+     */
+    enum {
+        CMD_AT = 0,
+        CMD_RST,
+        CMD_GMR,
+        CMD_CWMODE_Q,
+        CMD_CWMODE,
+        CMD_CWMODE_CUR,
+        CMD_CWJAP,
+        CMD_CWDHCP,
+        CMD_CWLAP,
+        CMD_CWLAP_SSID,
+        CMD_CWLAPOPT,
+        CMD_CWQAP,
+        CMD_CWSAP,
+        CMD_CWLIF,
+        CMD_CIPSTATUS,
+        CMD_CIPSTART_S,
+        CMD_CIPSTART_M,
+        CMD_CIPSEND_S,
+        CMD_CIPSEND_M,
+        CMD_SEND_OK,
+        CMD_CIPCLOSE_M,
+        CMD_CIPCLOSE_S,
+        CMD_CIFSR,
+        CMD_CIPMUX,
+        CMD_CIPSERVER_ON,
+        CMD_CIPSERVER_OFF,
+        CMD_CIPSTO,
+        CMD_UART_CUR,
+        CMD_CIOBAUD,
+        CMD_SLEEP,
+        CMD_GSLP,
+        CMD_CIPRECVMODE,
+        CMD_CIPRECVLEN,
+        CMD_CIPRECVDATA_S,
+        CMD_CIPRECVDATA_M,
+        CMD_WAIT_READY,
+        CMD_WAIT_GOT_IP,
+        CMD_COUNT
+    };
+    
+    /*
+     * Classes of response time tracked by the adaptive timeout, given to each 
+     * command by the table. 
+     */
+    enum {
+        RTT_QUERY = 0,      /* Answered by the module itself: queries and settings */
+        RTT_SCAN,           /* "AT+CWLAP" */
+        RTT_PROMPT,         /* "> " of "AT+CIPSEND" */
+        RTT_CLOSE,          /* "AT+CIPCLOSE" */
+        RTT_RECVDATA,       /* "AT+CIPRECVDATA" */
+        RTT_PAYLOAD,        /* Gap between bytes of +IPD data */
+        RTT_COUNT,
+        RTT_FIXED = 0xFF    /* Not adaptive: following the payload length or the network */
+    };
+    
+    static const ESP8266Command s_commands[CMD_COUNT];
+    
+    /*
+     * Capabilities, detected if not yet. 
+     */
+    uint16_t caps(void);
+    
+    /*
+     * Wait by the hook until data readable or the timeout since start expired. 
+     */
+    void io_wait(unsigned long start, uint32_t timeout);
+
+    /*
+     * Set all members to defaults. 
+     */
+    void init(void);
+    
     /* 
      * Empty the buffer or UART RX.
      */
     void rx_empty(void);
  
-    /* 
-     * Recvive data from uart. Return all received data if target found or timeout. 
+    /*
+     * An argument of command: string for 's' and 'r' formats, number for 'u'. 
      */
-    String recvString(String target, uint32_t timeout = 1000);
+    struct Arg {
+        const char *s;
+        uint32_t u;
+    };
     
-    /* 
-     * Recvive data from uart. Return all received data if one of target1 and target2 found or timeout. 
+    /*
+     * Send a command of the descriptor table(in flash) with args. 
+     * Return the timeout of the descriptor. 
      */
-    String recvString(String target1, String target2, uint32_t timeout = 1000);
+    uint16_t command(uint8_t id, const Arg *args);
     
-    /* 
-     * Recvive data from uart. Return all received data if one of target1, target2 and target3 found or timeout. 
+    /*
+     * Run a command of the descriptor table(in flash): send it with args, then 
+     * receive until its success or failure token found or timeout(0 for the 
+     * timeout of descriptor). The response is stored to data if not NULL. 
+     * Return true if a success token found. 
      */
-    String recvString(String target1, String target2, String target3, uint32_t timeout = 1000);
+    bool execute(uint8_t id, const Arg *args = NULL, String *data = NULL, uint32_t timeout = 0);
     
     /* 
-     * Recvive data from uart and search first target. Return true if target found, false for timeout.
+     * Recvive data from uart until one of tokens(in flash, NULL for unused) found, 
+     * any terminal response if terminals, or timeout. t0 and t1 mean success, t2 
+     * failure. Tokens match at the start of a line, so text of a response(e.g. 
+     * an SSID "ERROR" in "+CWLAP") or of "+IPD" payload(skipped) is no token. 
+     * Return ESP8266_RESULT_*. 
      */
-    bool recvFind(String target, uint32_t timeout = 1000);
+    uint8_t recvToken(String &data, const char *t0, const char *t1, const char *t2, 
+        uint32_t timeout, bool terminals = true);
+    
+    /*
+     * Whether the line arriving(len bytes, eol when ended by LF) matches a 
+     * token: at its start as soon as the token is complete, or for a token 
+     * beginning with CR at its end. 
+     */
+    bool token_match(const char *line, uint32_t len, bool eol, const char *token);
     
     /* 
-     * Recvive data from uart and search first target and cut out the substring between begin and end(excluding begin and end self). 
-     * Return true if target found, false for timeout.
+     * Cut out the substring between begin and end(excluding begin and end self). 
+     * Return true if both found. 
      */
-    bool recvFindAndFilter(String target, String begin, String end, String &data, uint32_t timeout = 1000);
+    bool filter(const String &data, const __FlashStringHelper *begin, 
+        const __FlashStringHelper *end, String &out);
     
     /*
-     * Receive a package from uart. 
+     * Get the timeout of a class of response time(RTT_*), the fixed one if 
+     * not adaptive or no sample yet. 
+     */
+    uint32_t rtt_timeout(uint8_t cls, uint32_t fixed);
+    
+    /*
+     * Feed a response time(ms) observed, or the timeout expired if !ok. 
+     */
+    void rtt_update(uint8_t cls, bool ok, uint32_t elapsed, uint32_t fixed);
+    
+    /*
+     * Receive from the payload of "+IPD". 
      *
+     * @param mux_id - the link wanted(0xFF for any). Payload of another link 
+     *  is left unread for its own recv. 
      * @param buffer - the buffer storing data. 
-     * @param buffer_size - guess what!
-     * @param data_len - the length of data actually received(maybe more than buffer_size, the remained data will be abandoned).
+     * @param buffer_size - guess what!(the rest of a longer payload is kept for next call)
      * @param timeout - the duration waitting data comming.
-     * @param coming_mux_id - in single connection mode, should be NULL and not NULL in multiple. 
+     * @param coming_mux_id - the link of data received if not NULL. 
+     */
+    uint32_t recvPkg(uint8_t mux_id, uint8_t *buffer, uint32_t buffer_size, uint32_t timeout, uint8_t *coming_mux_id);
+    
+    /*
+     * Receive data in passive mode: wait until data pending on the link 
+     * mux_id(0xFF for any) and pull it by "AT+CIPRECVDATA". 
+     */
+    uint32_t recvPassive(uint8_t mux_id, uint8_t *buffer, uint32_t buffer_size, uint32_t timeout, uint8_t *coming_mux_id);
+    
+    /*
+     * Pull at most buffer_size bytes pending on the link by "AT+CIPRECVDATA". 
+     */
+    uint32_t recvPassiveData(uint8_t mux_id, uint8_t *buffer, uint32_t buffer_size);
+    
+    /*
+     * Handle a line of scanning results. 
+     */
+    void scan_line(void);
+    
+    /*
+     * Feed a byte outside of payload: collect lines and start the payload 
+     * of "+IPD,<id>,<len>:". All reads from uart go through it(or ipd_deliver). 
+     */
+    void rx_char(char c);
+    
+    /*
+     * Handle the line complete in m_line: faults, links connected or closed, 
+     * notifications of passive mode(+IPD,<id>,<len> or +IPD,<len>). 
+     */
+    void rx_line(void);
+    
+    /*
+     * Pass the payload readable to the handler of setRecvHandler(parked if none). 
+     * Return the bytes passed. 
      */
-    uint32_t recvPkg(uint8_t *buffer, uint32_t buffer_size, uint32_t *data_len, uint32_t timeout, uint8_t *coming_mux_id);
+    uint32_t ipd_deliver(void);
+    
+    /*
+     * Keep payload of a link in m_park, dropping what does not fit. 
+     */
+    void park(uint8_t mux_id, const uint8_t *data, uint16_t len);
+    
+    /*
+     * Take the payload parked of a link(0xFF for any) into buffer(NULL to 
+     * drop it all). Return the bytes taken. 
+     */
+    uint32_t unpark(uint8_t mux_id, uint8_t *buffer, uint32_t buffer_size, uint8_t *coming_mux_id);
+    
+    /*
+     * Write payload to uart with the flow control selected. Return false if 
+     * CTS held it back too long(the rest unsent, a fault raised). 
+     */
+    bool uart_write(const uint8_t *buffer, uint32_t len);
+    
+    /*
+     * Write segments to uart, copying PROGMEM ones through a small stack buffer. 
+     */
+    bool uart_write(const ESP8266Segment *segments, uint8_t count);
+    
+    /*
+     * Drive RTS pin: ready = true allows ESP8266 to send. 
+     */
+    void rts_set(bool ready);
+    
+    /*
+     * Classify failure signatures in a line of response. 
+     */
+    void fault_check(const char *line);
+    
+    /*
+     * Record a fault(the first one since healthy wins). 
+     */
+    void fault_set(uint8_t fault);
+    
+    /*
+     * "AT+RST" and wait until ESP8266 answers again. 
+     */
+    bool reset_module(void);
+    
+    /*
+     * Forget the links and server which are lost after ESP8266 reset. 
+     */
+    void state_clear(void);
+    
+    /*
+     * Restore AP(if rejoin), links remembered and, if ESP8266 reset, the mode 
+     * of MUX, server and receiving mode lost with it. 
+     */
+    bool state_restore(bool rejoin, bool reset);
+    
+    /*
+     * One recovery attempt at the given escalation level. 
+     */
+    bool recover(uint8_t level);
     
     
     bool eAT(void);
@@ -445,6 +1316,7 @@ class ESP8266 {
     
     bool qATCWMODE(uint8_t *mode);
     bool sATCWMODE(uint8_t mode);
+    bool sATCWMODECUR(uint8_t mode);
     bool sATCWJAP(String ssid, String pwd);
     bool sATCWDHCP(uint8_t mode, boolean enabled);
     bool eATCWLAP(String &list);
@@ -457,12 +1329,27 @@ class ESP8266 {
     bool sATCIPSTARTMultiple(uint8_t mux_id, String type, String addr, uint32_t port);
     bool sATCIPSENDSingle(const uint8_t *buffer, uint32_t len);
     bool sATCIPSENDMultiple(uint8_t mux_id, const uint8_t *buffer, uint32_t len);
+    bool sATCIPSENDMultipleAsync(uint8_t mux_id, const uint8_t *buffer, uint32_t len);
+    bool sATCIPSENDSingle(const ESP8266Segment *segments, uint8_t count);
+    bool sATCIPSENDMultiple(uint8_t mux_id, const ESP8266Segment *segments, uint8_t count);
+    
+    /*
+     * Send data from src or producer by chunks of "AT+CIPSEND"(mux_id 0xFF for single mode). 
+     */
+    bool sATCIPSENDSource(uint8_t mux_id, Stream *src, ESP8266Producer producer, uint32_t len);
     bool sATCIPCLOSEMulitple(uint8_t mux_id);
     bool eATCIPCLOSESingle(void);
     bool eATCIFSR(String &list);
     bool sATCIPMUX(uint8_t mode);
     bool sATCIPSERVER(uint8_t mode, uint32_t port = 333);
     bool sATCIPSTO(uint32_t timeout);
+    bool sATUARTCUR(uint32_t baud, uint8_t flow_control);
+    bool sATCIOBAUD(uint32_t baud);
+    bool sATSLEEP(uint8_t mode);
+    bool sATGSLP(uint32_t ms);
+    bool sATCIPRECVMODE(uint8_t mode);
+    bool sATCWLAPOPT(uint8_t sort, uint16_t mask);
+    bool qATCIPRECVLEN(void);
     
     /*
      * +IPD,len:data
@@ -474,6 +1361,74 @@ class ESP8266 {
 #else
     HardwareSerial *m_puart; /* The UART to communicate with ESP8266 */
 #endif
+    Stream *m_pbase;        /* The stream of m_puart, or given by user */
+    Stream *m_pio;          /* All reads and writes go here(m_pbase or m_trace) */
+    ESP8266TraceRecorder *m_trace;
+    uint8_t m_flow_mode;    /* ESP8266_FLOW_* */
+    uint8_t m_rts_pin;      /* Output, low when mainboard ready to receive */
+    uint8_t m_cts_pin;      /* Input, low when ESP8266 ready to receive */
+    uint16_t m_flow_chunk;  /* Block size of software flow control */
+    uint16_t m_flow_pause;  /* Pause between blocks(ms) of software flow control */
+    
+    String m_ssid;                      /* AP joined, for rejoining */
+    String m_pwd;
+    uint8_t m_opr_mode;                 /* Set by "AT+CWMODE_CUR", 0 for none(saved in flash) */
+    uint8_t m_mux_mode;                 /* 0, 1 or 0xFF for unknown */
+    uint32_t m_server_port;             /* 0 for no server */
+    uint32_t m_server_timeout;          /* 0 for not set */
+    ESP8266Link m_links[ESP8266_MAX_LINKS]; /* Links by mux_id(single mode uses 0) */
+    uint16_t m_link_up;                 /* Bit by mux_id: "CONNECT" seen, no "CLOSED" since */
+    
+    friend class ESP8266Client;
+    ESP8266Client *m_clients[ESP8266_MAX_LINKS]; /* ESP8266Client connected by mux_id */
+    
+    bool m_expect_reset;                /* Resetting or deep sleeping, "ready" is not a fault */
+    bool m_ap_change;                   /* Joining or leaving AP, "WIFI DISCONNECT" is not a fault */
+    uint8_t m_fault;                    /* ESP8266_FAULT_* */
+    uint8_t m_result;                   /* ESP8266_RESULT_* of the last command */
+    uint8_t m_sup_level;                /* Escalation level of next attempt */
+    unsigned long m_fault_since;        /* When the pending fault was detected */
+    unsigned long m_sup_last;           /* Last health check or recovery attempt */
+    uint32_t m_sup_wait;                /* Current backoff */
+    uint32_t m_sup_interval;
+    uint32_t m_sup_backoff_min;
+    uint32_t m_sup_backoff_max;
+    ESP8266SupervisorStats m_sup_stats;
+    
+    bool m_rtt_enabled;
+    uint16_t m_rtt_floor;
+    uint16_t m_rtt_ceiling;             /* 0 for the fixed timeout of each command */
+    uint16_t m_srtt[RTT_COUNT];         /* By class(0xFFFF for no sample) */
+    uint16_t m_rttvar[RTT_COUNT];
+    
+    ESP8266WaitHook m_wait;
+    ESP8266LockHook m_lock;
+    
+    uint16_t m_caps;                    /* ESP8266_CAP_* */
+    uint16_t m_at_version;              /* major * 100 + minor */
+    
+    bool m_passive;                     /* Passive receiving mode */
+    uint8_t m_passive_next;             /* The link served first next time */
+    uint16_t m_pending[ESP8266_MAX_LINKS]; /* Data pending in ESP8266 by link */
+    
+    ESP8266RecvHandler m_recv_handler;
+    char m_line[ESP8266_LINE_SIZE];     /* The line arriving outside of payload */
+    uint8_t m_line_len;
+    uint8_t m_ipd_id;                   /* Link of the payload arriving(ESP8266_MAX_LINKS: dropped) */
+    uint32_t m_ipd_left;                /* Bytes of the payload still to come */
+    uint8_t m_park[ESP8266_PARK_SIZE];  /* Records of <id><len><data> */
+    uint16_t m_park_len;
+    
+    uint8_t m_scan_state;               /* ESP8266_SCAN_* */
+    uint8_t m_scan_channel;             /* 0 for all */
+    String m_scan_ssid;                 /* Empty for all */
+    String m_scan_line;                 /* The line arriving */
+    unsigned long m_scan_start;
+    uint32_t m_scan_timeout;
+    ESP8266ScanCallback m_scan_callback;
+    ESP8266AP *m_scan_results;
+    uint8_t m_scan_size;
+    uint8_t m_scan_count;
 };
 
 #endif /* #ifndef __ESP8266_H__ */
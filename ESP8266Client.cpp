@@ -0,0 +1,194 @@
+/**
+ * @file ESP8266Client.cpp
+ * @brief The implementation of class ESP8266Client. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266Client.h"
+
+ESP8266Client::ESP8266Client(ESP8266 &wifi, uint8_t mux_id): m_wifi(&wifi), m_mux_id(mux_id),
+    m_connected(false), m_rx_pos(0), m_rx_len(0), m_tx_len(0), m_tx_since(0)
+{
+}
+
+ESP8266Client::~ESP8266Client()
+{
+    if (m_mux_id < ESP8266_MAX_LINKS && m_wifi->m_clients[m_mux_id] == this) {
+        m_wifi->m_clients[m_mux_id] = NULL;
+    }
+}
+
+int ESP8266Client::connect(IPAddress ip, uint16_t port)
+{
+    String addr;
+    addr += (int)ip[0];
+    addr += '.';
+    addr += (int)ip[1];
+    addr += '.';
+    addr += (int)ip[2];
+    addr += '.';
+    addr += (int)ip[3];
+    return connect(addr.c_str(), port);
+}
+
+int ESP8266Client::connect(const char *host, uint16_t port)
+{
+    m_rx_pos = 0;
+    m_rx_len = 0;
+    m_tx_len = 0;
+    m_connected = m_wifi->createTCP(m_mux_id, host, port);
+    if (m_connected && m_mux_id < ESP8266_MAX_LINKS) {
+        m_wifi->m_clients[m_mux_id] = this;
+    }
+    return m_connected ? 1 : 0;
+}
+
+size_t ESP8266Client::write(uint8_t b)
+{
+    return write(&b, 1);
+}
+
+size_t ESP8266Client::write(const uint8_t *buf, size_t size)
+{
+    size_t done = 0;
+    size_t n;
+    
+    if (!m_connected) {
+        return 0;
+    }
+    while (done < size) {
+        if (m_tx_len == 0) {
+            m_tx_since = millis();
+        }
+        n = sizeof(m_tx) - m_tx_len;
+        if (n > size - done) {
+            n = size - done;
+        }
+        memcpy(m_tx + m_tx_len, buf + done, n);
+        m_tx_len += n;
+        done += n;
+        if (m_tx_len == sizeof(m_tx)) {
+            flush();
+            if (!m_connected) {
+                return done - n;
+            }
+        }
+    }
+    flush_aged();
+    return done;
+}
+
+int ESP8266Client::available(void)
+{
+    flush_aged();
+    fill(ESP8266CLIENT_RX_POLL_MS);
+    return m_rx_len - m_rx_pos;
+}
+
+int ESP8266Client::read(void)
+{
+    if (available() <= 0) {
+        return -1;
+    }
+    return m_rx[m_rx_pos++];
+}
+
+int ESP8266Client::read(uint8_t *buf, size_t size)
+{
+    size_t n = available();
+    if (n > size) {
+        n = size;
+    }
+    memcpy(buf, m_rx + m_rx_pos, n);
+    m_rx_pos += n;
+    return n;
+}
+
+int ESP8266Client::peek(void)
+{
+    if (available() <= 0) {
+        return -1;
+    }
+    return m_rx[m_rx_pos];
+}
+
+void ESP8266Client::flush(void)
+{
+    if (m_tx_len == 0) {
+        return;
+    }
+    if (!m_wifi->send(m_mux_id, m_tx, m_tx_len)) {
+        m_connected = false;
+    }
+    m_tx_len = 0;
+}
+
+void ESP8266Client::stop(void)
+{
+    flush();
+    m_wifi->releaseTCP(m_mux_id);
+    m_connected = false;
+    m_rx_pos = 0;
+    m_rx_len = 0;
+    if (m_mux_id < ESP8266_MAX_LINKS && m_wifi->m_clients[m_mux_id] == this) {
+        m_wifi->m_clients[m_mux_id] = NULL;
+    }
+}
+
+uint8_t ESP8266Client::connected(void)
+{
+    flush_aged();
+    fill(0);
+    return (m_connected || m_rx_pos < m_rx_len) ? 1 : 0;
+}
+
+ESP8266Client::operator bool(void)
+{
+    return m_connected;
+}
+
+void ESP8266Client::flush_aged(void)
+{
+    if (m_tx_len > 0 && millis() - m_tx_since >= ESP8266CLIENT_TX_FLUSH_MS) {
+        flush();
+    }
+}
+
+void ESP8266Client::fill(uint32_t timeout)
+{
+    ESP8266Client *owner;
+    uint8_t id;
+    
+    if (m_rx_pos < m_rx_len || !m_connected) {
+        return;
+    }
+    m_rx_pos = 0;
+    m_rx_len = m_wifi->recv(m_mux_id, m_rx, sizeof(m_rx), timeout);
+    if (m_rx_len == 0) {
+        /* Data of another link arriving first: move it to its client */
+        for (id = 0; id < ESP8266_MAX_LINKS; id++) {
+            owner = m_wifi->m_clients[id];
+            if (owner && owner != this && m_wifi->getRecvPending(id) > 0) {
+                owner->fill(0);
+                m_rx_len = m_wifi->recv(m_mux_id, m_rx, sizeof(m_rx), 0);
+                break;
+            }
+        }
+    }
+    if (m_rx_len == 0 && !m_wifi->isConnected(m_mux_id)) {
+        m_connected = false; /* "<id>,CLOSED" seen */
+    }
+}
@@ -0,0 +1,173 @@
+/**
+ * @file ESP8266Client.h
+ * @brief The definition of class ESP8266Client. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ESP8266CLIENT_H__
+#define __ESP8266CLIENT_H__
+
+#include "Arduino.h"
+#include "Client.h"
+#include "IPAddress.h"
+#include "ESP8266.h"
+
+
+#define ESP8266CLIENT_RX_BUFFER_SIZE    (64)    /* Bytes received kept for read */
+#define ESP8266CLIENT_TX_BUFFER_SIZE    (64)    /* Bytes of writes coalesced */
+#define ESP8266CLIENT_TX_FLUSH_MS       (20)    /* Age of coalesced writes before sent */
+#define ESP8266CLIENT_RX_POLL_MS        (10)    /* Time waiting data when nothing buffered */
+
+
+/**
+ * Arduino Client on one TCP link of ESP8266(multiple mode). 
+ *
+ * Lets protocol libraries written for Client run on ESP8266. Reads are served 
+ * from an internal buffer refilled from the package arriving, so a package 
+ * longer than ESP8266CLIENT_RX_BUFFER_SIZE is read over several refills. 
+ * Small writes are coalesced and sent by one "AT+CIPSEND" when the buffer is 
+ * full, when the oldest byte is older than ESP8266CLIENT_TX_FLUSH_MS(checked 
+ * by write, available and connected), or on flush(). 
+ *
+ * A package of another link arriving first is handed to the ESP8266Client 
+ * connected on that link of the same ESP8266, if any, instead of blocking 
+ * this one. 
+ *
+ * @note enableMUX must be called before. 
+ */
+class ESP8266Client : public Client {
+ public:
+    /**
+     * Constuctor. 
+     *
+     * @param wifi - the ESP8266 to use. 
+     * @param mux_id - the identifier of the TCP link(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
+     */
+    ESP8266Client(ESP8266 &wifi, uint8_t mux_id);
+    
+    ~ESP8266Client();
+    
+    /**
+     * Create the TCP link. 
+     * 
+     * @param ip - the IP of the target host. 
+     * @param port - the port number of the target host. 
+     * @retval 1 - success.
+     * @retval 0 - failure.
+     */
+    virtual int connect(IPAddress ip, uint16_t port);
+    
+    /**
+     * Create the TCP link. 
+     * 
+     * @param host - the IP or domain name of the target host. 
+     * @param port - the port number of the target host. 
+     * @retval 1 - success.
+     * @retval 0 - failure.
+     */
+    virtual int connect(const char *host, uint16_t port);
+    
+    /**
+     * Write one byte(coalesced). 
+     *
+     * @return 1 if accepted, 0 if the link is down. 
+     */
+    virtual size_t write(uint8_t b);
+    
+    /**
+     * Write bytes(coalesced). 
+     *
+     * @return the number of bytes accepted. 
+     */
+    virtual size_t write(const uint8_t *buf, size_t size);
+    
+    /**
+     * Get the number of bytes ready to read. 
+     *
+     * Aged writes are sent first. If nothing is buffered, waits up to 
+     * ESP8266CLIENT_RX_POLL_MS for data. 
+     */
+    virtual int available(void);
+    
+    /**
+     * Read one byte. 
+     *
+     * @return the byte or -1 if nothing available. 
+     */
+    virtual int read(void);
+    
+    /**
+     * Read bytes. 
+     *
+     * @return the number of bytes read. 
+     */
+    virtual int read(uint8_t *buf, size_t size);
+    
+    /**
+     * Get the next byte without removing it. 
+     *
+     * @return the byte or -1 if nothing available. 
+     */
+    virtual int peek(void);
+    
+    /**
+     * Send the coalesced writes now. 
+     */
+    virtual void flush(void);
+    
+    /**
+     * Send the coalesced writes and release the TCP link. 
+     */
+    virtual void stop(void);
+    
+    /**
+     * Whether the link is up or data is left to read. 
+     *
+     * Aged writes are sent and data already arrived is read first, so 
+     * "<id>,CLOSED" from the remote is noticed. 
+     */
+    virtual uint8_t connected(void);
+    
+    virtual operator bool(void);
+    
+    using Print::write;
+
+ private:
+    
+    /*
+     * Send coalesced writes if their age exceeds ESP8266CLIENT_TX_FLUSH_MS. 
+     */
+    void flush_aged(void);
+    
+    /*
+     * Receive into m_rx if m_rx is empty, waiting up to timeout. 
+     */
+    void fill(uint32_t timeout);
+    
+    ESP8266 *m_wifi;
+    uint8_t m_mux_id;
+    bool m_connected;
+    
+    uint8_t m_rx[ESP8266CLIENT_RX_BUFFER_SIZE];
+    uint16_t m_rx_pos;      /* Next byte to read */
+    uint16_t m_rx_len;      /* Bytes in m_rx */
+    
+    uint8_t m_tx[ESP8266CLIENT_TX_BUFFER_SIZE];
+    uint16_t m_tx_len;
+    unsigned long m_tx_since;   /* When the first pending byte was written */
+};
+
+#endif /* #ifndef __ESP8266CLIENT_H__ */
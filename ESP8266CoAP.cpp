@@ -0,0 +1,393 @@
+/**
+ * @file ESP8266CoAP.cpp
+ * @brief The implementation of class ESP8266CoAP. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266CoAP.h"
+
+#define TYPE_CON            (0)
+#define TYPE_NON            (1)
+#define TYPE_ACK            (2)
+#define TYPE_RST            (3)
+
+#define OPTION_URI_PATH     (11)
+#define OPTION_FORMAT       (12)
+#define OPTION_BLOCK2       (23)
+#define OPTION_BLOCK1       (27)
+
+#define BLOCK_NONE          (0xFFFFFFFF)
+#define BLOCK_MORE          (0x08)
+
+/* SZX of ESP8266COAP_BLOCK_SIZE: size = 2 ^ (SZX + 4) */
+static uint8_t block_szx(void)
+{
+    uint8_t szx = 0;
+    while ((16 << szx) < ESP8266COAP_BLOCK_SIZE && szx < 6) {
+        szx++;
+    }
+    return szx;
+}
+
+ESP8266CoAP::ESP8266CoAP(ESP8266 &wifi, uint8_t mux_id): m_wifi(&wifi), m_mux_id(mux_id),
+    m_mid(0), m_last_option(0), m_retransmissions(0), m_code(0), m_payload(NULL), 
+    m_payload_len(0), m_block1(BLOCK_NONE), m_block2(BLOCK_NONE), m_tx_len(0)
+{
+    m_token[0] = 0;
+    m_token[1] = 0;
+}
+
+bool ESP8266CoAP::begin(String host, uint32_t port)
+{
+    m_mid = random(0x10000);
+    return m_wifi->registerUDP(m_mux_id, host, port);
+}
+
+void ESP8266CoAP::end(void)
+{
+    m_wifi->unregisterUDP(m_mux_id);
+}
+
+uint8_t ESP8266CoAP::get(const char *path, uint8_t *resp, uint16_t resp_size, uint16_t *resp_len)
+{
+    return request(ESP8266COAP_GET, path, NULL, 0, resp, resp_size, resp_len);
+}
+
+uint8_t ESP8266CoAP::post(const char *path, const uint8_t *payload, uint16_t len, uint16_t format)
+{
+    return request(ESP8266COAP_POST, path, payload, len, NULL, 0, NULL, true, format);
+}
+
+uint8_t ESP8266CoAP::put(const char *path, const uint8_t *payload, uint16_t len, uint16_t format)
+{
+    return request(ESP8266COAP_PUT, path, payload, len, NULL, 0, NULL, true, format);
+}
+
+uint32_t ESP8266CoAP::getRetransmissions(void)
+{
+    return m_retransmissions;
+}
+
+uint8_t ESP8266CoAP::request(uint8_t method, const char *path, const uint8_t *payload, uint16_t len, 
+    uint8_t *resp, uint16_t resp_size, uint16_t *resp_len, bool confirmable, uint16_t format)
+{
+    uint8_t szx = block_szx();
+    uint32_t block1 = BLOCK_NONE;
+    uint32_t block2;
+    uint32_t num = 0;
+    uint32_t offset = 0;
+    uint16_t stored = 0;
+    uint16_t size;
+    uint16_t n;
+    bool more;
+    
+    if (resp_len) {
+        *resp_len = 0;
+    }
+    m_token[0] = random(0x100);
+    m_token[1] = random(0x100);
+    
+    /* Block1: the payload block by block, 2.31 Continue for all but the last */
+    do {
+        size = 16 << szx;
+        n = len - offset > size ? size : len - offset;
+        more = offset + n < len;
+        if (len > ESP8266COAP_BLOCK_SIZE) {
+            block1 = (num << 4) | (more ? BLOCK_MORE : 0) | szx;
+        }
+        /* The last one asks early for a response in blocks we can take(Block2 num 0) */
+        block2 = more ? BLOCK_NONE : block_szx();
+        if (!build(method, confirmable, path, format, block1, block2, payload + offset, n)
+            || !exchange(confirmable)) {
+            return 0;
+        }
+        if (more && m_code != ESP8266COAP_CODE(2, 31)) {
+            return m_code;
+        }
+        offset += n;
+        if (more && m_block1 != BLOCK_NONE && (m_block1 & 0x07) < szx) {
+            /* The server wants smaller blocks, offset is a multiple of them */
+            szx = m_block1 & 0x07;
+        }
+        num = offset >> (szx + 4);
+    } while (more);
+    
+    /* Block2: the response block by block */
+    szx = block_szx();
+    while (true) {
+        if (m_block2 != BLOCK_NONE && ((m_block2 & 0x07) > szx 
+            || ((m_block2 & BLOCK_MORE) && m_payload_len != (16 << (m_block2 & 0x07))))) {
+            return 0; /* Larger than asked or cut: the blocks would not join */
+        }
+        if (resp && m_payload_len > 0 && stored < resp_size) {
+            n = m_payload_len < resp_size - stored ? m_payload_len : resp_size - stored;
+            memcpy(resp + stored, m_payload, n);
+            stored += n;
+            if (resp_len) {
+                *resp_len = stored;
+            }
+        }
+        if (m_block2 == BLOCK_NONE || !(m_block2 & BLOCK_MORE)) {
+            break;
+        }
+        /* Following the server if it picked smaller blocks than ours */
+        szx = m_block2 & 0x07;
+        num = (m_block2 >> 4) + 1;
+        if (!build(method, confirmable, path, format, BLOCK_NONE, (num << 4) | szx, NULL, 0)
+            || !exchange(confirmable)) {
+            return 0;
+        }
+    }
+    return m_code;
+}
+
+bool ESP8266CoAP::build(uint8_t method, bool confirmable, const char *path, uint16_t format, 
+    uint32_t block1, uint32_t block2, const uint8_t *payload, uint16_t len)
+{
+    const char *end;
+    
+    /* A token per block: a late response to the previous block never matches */
+    m_mid++;
+    m_token[1]++;
+    if (m_token[1] == 0) {
+        m_token[0]++;
+    }
+    m_tx[0] = 0x40 | ((confirmable ? TYPE_CON : TYPE_NON) << 4) | sizeof(m_token);
+    m_tx[1] = method;
+    m_tx[2] = m_mid >> 8;
+    m_tx[3] = m_mid & 0xFF;
+    memcpy(m_tx + 4, m_token, sizeof(m_token));
+    m_tx_len = 4 + sizeof(m_token);
+    m_last_option = 0;
+    
+    while (path && *path != '\0') {
+        if (*path == '/') {
+            path++;
+            continue;
+        }
+        end = strchr(path, '/');
+        if (end == NULL) {
+            end = path + strlen(path);
+        }
+        if (!put_option(OPTION_URI_PATH, (const uint8_t *)path, end - path)) {
+            return false;
+        }
+        path = end;
+    }
+    if ((format != ESP8266COAP_NO_FORMAT && !put_option_uint(OPTION_FORMAT, format))
+        || (block2 != BLOCK_NONE && !put_option_uint(OPTION_BLOCK2, block2))
+        || (block1 != BLOCK_NONE && !put_option_uint(OPTION_BLOCK1, block1))) {
+        return false;
+    }
+    if (len > 0) {
+        if ((uint32_t)m_tx_len + 1 + len > sizeof(m_tx)) {
+            return false;
+        }
+        m_tx[m_tx_len++] = 0xFF;
+        memcpy(m_tx + m_tx_len, payload, len);
+        m_tx_len += len;
+    }
+    return true;
+}
+
+bool ESP8266CoAP::put_option(uint16_t number, const uint8_t *value, uint16_t len)
+{
+    uint16_t delta = number - m_last_option;
+    uint8_t *head;
+    
+    if ((uint32_t)m_tx_len + 5 + len > sizeof(m_tx)) {
+        return false;
+    }
+    head = &m_tx[m_tx_len++];
+    /* Nibbles: 0 ~ 12, 13 + 1 byte, 14 + 2 bytes */
+    if (delta < 13) {
+        *head = delta << 4;
+    } else if (delta < 269) {
+        *head = 13 << 4;
+        m_tx[m_tx_len++] = delta - 13;
+    } else {
+        *head = 14 << 4;
+        m_tx[m_tx_len++] = (delta - 269) >> 8;
+        m_tx[m_tx_len++] = (delta - 269) & 0xFF;
+    }
+    if (len < 13) {
+        *head |= len;
+    } else if (len < 269) {
+        *head |= 13;
+        m_tx[m_tx_len++] = len - 13;
+    } else {
+        *head |= 14;
+        m_tx[m_tx_len++] = (len - 269) >> 8;
+        m_tx[m_tx_len++] = (len - 269) & 0xFF;
+    }
+    memcpy(m_tx + m_tx_len, value, len);
+    m_tx_len += len;
+    m_last_option = number;
+    return true;
+}
+
+bool ESP8266CoAP::put_option_uint(uint16_t number, uint32_t value)
+{
+    uint8_t bytes[4];
+    uint8_t len = 0;
+    int8_t i;
+    
+    /* The shortest big-endian form, 0 is empty */
+    for (i = 3; i >= 0; i--) {
+        if (len > 0 || ((value >> (i * 8)) & 0xFF) != 0) {
+            bytes[len++] = (value >> (i * 8)) & 0xFF;
+        }
+    }
+    return put_option(number, bytes, len);
+}
+
+bool ESP8266CoAP::exchange(bool confirmable)
+{
+    uint32_t timeout = ESP8266COAP_ACK_TIMEOUT + random(ESP8266COAP_ACK_TIMEOUT / 2);
+    uint8_t attempts = 0;
+    bool acked = false;     /* Empty ACK got, the response comes separately */
+    unsigned long start;
+    uint32_t elapsed;
+    uint32_t n;
+    uint8_t type;
+    uint16_t mid;
+    bool token_match;
+    
+    while (true) {
+        if (!acked && !m_wifi->send(m_mux_id, m_tx, m_tx_len)) {
+            return false;
+        }
+        start = millis();
+        while ((elapsed = millis() - start) < timeout) {
+            n = m_wifi->recv(m_mux_id, m_rx, sizeof(m_rx), timeout - elapsed);
+            if (n == sizeof(m_rx) && m_wifi->getRecvPending(m_mux_id) > 0) {
+                /* A datagram larger than m_rx: drop the rest, never parse it cut */
+                while (m_wifi->getRecvPending(m_mux_id) > 0 
+                    && m_wifi->recv(m_mux_id, m_rx, sizeof(m_rx), 0) > 0) {
+                }
+                return false;
+            }
+            if (n == 0 || !parse(n, &type, &mid, &token_match)) {
+                continue;
+            }
+            if (type == TYPE_RST && mid == m_mid) {
+                return false;
+            }
+            if (type == TYPE_ACK && mid == m_mid && m_code == 0) {
+                acked = true;
+            } else if (type == TYPE_ACK && mid == m_mid && token_match) {
+                return true; /* Piggybacked response */
+            } else if ((type == TYPE_CON || type == TYPE_NON) && token_match && m_code >= ESP8266COAP_CODE(2, 0)) {
+                if (type == TYPE_CON) {
+                    ack(mid);
+                }
+                return true; /* Separate response */
+            }
+        }
+        if (!confirmable || ++attempts > ESP8266COAP_MAX_RETRANSMIT) {
+            return false;
+        }
+        if (!acked) {
+            m_retransmissions++;
+        }
+        timeout *= 2;
+    }
+}
+
+bool ESP8266CoAP::parse(uint16_t len, uint8_t *type, uint16_t *mid, bool *token_match)
+{
+    uint16_t p;
+    uint16_t number = 0;
+    uint16_t delta;
+    uint16_t olen;
+    uint32_t value;
+    uint8_t tkl;
+    uint8_t i;
+    
+    if (len < 4 || (m_rx[0] >> 6) != 1) {
+        return false;
+    }
+    *type = (m_rx[0] >> 4) & 0x03;
+    tkl = m_rx[0] & 0x0F;
+    m_code = m_rx[1];
+    *mid = ((uint16_t)m_rx[2] << 8) | m_rx[3];
+    if (tkl > 8 || 4 + tkl > len) {
+        return false;
+    }
+    *token_match = tkl == sizeof(m_token) && memcmp(m_rx + 4, m_token, sizeof(m_token)) == 0;
+    m_payload = NULL;
+    m_payload_len = 0;
+    m_block1 = BLOCK_NONE;
+    m_block2 = BLOCK_NONE;
+    
+    p = 4 + tkl;
+    while (p < len) {
+        if (m_rx[p] == 0xFF) {
+            m_payload = m_rx + p + 1;
+            m_payload_len = len - p - 1;
+            break;
+        }
+        delta = m_rx[p] >> 4;
+        olen = m_rx[p] & 0x0F;
+        p++;
+        if (delta == 15 || olen == 15) {
+            return false;
+        }
+        if (delta == 13) {
+            if (p + 1 > len) return false;
+            delta = m_rx[p++] + 13;
+        } else if (delta == 14) {
+            if (p + 2 > len) return false;
+            delta = (((uint16_t)m_rx[p] << 8) | m_rx[p + 1]) + 269;
+            p += 2;
+        }
+        if (olen == 13) {
+            if (p + 1 > len) return false;
+            olen = m_rx[p++] + 13;
+        } else if (olen == 14) {
+            if (p + 2 > len) return false;
+            olen = (((uint16_t)m_rx[p] << 8) | m_rx[p + 1]) + 269;
+            p += 2;
+        }
+        if (p + olen > len) {
+            return false;
+        }
+        number += delta;
+        if (number == OPTION_BLOCK1 || number == OPTION_BLOCK2) {
+            value = 0;
+            for (i = 0; i < olen && i < 3; i++) {
+                value = (value << 8) | m_rx[p + i];
+            }
+            if (number == OPTION_BLOCK1) {
+                m_block1 = value;
+            } else {
+                m_block2 = value;
+            }
+        }
+        p += olen;
+    }
+    return true;
+}
+
+void ESP8266CoAP::ack(uint16_t mid)
+{
+    uint8_t msg[4];
+    msg[0] = 0x40 | (TYPE_ACK << 4);
+    msg[1] = 0;
+    msg[2] = mid >> 8;
+    msg[3] = mid & 0xFF;
+    m_wifi->send(m_mux_id, msg, sizeof(msg));
+}
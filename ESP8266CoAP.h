@@ -0,0 +1,177 @@
+/**
+ * @file ESP8266CoAP.h
+ * @brief The definition of class ESP8266CoAP. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ESP8266COAP_H__
+#define __ESP8266COAP_H__
+
+#include "Arduino.h"
+#include "ESP8266.h"
+
+
+#define ESP8266COAP_BLOCK_SIZE      (64)    /* Payload per message: 16, 32, 64, 128, ... 1024 */
+#define ESP8266COAP_BUFFER_SIZE     (ESP8266COAP_BLOCK_SIZE + 64) /* A message with options */
+#define ESP8266COAP_ACK_TIMEOUT     (2000)  /* ms, randomized up to 1.5 times */
+#define ESP8266COAP_MAX_RETRANSMIT  (4)
+
+#define ESP8266COAP_GET             (1)
+#define ESP8266COAP_POST            (2)
+#define ESP8266COAP_PUT             (3)
+#define ESP8266COAP_DELETE          (4)
+
+#define ESP8266COAP_NO_FORMAT       (0xFFFF) /* No Content-Format option */
+
+/*
+ * Response codes are class * 32 + detail, e.g. 2.05 Content is 0x45. 
+ */
+#define ESP8266COAP_CODE(c, dd)     (((c) << 5) | (dd))
+
+
+/**
+ * CoAP(RFC 7252) client on one UDP link of ESP8266(multiple mode). 
+ *
+ * A request is one datagram and its response another, instead of the TCP 
+ * handshake, headers and close of HTTP. Confirmable requests are retransmitted 
+ * with exponential backoff until acknowledged. Payloads larger than 
+ * ESP8266COAP_BLOCK_SIZE are sent(Block1) and received(Block2) block by block. 
+ * The request carries an early Block2(num 0, our size), so the server never 
+ * sends larger blocks, and smaller blocks picked by the server(Block2, or 
+ * Block1 of 2.31 Continue) are used for the rest of the transfer. A response 
+ * larger than the buffer or a block shorter than its size fails the request 
+ * instead of being returned cut. The buffers are fixed-size members of each 
+ * object sized by ESP8266COAP_BUFFER_SIZE(256 bytes by default: tx and rx of 
+ * 128), no heap. 
+ */
+class ESP8266CoAP {
+ public:
+    /**
+     * Constuctor. 
+     *
+     * @param wifi - the ESP8266 to use. 
+     * @param mux_id - the identifier of the UDP link(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
+     */
+    ESP8266CoAP(ESP8266 &wifi, uint8_t mux_id);
+    
+    /**
+     * Register the UDP link to a server. 
+     *
+     * @param host - the IP or domain name of the server. 
+     * @param port - the port number of the server(default: 5683). 
+     * @retval true - success.
+     * @retval false - failure.
+     */
+    bool begin(String host, uint32_t port = 5683);
+    
+    /**
+     * Unregister the UDP link. 
+     */
+    void end(void);
+    
+    /**
+     * Send a request and wait for its response. 
+     *
+     * @param method - ESP8266COAP_GET, ESP8266COAP_POST, ESP8266COAP_PUT or ESP8266COAP_DELETE. 
+     * @param path - the path of resource(e.g. "sensors/temp"). 
+     * @param payload - the payload(NULL for none). 
+     * @param len - the length of payload. 
+     * @param resp - the buffer for the payload of response(NULL to drop it). 
+     * @param resp_size - the size of resp. 
+     * @param resp_len - the length of the payload of response stored(NULL if not needed). 
+     * @param confirmable - CON(retransmitted until acknowledged) or NON(default: true). 
+     * @param format - the Content-Format of payload(default: ESP8266COAP_NO_FORMAT). 
+     * @return the response code(e.g. 0x45 for 2.05 Content), 0 for no response 
+     *  (or a response cut or in blocks larger than asked). 
+     */
+    uint8_t request(uint8_t method, const char *path, const uint8_t *payload, uint16_t len, 
+        uint8_t *resp, uint16_t resp_size, uint16_t *resp_len, 
+        bool confirmable = true, uint16_t format = ESP8266COAP_NO_FORMAT);
+    
+    /**
+     * GET a resource. 
+     *
+     * @see request
+     */
+    uint8_t get(const char *path, uint8_t *resp, uint16_t resp_size, uint16_t *resp_len);
+    
+    /**
+     * POST to a resource. 
+     *
+     * @see request
+     */
+    uint8_t post(const char *path, const uint8_t *payload, uint16_t len, 
+        uint16_t format = ESP8266COAP_NO_FORMAT);
+    
+    /**
+     * PUT a resource. 
+     *
+     * @see request
+     */
+    uint8_t put(const char *path, const uint8_t *payload, uint16_t len, 
+        uint16_t format = ESP8266COAP_NO_FORMAT);
+    
+    /**
+     * Get the number of retransmissions since constructed. 
+     */
+    uint32_t getRetransmissions(void);
+
+ private:
+    
+    /*
+     * Build a request of one block in m_tx. block1/block2 are the option values, 
+     * 0xFFFFFFFF for none. Return false if m_tx is too small. 
+     */
+    bool build(uint8_t method, bool confirmable, const char *path, uint16_t format, 
+        uint32_t block1, uint32_t block2, const uint8_t *payload, uint16_t len);
+    bool put_option(uint16_t number, const uint8_t *value, uint16_t len);
+    bool put_option_uint(uint16_t number, uint32_t value);
+    
+    /*
+     * Send m_tx and wait for the response of the same token, retransmitting 
+     * CON. The response is parsed into m_code, m_payload, m_block1, m_block2. 
+     */
+    bool exchange(bool confirmable);
+    
+    /*
+     * Parse a message in m_rx. Return false if malformed. 
+     */
+    bool parse(uint16_t len, uint8_t *type, uint16_t *mid, bool *token_match);
+    
+    /*
+     * Send an empty ACK for a confirmable response. 
+     */
+    void ack(uint16_t mid);
+    
+    ESP8266 *m_wifi;
+    uint8_t m_mux_id;
+    uint16_t m_mid;                 /* Message ID of the last message sent */
+    uint8_t m_token[2];             /* Token of the block in progress */
+    uint16_t m_last_option;
+    uint32_t m_retransmissions;
+    
+    uint8_t m_code;                 /* Parsed from the response */
+    uint8_t *m_payload;
+    uint16_t m_payload_len;
+    uint32_t m_block1;              /* 0xFFFFFFFF for none */
+    uint32_t m_block2;
+    
+    uint8_t m_tx[ESP8266COAP_BUFFER_SIZE];
+    uint16_t m_tx_len;
+    uint8_t m_rx[ESP8266COAP_BUFFER_SIZE];
+};
+
+#endif /* #ifndef __ESP8266COAP_H__ */
@@ -0,0 +1,173 @@
+/**
+ * @file ESP8266LZ.cpp
+ * @brief The implementation of class ESP8266LZEncoder and ESP8266LZDecoder. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266LZ.h"
+
+ESP8266LZEncoder::ESP8266LZEncoder(void): m_data(NULL), m_len(0), m_pos(0), m_left(0),
+    m_group_len(0), m_group_pos(0)
+{
+}
+
+uint32_t ESP8266LZEncoder::begin(const uint8_t *data, uint32_t len)
+{
+    uint32_t total = 0;
+    
+    m_data = data;
+    m_len = data ? len : 0;
+    m_pos = 0;
+    while (group()) {
+        total += m_group_len;
+    }
+    m_pos = 0;
+    m_group_len = 0;
+    m_group_pos = 0;
+    m_left = total;
+    return total;
+}
+
+bool ESP8266LZEncoder::group(void)
+{
+    uint32_t start;
+    uint32_t best_len;
+    uint32_t best_off;
+    uint32_t i;
+    uint32_t k;
+    uint32_t max;
+    uint8_t item;
+    
+    if (m_pos >= m_len) {
+        return false;
+    }
+    m_group[0] = 0;
+    m_group_len = 1;
+    m_group_pos = 0;
+    for (item = 0; item < 8 && m_pos < m_len; item++) {
+        /* The longest match in the window, the nearest if equal */
+        best_len = 0;
+        best_off = 0;
+        max = m_len - m_pos < ESP8266LZ_MAX_MATCH ? m_len - m_pos : ESP8266LZ_MAX_MATCH;
+        start = m_pos > ESP8266LZ_WINDOW ? m_pos - ESP8266LZ_WINDOW : 0;
+        for (i = m_pos; i-- > start && best_len < max; ) {
+            if (m_data[i] != m_data[m_pos]) {
+                continue;
+            }
+            for (k = 1; k < max && m_data[i + k] == m_data[m_pos + k]; k++) {
+            }
+            if (k > best_len) {
+                best_len = k;
+                best_off = m_pos - i;
+            }
+        }
+        if (best_len >= ESP8266LZ_MIN_MATCH) {
+            m_group[0] |= 1 << item;
+            m_group[m_group_len++] = best_off - 1;
+            m_group[m_group_len++] = best_len - ESP8266LZ_MIN_MATCH;
+            m_pos += best_len;
+        } else {
+            m_group[m_group_len++] = m_data[m_pos++];
+        }
+    }
+    return true;
+}
+
+int ESP8266LZEncoder::available(void)
+{
+    return m_left < 0x7FFF ? m_left : 0x7FFF;
+}
+
+int ESP8266LZEncoder::read(void)
+{
+    int c = peek();
+    if (c >= 0) {
+        m_group_pos++;
+        m_left--;
+    }
+    return c;
+}
+
+int ESP8266LZEncoder::peek(void)
+{
+    if (m_group_pos >= m_group_len && !group()) {
+        return -1;
+    }
+    return m_group[m_group_pos];
+}
+
+void ESP8266LZEncoder::flush(void)
+{
+}
+
+size_t ESP8266LZEncoder::write(uint8_t)
+{
+    return 0;
+}
+
+
+ESP8266LZDecoder::ESP8266LZDecoder(Print &out): m_out(&out)
+{
+    reset();
+}
+
+void ESP8266LZDecoder::reset(void)
+{
+    m_window_pos = 0;
+    m_flags = 0;
+    m_items = 0;
+    m_offset = -1;
+    m_length = 0;
+}
+
+uint32_t ESP8266LZDecoder::getLength(void)
+{
+    return m_length;
+}
+
+void ESP8266LZDecoder::put(uint8_t c)
+{
+    m_out->write(c);
+    m_window[m_window_pos++] = c; /* uint8_t wraps at ESP8266LZ_WINDOW */
+    m_length++;
+}
+
+size_t ESP8266LZDecoder::write(uint8_t c)
+{
+    uint16_t len;
+    uint8_t from;
+    
+    if (m_offset >= 0) {
+        /* The length of a match */
+        from = m_window_pos - m_offset;
+        for (len = c + ESP8266LZ_MIN_MATCH; len > 0; len--) {
+            put(m_window[from++]);
+        }
+        m_offset = -1;
+    } else if (m_items == 0) {
+        m_flags = c;
+        m_items = 8;
+        return 1;
+    } else if (m_flags & 1) {
+        m_offset = c + 1;
+        return 1;
+    } else {
+        put(c);
+    }
+    m_flags >>= 1;
+    m_items--;
+    return 1;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file ESP8266LZ.h
+ * @brief The definition of class ESP8266LZEncoder and ESP8266LZDecoder. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ESP8266LZ_H__
+#define __ESP8266LZ_H__
+
+#include "Arduino.h"
+
+
+/*
+ * Format: groups of a flag byte and 8 items(fewer in the last group). Bit i 
+ * (LSB first) of flag tells item i: 0 - a literal byte, 1 - a match of 2 bytes, 
+ * (offset - 1, length - 3), copying length(3 ~ 258) bytes from offset(1 ~ 256) 
+ * bytes back. 
+ */
+#define ESP8266LZ_WINDOW        (256)
+#define ESP8266LZ_MIN_MATCH     (3)
+#define ESP8266LZ_MAX_MATCH     (258)
+
+
+/**
+ * Compress data in RAM into a stream, read by ESP8266::send(mux_id, Stream &, len). 
+ *
+ * Compressed on the fly while read, so only a group(17 bytes) is buffered: 
+ *
+ *     uint32_t len = encoder.begin(json, json_len);
+ *     wifi.send(mux_id, encoder, len);
+ */
+class ESP8266LZEncoder : public Stream {
+ public:
+    /**
+     * Constuctor. 
+     */
+    ESP8266LZEncoder(void);
+    
+    /**
+     * Start compressing data. 
+     *
+     * The data is compressed once to count the length, then again while read. 
+     *
+     * @param data - the data, kept by caller until read completely. 
+     * @param len - the length of data. 
+     * @return the length of compressed data. 
+     */
+    uint32_t begin(const uint8_t *data, uint32_t len);
+    
+    virtual int available(void);
+    virtual int read(void);
+    virtual int peek(void);
+    virtual void flush(void);
+    virtual size_t write(uint8_t c);
+    using Print::write;
+
+ private:
+    
+    /*
+     * Compress the next group into m_group. Return false if no more data. 
+     */
+    bool group(void);
+    
+    const uint8_t *m_data;
+    uint32_t m_len;
+    uint32_t m_pos;         /* Next byte of data to compress */
+    uint32_t m_left;        /* Compressed bytes not read yet */
+    uint8_t m_group[1 + 8 * 2];
+    uint8_t m_group_len;
+    uint8_t m_group_pos;
+};
+
+
+/**
+ * Decompress data received, written into it piece by piece(e.g. by recv), 
+ * to another Print(a buffer, a file, Serial). 
+ *
+ * Needs ESP8266LZ_WINDOW bytes of RAM for the history. 
+ */
+class ESP8266LZDecoder : public Print {
+ public:
+    /**
+     * Constuctor. 
+     *
+     * @param out - where decompressed data goes. 
+     */
+    ESP8266LZDecoder(Print &out);
+    
+    /**
+     * Start a new compressed message. 
+     */
+    void reset(void);
+    
+    /**
+     * Get the length of data decompressed since reset. 
+     */
+    uint32_t getLength(void);
+    
+    virtual size_t write(uint8_t c);
+    using Print::write;
+
+ private:
+    
+    void put(uint8_t c);
+    
+    Print *m_out;
+    uint8_t m_window[ESP8266LZ_WINDOW];
+    uint8_t m_window_pos;
+    uint8_t m_flags;
+    uint8_t m_items;        /* Items left in the group */
+    int16_t m_offset;       /* -1 if the next byte is not the length of a match */
+    uint32_t m_length;
+};
+
+#endif /* #ifndef __ESP8266LZ_H__ */
@@ -0,0 +1,475 @@
+/**
+ * @file ESP8266MQTT.cpp
+ * @brief The implementation of class ESP8266MQTT. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266MQTT.h"
+
+#define MQTT_CONNECT        (0x10)
+#define MQTT_CONNACK        (0x20)
+#define MQTT_PUBLISH        (0x30)
+#define MQTT_PUBACK         (0x40)
+#define MQTT_SUBSCRIBE      (0x82)
+#define MQTT_UNSUBSCRIBE    (0xA2)
+#define MQTT_PINGREQ        (0xC0)
+#define MQTT_PINGRESP       (0xD0)
+#define MQTT_DISCONNECT     (0xE0)
+
+#define MQTT_FLAG_DUP       (0x08)
+
+ESP8266MQTT::ESP8266MQTT(ESP8266 &wifi, uint8_t mux_id): m_wifi(&wifi), m_mux_id(mux_id),
+    m_connected(false), m_session_present(false), m_batch(false), m_ping_pending(false),
+    m_keepalive(0), m_packet_id(0), m_last_out(0), m_last_in(0), m_callback(NULL),
+    m_tx_len(0), m_rx_len(0), m_store_len(0)
+{
+    memset(m_inflight, 0, sizeof(m_inflight));
+}
+
+bool ESP8266MQTT::connect(String host, uint32_t port, const char *client_id, 
+    const char *user, const char *pwd, uint16_t keepalive, bool clean_session)
+{
+    uint16_t remaining;
+    uint8_t flags = 0;
+    unsigned long start;
+    uint32_t n;
+    
+    m_connected = false;
+    m_batch = false;
+    m_ping_pending = false;
+    m_tx_len = 0;
+    m_rx_len = 0;
+    if (clean_session) {
+        memset(m_inflight, 0, sizeof(m_inflight));
+        m_store_len = 0;
+    }
+    if (!m_wifi->createTCP(m_mux_id, host, port)) {
+        return false;
+    }
+    
+    remaining = 10 + 2 + strlen(client_id);
+    if (clean_session) {
+        flags |= 0x02;
+    }
+    if (user) {
+        flags |= 0x80;
+        remaining += 2 + strlen(user);
+    }
+    if (pwd) {
+        flags |= 0x40;
+        remaining += 2 + strlen(pwd);
+    }
+    if (begin_packet(MQTT_CONNECT, remaining) < 0) {
+        m_wifi->releaseTCP(m_mux_id);
+        return false;
+    }
+    put_str("MQTT");
+    m_tx[m_tx_len++] = 4; /* Protocol level 3.1.1 */
+    m_tx[m_tx_len++] = flags;
+    put_u16(keepalive);
+    put_str(client_id);
+    if (user) {
+        put_str(user);
+    }
+    if (pwd) {
+        put_str(pwd);
+    }
+    m_connected = true; /* Let send_tx go */
+    if (!send_tx(true)) {
+        m_wifi->releaseTCP(m_mux_id);
+        return false;
+    }
+    m_connected = false;
+    
+    start = millis();
+    while (millis() - start < ESP8266MQTT_TIMEOUT_MS && m_rx_len < 4) {
+        n = m_wifi->recv(m_mux_id, m_rx + m_rx_len, sizeof(m_rx) - m_rx_len, 100);
+        m_rx_len += n;
+    }
+    if (m_rx_len < 4 || m_rx[0] != MQTT_CONNACK || m_rx[3] != 0) {
+        m_wifi->releaseTCP(m_mux_id);
+        m_rx_len = 0;
+        return false;
+    }
+    m_session_present = (m_rx[2] & 0x01) != 0;
+    m_rx_len -= 4;
+    memmove(m_rx, m_rx + 4, m_rx_len);
+    
+    m_connected = true;
+    m_keepalive = keepalive;
+    m_last_in = millis();
+    if (!clean_session) {
+        store_retransmit(true);
+        send_tx(true);
+    }
+    return m_connected;
+}
+
+void ESP8266MQTT::disconnect(void)
+{
+    if (m_connected) {
+        m_batch = false;
+        if (begin_packet(MQTT_DISCONNECT, 0) >= 0) {
+            send_tx(true);
+        }
+    }
+    m_wifi->releaseTCP(m_mux_id);
+    m_connected = false;
+}
+
+bool ESP8266MQTT::connected(void)
+{
+    return m_connected;
+}
+
+bool ESP8266MQTT::sessionPresent(void)
+{
+    return m_session_present;
+}
+
+bool ESP8266MQTT::publish(const char *topic, const uint8_t *payload, uint16_t len, uint8_t qos, bool retain)
+{
+    uint16_t topic_len = strlen(topic);
+    uint16_t remaining;
+    uint16_t id = 0;
+    int16_t offset;
+    
+    if (!m_connected || qos > 1) {
+        return false;
+    }
+    remaining = 2 + topic_len + len + (qos ? 2 : 0);
+    offset = begin_packet(MQTT_PUBLISH | (qos << 1) | (retain ? 1 : 0), remaining);
+    if (offset < 0) {
+        return false;
+    }
+    put_str(topic);
+    if (qos) {
+        id = next_id();
+        put_u16(id);
+    }
+    put_bytes(payload, len);
+    if (qos && !store_add(id, offset, m_tx_len - offset)) {
+        m_tx_len = offset; /* No room to keep it, take it back */
+        return false;
+    }
+    return send_tx(false);
+}
+
+bool ESP8266MQTT::publish(const char *topic, const char *payload, uint8_t qos, bool retain)
+{
+    return publish(topic, (const uint8_t *)payload, strlen(payload), qos, retain);
+}
+
+void ESP8266MQTT::beginBatch(void)
+{
+    m_batch = true;
+}
+
+bool ESP8266MQTT::endBatch(void)
+{
+    m_batch = false;
+    return send_tx(true);
+}
+
+bool ESP8266MQTT::subscribe(const char *topic, uint8_t qos)
+{
+    if (!m_connected || begin_packet(MQTT_SUBSCRIBE, 2 + 2 + strlen(topic) + 1) < 0) {
+        return false;
+    }
+    put_u16(next_id());
+    put_str(topic);
+    m_tx[m_tx_len++] = qos > 1 ? 1 : qos;
+    return send_tx(true);
+}
+
+bool ESP8266MQTT::unsubscribe(const char *topic)
+{
+    if (!m_connected || begin_packet(MQTT_UNSUBSCRIBE, 2 + 2 + strlen(topic)) < 0) {
+        return false;
+    }
+    put_u16(next_id());
+    put_str(topic);
+    return send_tx(true);
+}
+
+void ESP8266MQTT::setCallback(ESP8266MQTTCallback callback)
+{
+    m_callback = callback;
+}
+
+bool ESP8266MQTT::loop(uint32_t timeout)
+{
+    unsigned long now;
+    uint32_t n;
+    
+    if (!m_connected) {
+        return false;
+    }
+    if (m_rx_len < sizeof(m_rx)) {
+        n = m_wifi->recv(m_mux_id, m_rx + m_rx_len, sizeof(m_rx) - m_rx_len, timeout);
+        if (n == 0 && !m_wifi->isConnected(m_mux_id)) {
+            /* Closed by the broker("<id>,CLOSED") */
+            m_connected = false;
+            return false;
+        }
+        m_rx_len += n;
+    }
+    handle_rx();
+    
+    now = millis();
+    if (m_keepalive && now - m_last_out >= (uint32_t)m_keepalive * 1000) {
+        if (m_ping_pending) {
+            /* No PINGRESP in a whole interval, the broker is gone */
+            m_wifi->releaseTCP(m_mux_id);
+            m_connected = false;
+            return false;
+        }
+        if (begin_packet(MQTT_PINGREQ, 0) >= 0 && send_tx(true)) {
+            m_ping_pending = true;
+        }
+    }
+    store_retransmit(false);
+    send_tx(false);
+    return m_connected;
+}
+
+uint8_t ESP8266MQTT::inflight(void)
+{
+    uint8_t i;
+    uint8_t count = 0;
+    for (i = 0; i < ESP8266MQTT_MAX_INFLIGHT; i++) {
+        if (m_inflight[i].id) {
+            count++;
+        }
+    }
+    return count;
+}
+
+int16_t ESP8266MQTT::begin_packet(uint8_t header, uint16_t remaining)
+{
+    uint16_t total = 1 + (remaining < 128 ? 1 : 2) + remaining;
+    int16_t offset;
+    
+    if (total > sizeof(m_tx)) {
+        return -1;
+    }
+    if (m_tx_len + total > sizeof(m_tx) && !send_tx(true)) {
+        return -1;
+    }
+    offset = m_tx_len;
+    m_tx[m_tx_len++] = header;
+    if (remaining < 128) {
+        m_tx[m_tx_len++] = remaining;
+    } else {
+        m_tx[m_tx_len++] = (remaining & 0x7F) | 0x80;
+        m_tx[m_tx_len++] = remaining >> 7;
+    }
+    return offset;
+}
+
+void ESP8266MQTT::put_u16(uint16_t v)
+{
+    m_tx[m_tx_len++] = v >> 8;
+    m_tx[m_tx_len++] = v & 0xFF;
+}
+
+void ESP8266MQTT::put_str(const char *s)
+{
+    uint16_t len = strlen(s);
+    put_u16(len);
+    put_bytes((const uint8_t *)s, len);
+}
+
+void ESP8266MQTT::put_bytes(const uint8_t *data, uint16_t len)
+{
+    memcpy(m_tx + m_tx_len, data, len);
+    m_tx_len += len;
+}
+
+bool ESP8266MQTT::send_tx(bool force)
+{
+    bool ret;
+    if (m_tx_len == 0 || (m_batch && !force)) {
+        return true;
+    }
+    if (!m_connected) {
+        m_tx_len = 0;
+        return false;
+    }
+    ret = m_wifi->send(m_mux_id, m_tx, m_tx_len);
+    m_tx_len = 0;
+    if (ret) {
+        m_last_out = millis();
+    } else {
+        m_connected = false;
+    }
+    return ret;
+}
+
+void ESP8266MQTT::handle_rx(void)
+{
+    uint32_t remaining;
+    uint16_t total;
+    uint8_t i;
+    
+    while (m_rx_len >= 2) {
+        remaining = 0;
+        for (i = 1; i < 5 && i < m_rx_len; i++) {
+            remaining |= (uint32_t)(m_rx[i] & 0x7F) << (7 * (i - 1));
+            if (!(m_rx[i] & 0x80)) {
+                break;
+            }
+        }
+        if (i == m_rx_len) {
+            return; /* Length not complete */
+        }
+        if (i == 5 || 1 + i + remaining > sizeof(m_rx)) {
+            /* Larger than we can ever hold, the stream is lost */
+            m_rx_len = 0;
+            m_wifi->releaseTCP(m_mux_id);
+            m_connected = false;
+            return;
+        }
+        total = 1 + i + remaining;
+        if (m_rx_len < total) {
+            return;
+        }
+        m_last_in = millis();
+        handle_packet(m_rx[0], m_rx + 1 + i, remaining);
+        m_rx_len -= total;
+        memmove(m_rx, m_rx + total, m_rx_len);
+    }
+}
+
+void ESP8266MQTT::handle_packet(uint8_t header, uint8_t *body, uint16_t len)
+{
+    uint16_t topic_len;
+    uint16_t pos;
+    uint16_t id = 0;
+    uint8_t qos;
+    
+    switch (header & 0xF0) {
+    case MQTT_PUBLISH:
+        qos = (header >> 1) & 0x03;
+        if (len < 2) {
+            return;
+        }
+        topic_len = ((uint16_t)body[0] << 8) | body[1];
+        /* In 32 bits, a topic length near 0xFFFF would wrap pos */
+        if ((uint32_t)topic_len + (qos ? 4 : 2) > len) {
+            return;
+        }
+        pos = 2 + topic_len;
+        if (qos) {
+            id = ((uint16_t)body[pos] << 8) | body[pos + 1];
+            pos += 2;
+        }
+        /* Move the topic over its length to make room for NUL */
+        memmove(body, body + 2, topic_len);
+        body[topic_len] = '\0';
+        if (m_callback) {
+            m_callback((const char *)body, body + pos, len - pos);
+        }
+        if (qos == 1 && begin_packet(MQTT_PUBACK, 2) >= 0) {
+            put_u16(id);
+        }
+        break;
+    case MQTT_PUBACK:
+        if (len >= 2) {
+            store_remove(((uint16_t)body[0] << 8) | body[1]);
+        }
+        break;
+    case MQTT_PINGRESP:
+        m_ping_pending = false;
+        break;
+    default: /* SUBACK, UNSUBACK */
+        break;
+    }
+}
+
+bool ESP8266MQTT::store_add(uint16_t id, uint16_t offset, uint16_t len)
+{
+    uint8_t i;
+    if (m_store_len + len > sizeof(m_store)) {
+        return false;
+    }
+    for (i = 0; i < ESP8266MQTT_MAX_INFLIGHT; i++) {
+        if (m_inflight[i].id == 0) {
+            memcpy(m_store + m_store_len, m_tx + offset, len);
+            m_inflight[i].id = id;
+            m_inflight[i].offset = m_store_len;
+            m_inflight[i].len = len;
+            m_inflight[i].sent = millis();
+            m_store_len += len;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ESP8266MQTT::store_remove(uint16_t id)
+{
+    uint8_t i;
+    uint8_t j;
+    uint16_t offset;
+    uint16_t len;
+    
+    for (i = 0; i < ESP8266MQTT_MAX_INFLIGHT; i++) {
+        if (m_inflight[i].id != id || id == 0) {
+            continue;
+        }
+        offset = m_inflight[i].offset;
+        len = m_inflight[i].len;
+        memmove(m_store + offset, m_store + offset + len, m_store_len - offset - len);
+        m_store_len -= len;
+        m_inflight[i].id = 0;
+        for (j = 0; j < ESP8266MQTT_MAX_INFLIGHT; j++) {
+            if (m_inflight[j].id && m_inflight[j].offset > offset) {
+                m_inflight[j].offset -= len;
+            }
+        }
+        return;
+    }
+}
+
+void ESP8266MQTT::store_retransmit(bool all)
+{
+    uint8_t i;
+    Inflight *p;
+    unsigned long now = millis();
+    
+    for (i = 0; i < ESP8266MQTT_MAX_INFLIGHT && m_connected; i++) {
+        p = &m_inflight[i];
+        if (p->id == 0 || (!all && now - p->sent < ESP8266MQTT_RETRY_MS)) {
+            continue;
+        }
+        if (m_tx_len + p->len > sizeof(m_tx) && !send_tx(true)) {
+            return;
+        }
+        m_store[p->offset] |= MQTT_FLAG_DUP;
+        memcpy(m_tx + m_tx_len, m_store + p->offset, p->len);
+        m_tx_len += p->len;
+        p->sent = now;
+    }
+}
+
+uint16_t ESP8266MQTT::next_id(void)
+{
+    if (++m_packet_id == 0) {
+        m_packet_id = 1;
+    }
+    return m_packet_id;
+}
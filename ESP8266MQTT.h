@@ -0,0 +1,230 @@
+/**
+ * @file ESP8266MQTT.h
+ * @brief The definition of class ESP8266MQTT. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ESP8266MQTT_H__
+#define __ESP8266MQTT_H__
+
+#include "Arduino.h"
+#include "ESP8266.h"
+
+
+#define ESP8266MQTT_TX_BUFFER_SIZE  (128)   /* Packets batched into one "AT+CIPSEND" */
+#define ESP8266MQTT_RX_BUFFER_SIZE  (128)   /* Largest packet received */
+#define ESP8266MQTT_MAX_INFLIGHT    (4)     /* QoS 1 publishes waiting PUBACK */
+#define ESP8266MQTT_STORE_SIZE      (128)   /* Bytes keeping QoS 1 publishes for retransmission */
+#define ESP8266MQTT_RETRY_MS        (10000) /* Retransmit QoS 1 publishes unacknowledged for so long */
+#define ESP8266MQTT_TIMEOUT_MS      (5000)  /* Waiting CONNACK */
+
+/**
+ * Called for every PUBLISH received. 
+ *
+ * @param topic - the topic(NUL terminated). 
+ * @param payload - the payload, valid only during the call. 
+ * @param len - the length of payload. 
+ */
+typedef void (*ESP8266MQTTCallback)(const char *topic, const uint8_t *payload, uint16_t len);
+
+
+/**
+ * MQTT 3.1.1 client on one TCP link of ESP8266(multiple mode). 
+ *
+ * The buffers are fixed-size members of each object sized by the ESP8266MQTT_* 
+ * macros(424 bytes by default: tx, rx and store of 128 and 4 inflight slots 
+ * of 10), no heap is used after connect. Publishes between beginBatch and endBatch are packed 
+ * into as few "AT+CIPSEND" as the tx buffer allows. QoS 1 publishes are kept 
+ * with their packet identifier until PUBACK and retransmitted with DUP set 
+ * after ESP8266MQTT_RETRY_MS or when a persistent session is resumed. 
+ * 
+ * Data is read into the room left in the rx buffer, the rest of a longer 
+ * "+IPD" stays for the next loop, and data of other links is left to their 
+ * own recv. A packet larger than the rx buffer or a link closed by the 
+ * broker ends the session. 
+ */
+class ESP8266MQTT {
+ public:
+    /**
+     * Constuctor. 
+     *
+     * @param wifi - the ESP8266 to use. 
+     * @param mux_id - the identifier of the TCP link(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
+     */
+    ESP8266MQTT(ESP8266 &wifi, uint8_t mux_id);
+    
+    /**
+     * Connect to a broker. 
+     * 
+     * @param host - the IP or domain name of the broker. 
+     * @param port - the port number of the broker. 
+     * @param client_id - the client identifier. 
+     * @param user - the user name(NULL for none). 
+     * @param pwd - the password(NULL for none). 
+     * @param keepalive - the keep alive interval in seconds(default: 60). 
+     * @param clean_session - false to resume a persistent session(default: true). 
+     * @retval true - success(CONNACK accepted).
+     * @retval false - failure.
+     */
+    bool connect(String host, uint32_t port, const char *client_id, 
+        const char *user = NULL, const char *pwd = NULL, 
+        uint16_t keepalive = 60, bool clean_session = true);
+    
+    /**
+     * Send DISCONNECT and release the TCP link. 
+     */
+    void disconnect(void);
+    
+    /**
+     * Whether connected to the broker. 
+     */
+    bool connected(void);
+    
+    /**
+     * Whether the broker resumed a session at the last connect. 
+     */
+    bool sessionPresent(void);
+    
+    /**
+     * Publish a message. 
+     * 
+     * @param topic - the topic. 
+     * @param payload - the payload. 
+     * @param len - the length of payload. 
+     * @param qos - 0 or 1(default: 0). 
+     * @param retain - the retain flag(default: false). 
+     * @retval true - sent, or queued when batching.
+     * @retval false - failure(not connected, too large or no room for QoS 1). 
+     */
+    bool publish(const char *topic, const uint8_t *payload, uint16_t len, 
+        uint8_t qos = 0, bool retain = false);
+    
+    /**
+     * Publish a string message. 
+     * 
+     * @see publish(const char *topic, const uint8_t *payload, uint16_t len, uint8_t qos, bool retain);
+     */
+    bool publish(const char *topic, const char *payload, uint8_t qos = 0, bool retain = false);
+    
+    /**
+     * Start batching: packets are kept in the tx buffer until endBatch or full. 
+     */
+    void beginBatch(void);
+    
+    /**
+     * Stop batching and send everything batched in one "AT+CIPSEND". 
+     *
+     * @retval true - success.
+     * @retval false - failure.
+     */
+    bool endBatch(void);
+    
+    /**
+     * Subscribe to a topic filter. 
+     * 
+     * @param topic - the topic filter. 
+     * @param qos - the maximum QoS requested(0 or 1, default: 0). 
+     * @retval true - SUBSCRIBE sent.
+     * @retval false - failure.
+     */
+    bool subscribe(const char *topic, uint8_t qos = 0);
+    
+    /**
+     * Unsubscribe from a topic filter. 
+     * 
+     * @retval true - UNSUBSCRIBE sent.
+     * @retval false - failure.
+     */
+    bool unsubscribe(const char *topic);
+    
+    /**
+     * Set the callback for messages received. 
+     */
+    void setCallback(ESP8266MQTTCallback callback);
+    
+    /**
+     * Process incoming packets, keepalive and retransmission. 
+     *
+     * Should be called frequently in loop(). 
+     *
+     * @param timeout - the time waiting for data(default: 10ms). 
+     * @retval true - still connected.
+     * @retval false - disconnected.
+     */
+    bool loop(uint32_t timeout = 10);
+    
+    /**
+     * Get the number of QoS 1 publishes waiting for PUBACK. 
+     */
+    uint8_t inflight(void);
+
+ private:
+    
+    struct Inflight {
+        uint16_t id;            /* 0 for a free slot */
+        uint16_t offset;        /* Offset of the packet in m_store */
+        uint16_t len;
+        unsigned long sent;
+    };
+    
+    /*
+     * Append a packet of given fixed header and remaining length to m_tx, 
+     * flushing first if no room. Returns the offset of the packet or -1. 
+     */
+    int16_t begin_packet(uint8_t header, uint16_t remaining);
+    void put_u16(uint16_t v);
+    void put_str(const char *s);
+    void put_bytes(const uint8_t *data, uint16_t len);
+    
+    /*
+     * Send m_tx unless batching and not forced. 
+     */
+    bool send_tx(bool force);
+    
+    /*
+     * Parse and handle complete packets in m_rx. 
+     */
+    void handle_rx(void);
+    void handle_packet(uint8_t header, uint8_t *body, uint16_t len);
+    
+    bool store_add(uint16_t id, uint16_t offset, uint16_t len);
+    void store_remove(uint16_t id);
+    void store_retransmit(bool all);
+    
+    uint16_t next_id(void);
+    
+    ESP8266 *m_wifi;
+    uint8_t m_mux_id;
+    bool m_connected;
+    bool m_session_present;
+    bool m_batch;
+    bool m_ping_pending;
+    uint16_t m_keepalive;           /* Seconds */
+    uint16_t m_packet_id;
+    unsigned long m_last_out;
+    unsigned long m_last_in;
+    ESP8266MQTTCallback m_callback;
+    
+    uint8_t m_tx[ESP8266MQTT_TX_BUFFER_SIZE];
+    uint16_t m_tx_len;
+    uint8_t m_rx[ESP8266MQTT_RX_BUFFER_SIZE];
+    uint16_t m_rx_len;
+    uint8_t m_store[ESP8266MQTT_STORE_SIZE];
+    uint16_t m_store_len;
+    Inflight m_inflight[ESP8266MQTT_MAX_INFLIGHT];
+};
+
+#endif /* #ifndef __ESP8266MQTT_H__ */
@@ -0,0 +1,246 @@
+/**
+ * @file ESP8266Pool.cpp
+ * @brief The implementation of class ESP8266Pool. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266Pool.h"
+
+ESP8266Pool::ESP8266Pool(void): m_count(0), m_next(0), m_poll(0), m_failed(false)
+{
+    memset(m_wifi, 0, sizeof(m_wifi));
+    memset(m_used, 0, sizeof(m_used));
+    memset(m_pending, 0, sizeof(m_pending));
+    memset(m_spread, ESP8266POOL_NONE, sizeof(m_spread));
+}
+
+bool ESP8266Pool::add(ESP8266 &wifi)
+{
+    if (m_count >= ESP8266POOL_MAX_MODULES) {
+        return false;
+    }
+    m_wifi[m_count++] = &wifi;
+    return true;
+}
+
+uint8_t ESP8266Pool::modules(void)
+{
+    return m_count;
+}
+
+uint8_t ESP8266Pool::createTCP(String addr, uint32_t port)
+{
+    uint8_t link = pick();
+    uint8_t m = link / ESP8266_MAX_LINKS;
+    uint8_t id = link % ESP8266_MAX_LINKS;
+    
+    if (link == ESP8266POOL_NONE) {
+        return ESP8266POOL_NONE;
+    }
+    settle(m); /* A failure of an earlier datagram is left for flush */
+    if (!m_wifi[m]->createTCP(id, addr, port)) {
+        return ESP8266POOL_NONE;
+    }
+    m_used[m] |= (uint16_t)1 << id;
+    return link;
+}
+
+uint8_t ESP8266Pool::registerUDP(String addr, uint32_t port)
+{
+    uint8_t link = pick();
+    uint8_t m = link / ESP8266_MAX_LINKS;
+    uint8_t id = link % ESP8266_MAX_LINKS;
+    
+    if (link == ESP8266POOL_NONE) {
+        return ESP8266POOL_NONE;
+    }
+    settle(m); /* A failure of an earlier datagram is left for flush */
+    if (!m_wifi[m]->registerUDP(id, addr, port)) {
+        return ESP8266POOL_NONE;
+    }
+    m_used[m] |= (uint16_t)1 << id;
+    return link;
+}
+
+uint8_t ESP8266Pool::registerUDPSpread(String addr, uint32_t port)
+{
+    uint8_t m;
+    uint8_t id;
+    uint8_t n = 0;
+    
+    for (m = 0; m < m_count; m++) {
+        if (m_spread[m] != ESP8266POOL_NONE) {
+            n++;
+            continue;
+        }
+        for (id = 0; id < ESP8266_MAX_LINKS; id++) {
+            if (!(m_used[m] & ((uint16_t)1 << id))) {
+                break;
+            }
+        }
+        if (id == ESP8266_MAX_LINKS) {
+            continue;
+        }
+        settle(m);
+        if (m_wifi[m]->registerUDP(id, addr, port)) {
+            m_used[m] |= (uint16_t)1 << id;
+            m_spread[m] = id;
+            n++;
+        }
+    }
+    return n;
+}
+
+bool ESP8266Pool::release(uint8_t link)
+{
+    uint8_t m = link / ESP8266_MAX_LINKS;
+    uint8_t id = link % ESP8266_MAX_LINKS;
+    
+    if (m >= m_count) {
+        return false;
+    }
+    settle(m);
+    m_used[m] &= ~((uint16_t)1 << id);
+    if (m_spread[m] == id) {
+        m_spread[m] = ESP8266POOL_NONE;
+    }
+    return m_wifi[m]->releaseTCP(id);
+}
+
+void ESP8266Pool::unregisterUDPSpread(void)
+{
+    uint8_t m;
+    for (m = 0; m < m_count; m++) {
+        if (m_spread[m] != ESP8266POOL_NONE) {
+            release(m * ESP8266_MAX_LINKS + m_spread[m]);
+        }
+    }
+}
+
+bool ESP8266Pool::send(uint8_t link, const uint8_t *buffer, uint32_t len)
+{
+    uint8_t m = link / ESP8266_MAX_LINKS;
+    
+    if (m >= m_count) {
+        return false;
+    }
+    settle(m);
+    return m_wifi[m]->send(link % ESP8266_MAX_LINKS, buffer, len);
+}
+
+bool ESP8266Pool::sendSpread(const uint8_t *buffer, uint32_t len)
+{
+    uint8_t i;
+    uint8_t m;
+    
+    for (i = 0; i < m_count; i++) {
+        m = m_next;
+        m_next = (m_next + 1) % m_count;
+        if (m_spread[m] == ESP8266POOL_NONE) {
+            continue;
+        }
+        settle(m); /* A failure of the previous one is left for flush */
+        m_pending[m] = m_wifi[m]->sendAsync(m_spread[m], buffer, len);
+        return m_pending[m];
+    }
+    return false;
+}
+
+bool ESP8266Pool::flush(void)
+{
+    uint8_t m;
+    bool ret;
+    for (m = 0; m < m_count; m++) {
+        settle(m);
+    }
+    ret = !m_failed;
+    m_failed = false;
+    return ret;
+}
+
+uint32_t ESP8266Pool::recv(uint8_t *link, uint8_t *buffer, uint32_t buffer_size, uint32_t timeout)
+{
+    unsigned long start = millis();
+    uint8_t id;
+    uint8_t m;
+    uint32_t len;
+    
+    if (m_count == 0) {
+        return 0;
+    }
+    /* 
+     * Without waiting on a module: each takes only what arrived, and its 
+     * parser keeps a header cut in the middle for the next round. Once a 
+     * payload has started, that module reads it to the end. 
+     */
+    do {
+        m = m_poll;
+        m_poll = (m_poll + 1) % m_count;
+        settle(m);
+        len = m_wifi[m]->recv(&id, buffer, buffer_size, 0);
+        if (len > 0) {
+            if (link) {
+                *link = m * ESP8266_MAX_LINKS + id;
+            }
+            return len;
+        }
+    } while (millis() - start < timeout);
+    return 0;
+}
+
+uint8_t ESP8266Pool::pick(void)
+{
+    uint8_t m;
+    uint8_t id;
+    uint8_t load;
+    uint8_t best = ESP8266POOL_NONE;
+    uint8_t best_load = 0xFF;
+    
+    for (m = 0; m < m_count; m++) {
+        load = 0;
+        for (id = 0; id < ESP8266_MAX_LINKS; id++) {
+            if (m_used[m] & ((uint16_t)1 << id)) {
+                load++;
+            }
+        }
+        if (load < ESP8266_MAX_LINKS && load < best_load) {
+            best = m;
+            best_load = load;
+        }
+    }
+    if (best == ESP8266POOL_NONE) {
+        return ESP8266POOL_NONE;
+    }
+    for (id = 0; id < ESP8266_MAX_LINKS; id++) {
+        if (!(m_used[best] & ((uint16_t)1 << id))) {
+            return best * ESP8266_MAX_LINKS + id;
+        }
+    }
+    return ESP8266POOL_NONE;
+}
+
+bool ESP8266Pool::settle(uint8_t module)
+{
+    if (!m_pending[module]) {
+        return true;
+    }
+    m_pending[module] = false;
+    if (!m_wifi[module]->sendWait()) {
+        m_failed = true;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,167 @@
+/**
+ * @file ESP8266Pool.h
+ * @brief The definition of class ESP8266Pool. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ESP8266POOL_H__
+#define __ESP8266POOL_H__
+
+#include "Arduino.h"
+#include "ESP8266.h"
+
+
+#define ESP8266POOL_MAX_MODULES     (4)     /* Modules managed at most */
+#define ESP8266POOL_NONE            (0xFF)  /* Not a link */
+
+#if ESP8266POOL_MAX_MODULES * ESP8266_MAX_LINKS >= ESP8266POOL_NONE
+#error "Too many links in ESP8266Pool"
+#endif
+
+
+/**
+ * Aggregates several ESP8266 on separate uarts into one pool of links. 
+ *
+ * A link of the pool is identified by module * ESP8266_MAX_LINKS + mux_id. 
+ * New links are placed on the module with fewest links open. Outbound UDP 
+ * traffic registered by registerUDPSpread is spread across all modules in 
+ * turn; each module gets its data written and the next one is served while 
+ * it is still transmitting, so the throughput scales with module count. 
+ *
+ * @note Every module must be in multiple mode(enableMUX). 
+ */
+class ESP8266Pool {
+ public:
+    /**
+     * Constuctor. 
+     */
+    ESP8266Pool(void);
+    
+    /**
+     * Add a module to the pool. 
+     *
+     * @retval true - success.
+     * @retval false - the pool is full. 
+     */
+    bool add(ESP8266 &wifi);
+    
+    /**
+     * Get the number of modules in the pool. 
+     */
+    uint8_t modules(void);
+    
+    /**
+     * Create TCP connection on the least-loaded module. 
+     * 
+     * @param addr - the IP or domain name of the target host. 
+     * @param port - the port number of the target host. 
+     * @return the link or ESP8266POOL_NONE for failure. 
+     */
+    uint8_t createTCP(String addr, uint32_t port);
+    
+    /**
+     * Register UDP on the least-loaded module. 
+     * 
+     * @param addr - the IP or domain name of the target host. 
+     * @param port - the port number of the target host. 
+     * @return the link or ESP8266POOL_NONE for failure. 
+     */
+    uint8_t registerUDP(String addr, uint32_t port);
+    
+    /**
+     * Register UDP to the same target on every module for sendSpread. 
+     * 
+     * @param addr - the IP or domain name of the target host. 
+     * @param port - the port number of the target host. 
+     * @return the number of modules registered. 
+     */
+    uint8_t registerUDPSpread(String addr, uint32_t port);
+    
+    /**
+     * Release a link(TCP or UDP). 
+     * 
+     * @retval true - success.
+     * @retval false - failure.
+     */
+    bool release(uint8_t link);
+    
+    /**
+     * Unregister the UDP links of registerUDPSpread. 
+     */
+    void unregisterUDPSpread(void);
+    
+    /**
+     * Send data on a link. 
+     * 
+     * @retval true - success.
+     * @retval false - failure.
+     */
+    bool send(uint8_t link, const uint8_t *buffer, uint32_t len);
+    
+    /**
+     * Send a datagram on the next module of registerUDPSpread. 
+     *
+     * Returns when the data is written. Whether it was sent is known when 
+     * the module is next used, and reported by flush. 
+     * 
+     * @retval true - written. 
+     * @retval false - failure to start it. 
+     */
+    bool sendSpread(const uint8_t *buffer, uint32_t len);
+    
+    /**
+     * Wait for all sends started by sendSpread. 
+     * 
+     * @retval true - all succeeded since the last flush.
+     * @retval false - any failed.
+     */
+    bool flush(void);
+    
+    /**
+     * Receive data from any link of any module. 
+     * 
+     * @param link - the link data coming from. 
+     * @param buffer - the buffer for storing data. 
+     * @param buffer_size - the length of the buffer. 
+     * @param timeout - the time waiting data. 
+     * @return the length of data received actually. 
+     */
+    uint32_t recv(uint8_t *link, uint8_t *buffer, uint32_t buffer_size, uint32_t timeout = 1000);
+
+ private:
+    
+    /*
+     * Find a free mux_id on the least-loaded module. Returns the link or ESP8266POOL_NONE. 
+     */
+    uint8_t pick(void);
+    
+    /*
+     * Wait for the pending send of a module, if any. A failure is kept in 
+     * m_failed for flush. 
+     */
+    bool settle(uint8_t module);
+    
+    ESP8266 *m_wifi[ESP8266POOL_MAX_MODULES];
+    uint16_t m_used[ESP8266POOL_MAX_MODULES];       /* Bit mask of mux_id in use */
+    bool m_pending[ESP8266POOL_MAX_MODULES];        /* sendAsync waiting for sendWait */
+    uint8_t m_spread[ESP8266POOL_MAX_MODULES];      /* mux_id of spread UDP or ESP8266POOL_NONE */
+    uint8_t m_count;
+    uint8_t m_next;         /* Next module of sendSpread */
+    uint8_t m_poll;         /* Next module polled by recv */
+    bool m_failed;          /* A send of sendSpread failed since the last flush */
+};
+
+#endif /* #ifndef __ESP8266POOL_H__ */
@@ -0,0 +1,180 @@
+/**
+ * @file ESP8266Scheduler.cpp
+ * @brief The implementation of class ESP8266Scheduler. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266Scheduler.h"
+
+ESP8266Scheduler::ESP8266Scheduler(ESP8266 &wifi, uint8_t mux_id): m_wifi(&wifi), m_mux_id(mux_id),
+    m_type(ESP8266_LINK_TCP), m_port(0), m_interval(60000), m_sleep_mode(ESP8266_SLEEP_MODEM),
+    m_last(0), m_asleep(false), m_data_len(0), m_count(0)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void ESP8266Scheduler::setTarget(uint8_t type, String addr, uint32_t port)
+{
+    m_type = type;
+    m_addr = addr;
+    m_port = port;
+}
+
+void ESP8266Scheduler::setInterval(uint32_t interval, uint8_t sleep_mode)
+{
+    m_interval = interval;
+    m_sleep_mode = sleep_mode;
+}
+
+bool ESP8266Scheduler::queue(const uint8_t *data, uint16_t len)
+{
+    if (m_count >= ESP8266SCHEDULER_MAX_MESSAGES || m_data_len + len > sizeof(m_data)) {
+        return false;
+    }
+    memcpy(m_data + m_data_len, data, len);
+    m_data_len += len;
+    m_lens[m_count++] = len;
+    return true;
+}
+
+bool ESP8266Scheduler::run(void)
+{
+    bool full = m_count >= ESP8266SCHEDULER_MAX_MESSAGES 
+        || m_data_len >= sizeof(m_data);
+    
+    if (m_count == 0 || (!full && millis() - m_last < m_interval)) {
+        return true;
+    }
+    return flush();
+}
+
+bool ESP8266Scheduler::flush(void)
+{
+    unsigned long start = millis();
+    bool ret;
+    
+    if (m_count == 0) {
+        return true;
+    }
+    m_stats.windows++;
+    ret = wake() && deliver();
+    if (!ret) {
+        m_stats.failures++;
+    }
+    if (!m_asleep) {
+        sleep();
+    }
+    m_last = millis();
+    m_stats.radio_on_ms += m_last - start;
+    return ret;
+}
+
+const ESP8266SchedulerStats &ESP8266Scheduler::getStats(void)
+{
+    return m_stats;
+}
+
+uint32_t ESP8266Scheduler::getRadioOnPerByte(void)
+{
+    if (m_stats.bytes == 0) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)m_stats.radio_on_ms * 1000 / m_stats.bytes);
+}
+
+bool ESP8266Scheduler::wake(void)
+{
+    uint32_t elapsed;
+    uint32_t timeout = ESP8266SCHEDULER_BOOT_MS;
+    
+    if (!m_asleep) {
+        return true;
+    }
+    if (m_sleep_mode == ESP8266_SLEEP_DEEP) {
+        /* 
+         * The module wakes on its own when the sleep ends(interval after the 
+         * last window). Wait for the rest of the sleep if early(a full 
+         * queue), and for its boot. 
+         */
+        elapsed = millis() - m_last;
+        if (elapsed < m_interval) {
+            timeout += m_interval - elapsed;
+        }
+        if (!m_wifi->waitWake(timeout)) {
+            return false;
+        }
+        m_asleep = false;
+        return m_wifi->enableMUX();
+    }
+    if (!m_wifi->setSleepMode(ESP8266_SLEEP_NONE)) {
+        return false;
+    }
+    m_asleep = false;
+    return true;
+}
+
+void ESP8266Scheduler::sleep(void)
+{
+    if (m_sleep_mode == ESP8266_SLEEP_DEEP) {
+        m_asleep = m_wifi->deepSleep(m_interval);
+    } else if (m_sleep_mode != ESP8266_SLEEP_NONE) {
+        m_asleep = m_wifi->setSleepMode(m_sleep_mode);
+    }
+}
+
+bool ESP8266Scheduler::deliver(void)
+{
+    uint16_t offset = 0;
+    uint8_t i;
+    bool ret = true;
+    
+    if (m_type == ESP8266_LINK_UDP) {
+        if (!m_wifi->registerUDP(m_mux_id, m_addr, m_port)) {
+            return false;
+        }
+        for (i = 0; i < m_count && ret; i++) {
+            ret = m_wifi->send(m_mux_id, m_data + offset, m_lens[i]);
+            offset += m_lens[i];
+        }
+        m_wifi->unregisterUDP(m_mux_id);
+        if (!ret) {
+            /* Keep what was not sent */
+            i--;
+            offset -= m_lens[i];
+            memmove(m_data, m_data + offset, m_data_len - offset);
+            memmove(m_lens, m_lens + i, (m_count - i) * sizeof(m_lens[0]));
+            m_stats.messages += i;
+            m_stats.bytes += offset;
+            m_data_len -= offset;
+            m_count -= i;
+            return false;
+        }
+    } else {
+        if (!m_wifi->createTCP(m_mux_id, m_addr, m_port)) {
+            return false;
+        }
+        ret = m_wifi->send(m_mux_id, m_data, m_data_len);
+        m_wifi->releaseTCP(m_mux_id);
+        if (!ret) {
+            return false;
+        }
+    }
+    m_stats.messages += m_count;
+    m_stats.bytes += m_data_len;
+    m_data_len = 0;
+    m_count = 0;
+    return true;
+}
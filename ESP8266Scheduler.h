@@ -0,0 +1,149 @@
+/**
+ * @file ESP8266Scheduler.h
+ * @brief The definition of class ESP8266Scheduler. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ESP8266SCHEDULER_H__
+#define __ESP8266SCHEDULER_H__
+
+#include "Arduino.h"
+#include "ESP8266.h"
+
+
+#define ESP8266SCHEDULER_BUFFER_SIZE    (256)   /* Bytes of messages queued */
+#define ESP8266SCHEDULER_MAX_MESSAGES   (16)    /* Messages queued */
+#define ESP8266SCHEDULER_BOOT_MS        (10000) /* Waiting for "ready" and the AP after a deep sleep */
+
+
+/**
+ * Metrics of the duty-cycling scheduler. 
+ */
+struct ESP8266SchedulerStats {
+    uint32_t windows;       /**< Radio-on windows opened */
+    uint32_t failures;      /**< Windows which failed to deliver */
+    uint32_t messages;      /**< Messages delivered */
+    uint32_t bytes;         /**< Bytes delivered */
+    uint32_t radio_on_ms;   /**< Time ESP8266 was kept awake for windows */
+};
+
+
+/**
+ * Duty-cycling scheduler which keeps ESP8266 asleep between uploads. 
+ *
+ * Messages queued are kept in RAM and flushed together in one radio-on 
+ * window every interval(or earlier when the queue is full): wake up, open the 
+ * link, send, close the link and sleep again. Waking from deep sleep only 
+ * waits for the module to rejoin the AP saved, instead of restart and joinAP: 
+ * for the rest of the sleep if the window is early(a full queue), plus 
+ * ESP8266SCHEDULER_BOOT_MS. If it does not wake, the next window waits again. 
+ *
+ * @note enableMUX must be called before. With ESP8266_SLEEP_DEEP, GPIO16 of 
+ *  ESP8266 must be wired to RST. 
+ */
+class ESP8266Scheduler {
+ public:
+    /**
+     * Constuctor. 
+     *
+     * @param wifi - the ESP8266 to use. 
+     * @param mux_id - the identifier of link used for windows(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
+     */
+    ESP8266Scheduler(ESP8266 &wifi, uint8_t mux_id);
+    
+    /**
+     * Set the target of messages. 
+     *
+     * @param type - ESP8266_LINK_TCP(messages concatenated into one send) 
+     *  or ESP8266_LINK_UDP(one datagram per message). 
+     * @param addr - the IP or domain name of the target host. 
+     * @param port - the port number of the target host. 
+     */
+    void setTarget(uint8_t type, String addr, uint32_t port);
+    
+    /**
+     * Set the interval of windows and the sleep mode between. 
+     *
+     * @param interval - the interval of radio-on windows in milliseconds. 
+     * @param sleep_mode - ESP8266_SLEEP_MODEM, ESP8266_SLEEP_LIGHT or ESP8266_SLEEP_DEEP. 
+     */
+    void setInterval(uint32_t interval, uint8_t sleep_mode = ESP8266_SLEEP_MODEM);
+    
+    /**
+     * Queue a message for the next window. 
+     *
+     * @retval true - queued.
+     * @retval false - no room(a window is due, call run). 
+     */
+    bool queue(const uint8_t *data, uint16_t len);
+    
+    /**
+     * Open a window if due. Should be called in loop(). 
+     *
+     * @retval true - nothing due or delivered.
+     * @retval false - the window failed(messages kept for the next one). 
+     */
+    bool run(void);
+    
+    /**
+     * Open a window now. 
+     *
+     * @retval true - delivered.
+     * @retval false - failure(messages kept for the next window). 
+     */
+    bool flush(void);
+    
+    /**
+     * Get the metrics. 
+     */
+    const ESP8266SchedulerStats &getStats(void);
+    
+    /**
+     * Get the radio-on time per byte delivered. 
+     *
+     * @return microseconds of radio-on time per byte(0 if nothing delivered). 
+     */
+    uint32_t getRadioOnPerByte(void);
+
+ private:
+    
+    /*
+     * Wake ESP8266 up if asleep. It stays asleep(for the next window to 
+     * wake) on failure. 
+     */
+    bool wake(void);
+    void sleep(void);
+    bool deliver(void);
+    
+    ESP8266 *m_wifi;
+    uint8_t m_mux_id;
+    uint8_t m_type;
+    String m_addr;
+    uint32_t m_port;
+    uint32_t m_interval;
+    uint8_t m_sleep_mode;
+    unsigned long m_last;           /* End of the last window */
+    bool m_asleep;
+    
+    uint8_t m_data[ESP8266SCHEDULER_BUFFER_SIZE];
+    uint16_t m_data_len;
+    uint16_t m_lens[ESP8266SCHEDULER_MAX_MESSAGES];
+    uint8_t m_count;
+    
+    ESP8266SchedulerStats m_stats;
+};
+
+#endif /* #ifndef __ESP8266SCHEDULER_H__ */
@@ -0,0 +1,175 @@
+/**
+ * @file ESP8266SendScheduler.cpp
+ * @brief The implementation of class ESP8266SendScheduler. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266SendScheduler.h"
+
+ESP8266SendScheduler::ESP8266SendScheduler(ESP8266 &wifi): m_wifi(&wifi)
+{
+    uint8_t i;
+    for (i = 0; i < ESP8266_MAX_LINKS; i++) {
+        m_head[i] = 0;
+        m_count[i] = 0;
+        m_priority[i] = 0;
+        m_quantum[i] = ESP8266SENDSCHEDULER_QUANTUM;
+        m_deficit[i] = 0;
+    }
+    for (i = 0; i < ESP8266SENDSCHEDULER_PRIORITIES; i++) {
+        m_current[i] = 0;
+    }
+    memset(m_stats, 0, sizeof(m_stats));
+}
+
+bool ESP8266SendScheduler::setLink(uint8_t mux_id, uint8_t priority, uint16_t quantum)
+{
+    if (mux_id >= ESP8266_MAX_LINKS || priority >= ESP8266SENDSCHEDULER_PRIORITIES || quantum == 0) {
+        return false;
+    }
+    m_priority[mux_id] = priority;
+    m_quantum[mux_id] = quantum;
+    return true;
+}
+
+bool ESP8266SendScheduler::queue(uint8_t mux_id, const uint8_t *data, uint32_t len)
+{
+    Message *msg;
+    if (mux_id >= ESP8266_MAX_LINKS || m_count[mux_id] >= ESP8266SENDSCHEDULER_DEPTH 
+        || data == NULL || len == 0) {
+        return false;
+    }
+    msg = &m_queue[mux_id][(m_head[mux_id] + m_count[mux_id]) % ESP8266SENDSCHEDULER_DEPTH];
+    msg->data = data;
+    msg->len = len;
+    msg->sent = 0;
+    msg->failures = 0;
+    msg->started = false;
+    msg->queued = millis();
+    m_count[mux_id]++;
+    return true;
+}
+
+uint8_t ESP8266SendScheduler::pick(void)
+{
+    uint8_t priority;
+    uint8_t i;
+    uint8_t id;
+    
+    for (priority = 0; priority < ESP8266SENDSCHEDULER_PRIORITIES; priority++) {
+        for (i = 0; i < ESP8266_MAX_LINKS; i++) {
+            id = (m_current[priority] + i) % ESP8266_MAX_LINKS;
+            if (m_priority[id] != priority || m_count[id] == 0) {
+                continue;
+            }
+            if (id != m_current[priority] || m_deficit[id] == 0) {
+                /* A new turn of this link */
+                m_current[priority] = id;
+                m_deficit[id] += m_quantum[id];
+            }
+            return id;
+        }
+    }
+    return 0xFF;
+}
+
+bool ESP8266SendScheduler::run(void)
+{
+    Message *msg;
+    uint8_t id = pick();
+    uint32_t n;
+    uint32_t delay_ms;
+    
+    if (id == 0xFF) {
+        return true;
+    }
+    msg = &m_queue[id][m_head[id]];
+    n = msg->len - msg->sent;
+    n = n < m_deficit[id] ? n : m_deficit[id];
+    n = n < ESP8266_SEND_MAX ? n : ESP8266_SEND_MAX;
+    
+    if (!msg->started) {
+        /* Counted once even if retried */
+        msg->started = true;
+        delay_ms = millis() - msg->queued;
+        m_stats[id].total_delay_ms += delay_ms;
+        if (delay_ms > m_stats[id].max_delay_ms) {
+            m_stats[id].max_delay_ms = delay_ms;
+        }
+    }
+    if (!m_wifi->send(id, msg->data + msg->sent, n)) {
+        m_stats[id].failures++;
+        if (++msg->failures >= ESP8266SENDSCHEDULER_RETRIES) {
+            m_stats[id].dropped++;
+            m_head[id] = (m_head[id] + 1) % ESP8266SENDSCHEDULER_DEPTH;
+            m_count[id]--;
+        }
+        turn_over(id);
+        return false;
+    }
+    msg->sent += n;
+    m_deficit[id] -= n;
+    m_stats[id].bytes += n;
+    if (msg->sent == msg->len) {
+        m_stats[id].messages++;
+        m_head[id] = (m_head[id] + 1) % ESP8266SENDSCHEDULER_DEPTH;
+        m_count[id]--;
+    }
+    if (m_deficit[id] == 0 || m_count[id] == 0) {
+        turn_over(id);
+    }
+    return true;
+}
+
+void ESP8266SendScheduler::turn_over(uint8_t mux_id)
+{
+    m_deficit[mux_id] = 0;
+    m_current[m_priority[mux_id]] = (mux_id + 1) % ESP8266_MAX_LINKS;
+}
+
+bool ESP8266SendScheduler::flush(void)
+{
+    uint8_t i;
+    bool pending = true;
+    while (pending) {
+        if (!run()) {
+            return false;
+        }
+        pending = false;
+        for (i = 0; i < ESP8266_MAX_LINKS; i++) {
+            pending = pending || m_count[i] > 0;
+        }
+    }
+    return true;
+}
+
+void ESP8266SendScheduler::clear(uint8_t mux_id)
+{
+    if (mux_id < ESP8266_MAX_LINKS) {
+        m_count[mux_id] = 0;
+        m_deficit[mux_id] = 0;
+    }
+}
+
+uint8_t ESP8266SendScheduler::getQueued(uint8_t mux_id)
+{
+    return mux_id < ESP8266_MAX_LINKS ? m_count[mux_id] : 0;
+}
+
+const ESP8266SendStats &ESP8266SendScheduler::getStats(uint8_t mux_id)
+{
+    return m_stats[mux_id < ESP8266_MAX_LINKS ? mux_id : 0];
+}
@@ -0,0 +1,169 @@
+/**
+ * @file ESP8266SendScheduler.h
+ * @brief The definition of class ESP8266SendScheduler. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ESP8266SENDSCHEDULER_H__
+#define __ESP8266SENDSCHEDULER_H__
+
+#include "Arduino.h"
+#include "ESP8266.h"
+
+
+#define ESP8266SENDSCHEDULER_DEPTH      (4)     /* Messages queued per link */
+#define ESP8266SENDSCHEDULER_PRIORITIES (4)     /* Priorities: 0(highest) ~ 3 */
+#define ESP8266SENDSCHEDULER_QUANTUM    (256)   /* Default bytes per link per round */
+#define ESP8266SENDSCHEDULER_RETRIES    (3)     /* Failures of a message before it is dropped */
+
+
+/**
+ * Metrics of a link of the send scheduler. 
+ *
+ * The queueing delay is the time from queue to the first byte sent. 
+ */
+struct ESP8266SendStats {
+    uint32_t messages;          /**< Messages sent completely */
+    uint32_t bytes;             /**< Bytes sent */
+    uint32_t failures;          /**< Chunks failed(retried in the next turn of the link) */
+    uint32_t dropped;           /**< Messages dropped after ESP8266SENDSCHEDULER_RETRIES failures */
+    uint32_t max_delay_ms;      /**< Longest queueing delay */
+    uint32_t total_delay_ms;    /**< Sum of queueing delays(divide by messages for the mean) */
+};
+
+
+/**
+ * Outbound scheduler sharing the uart fairly between links in multiple mode. 
+ *
+ * Each link has its own queue and priority. Every run sends one chunk: from 
+ * the highest priority having data, and between links of the same priority 
+ * by deficit round robin, each link sending up to its quantum per round. A 
+ * large transfer is thus cut into chunks, and a message of higher priority 
+ * waits for one chunk at most. 
+ *
+ * @note Messages are not copied: the data must be kept until sent(see getQueued). 
+ *  enableMUX must be called before. 
+ */
+class ESP8266SendScheduler {
+ public:
+    /**
+     * Constuctor. 
+     *
+     * @param wifi - the ESP8266 to use. 
+     */
+    ESP8266SendScheduler(ESP8266 &wifi);
+    
+    /**
+     * Set the priority and the quantum of a link. 
+     *
+     * @param mux_id - the identifier of link(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
+     * @param priority - 0(highest) ~ ESP8266SENDSCHEDULER_PRIORITIES - 1(default: 0). 
+     * @param quantum - the bytes sent per round(default: ESP8266SENDSCHEDULER_QUANTUM), 
+     *  also the largest chunk of this link. 
+     * @retval true - success.
+     * @retval false - invalid parameter. 
+     */
+    bool setLink(uint8_t mux_id, uint8_t priority, uint16_t quantum = ESP8266SENDSCHEDULER_QUANTUM);
+    
+    /**
+     * Queue a message on a link. 
+     *
+     * @param mux_id - the identifier of link(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
+     * @param data - the data, kept by caller until sent. 
+     * @param len - the length of data. 
+     * @retval true - queued.
+     * @retval false - the queue of the link is full. 
+     */
+    bool queue(uint8_t mux_id, const uint8_t *data, uint32_t len);
+    
+    /**
+     * Send one chunk if any queued. Should be called in loop(). 
+     *
+     * A failure ends the turn of the link, so a link whose peer is gone 
+     * does not hold the others back, and the chunk is retried in its next 
+     * turn. A message failing ESP8266SENDSCHEDULER_RETRIES times is dropped 
+     * (the part sent already stays sent). 
+     *
+     * @retval true - a chunk sent or nothing queued.
+     * @retval false - the chunk failed. 
+     */
+    bool run(void);
+    
+    /**
+     * Send until all queues are empty or a chunk fails. 
+     *
+     * @retval true - all sent.
+     * @retval false - a chunk failed. 
+     */
+    bool flush(void);
+    
+    /**
+     * Drop the messages queued on a link(e.g. after it is closed). 
+     *
+     * @param mux_id - the identifier of link. 
+     */
+    void clear(uint8_t mux_id);
+    
+    /**
+     * Get the number of messages queued(not sent completely) on a link. 
+     *
+     * @param mux_id - the identifier of link. 
+     */
+    uint8_t getQueued(uint8_t mux_id);
+    
+    /**
+     * Get the metrics of a link. 
+     *
+     * @param mux_id - the identifier of link. 
+     */
+    const ESP8266SendStats &getStats(uint8_t mux_id);
+
+ private:
+    
+    /*
+     * A message queued. 
+     */
+    struct Message {
+        const uint8_t *data;
+        uint32_t len;
+        uint32_t sent;
+        uint8_t failures;
+        bool started;           /* Queueing delay counted */
+        unsigned long queued;
+    };
+    
+    /*
+     * Pick the link sending next, 0xFF if nothing queued. 
+     */
+    uint8_t pick(void);
+    
+    /*
+     * End the turn of a link, the next link of the same priority goes first. 
+     */
+    void turn_over(uint8_t mux_id);
+    
+    ESP8266 *m_wifi;
+    Message m_queue[ESP8266_MAX_LINKS][ESP8266SENDSCHEDULER_DEPTH];
+    uint8_t m_head[ESP8266_MAX_LINKS];
+    uint8_t m_count[ESP8266_MAX_LINKS];
+    uint8_t m_priority[ESP8266_MAX_LINKS];
+    uint16_t m_quantum[ESP8266_MAX_LINKS];
+    uint32_t m_deficit[ESP8266_MAX_LINKS];
+    uint8_t m_current[ESP8266SENDSCHEDULER_PRIORITIES]; /* The link served in each priority */
+    ESP8266SendStats m_stats[ESP8266_MAX_LINKS];
+};
+
+#endif /* #ifndef __ESP8266SENDSCHEDULER_H__ */
@@ -0,0 +1,307 @@
+/**
+ * @file ESP8266Trace.cpp
+ * @brief The implementation of classes ESP8266TraceRecorder and ESP8266TraceReplay. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266Trace.h"
+
+ESP8266TraceRecorder::ESP8266TraceRecorder(Print &sink): m_sink(&sink), m_io(NULL),
+    m_dir(ESP8266TRACE_RX), m_run_len(0), m_run_time(0), m_last_time(0), m_byte_time(0),
+    m_arrival_len(0), m_seen(0)
+{
+}
+
+void ESP8266TraceRecorder::attach(Stream &io)
+{
+    m_io = &io;
+    m_last_time = micros();
+    m_byte_time = m_last_time;
+    m_arrival_len = 0;
+    m_seen = 0;
+}
+
+void ESP8266TraceRecorder::end(void)
+{
+    uint32_t delta;
+    
+    if (m_run_len == 0) {
+        return;
+    }
+    delta = m_run_time - m_last_time;
+    m_last_time = m_run_time;
+    m_sink->write((uint8_t)(m_dir | (m_run_len - 1)));
+    while (delta >= 0x80) {
+        m_sink->write((uint8_t)((delta & 0x7F) | 0x80));
+        delta >>= 7;
+    }
+    m_sink->write((uint8_t)delta);
+    m_sink->write(m_run, m_run_len);
+    m_run_len = 0;
+}
+
+int ESP8266TraceRecorder::available(void)
+{
+    int n = m_io->available();
+    arrive(n);
+    return n;
+}
+
+int ESP8266TraceRecorder::read(void)
+{
+    int c;
+    if (m_seen <= 0) {
+        arrive(m_io->available());
+    }
+    c = m_io->read();
+    if (c >= 0) {
+        record(ESP8266TRACE_RX, c, depart());
+    }
+    return c;
+}
+
+int ESP8266TraceRecorder::peek(void)
+{
+    arrive(m_io->available());
+    return m_io->peek();
+}
+
+size_t ESP8266TraceRecorder::write(uint8_t c)
+{
+    record(ESP8266TRACE_TX, c, micros());
+    return m_io->write(c);
+}
+
+size_t ESP8266TraceRecorder::write(const uint8_t *buffer, size_t size)
+{
+    unsigned long now = micros();
+    size_t i;
+    for (i = 0; i < size; i++) {
+        record(ESP8266TRACE_TX, buffer[i], now);
+    }
+    return m_io->write(buffer, size);
+}
+
+void ESP8266TraceRecorder::flush(void)
+{
+    m_io->flush();
+}
+
+void ESP8266TraceRecorder::arrive(int available)
+{
+    if (available <= m_seen) {
+        return;
+    }
+    if (m_arrival_len < ESP8266TRACE_ARRIVALS) {
+        m_arrivals[m_arrival_len].count = 0;
+        m_arrivals[m_arrival_len].time = micros();
+        m_arrival_len++;
+    }
+    /* All full: the latest arrival takes them, a little early */
+    m_arrivals[m_arrival_len - 1].count += available - m_seen;
+    m_seen = available;
+}
+
+unsigned long ESP8266TraceRecorder::depart(void)
+{
+    unsigned long time;
+    
+    if (m_arrival_len == 0) {
+        return micros();
+    }
+    time = m_arrivals[0].time;
+    m_seen--;
+    if (--m_arrivals[0].count == 0) {
+        m_arrival_len--;
+        memmove(m_arrivals, m_arrivals + 1, m_arrival_len * sizeof(m_arrivals[0]));
+    }
+    return time;
+}
+
+void ESP8266TraceRecorder::record(uint8_t dir, uint8_t c, unsigned long now)
+{
+    /* Records keep their order: a byte read after a write is not before it */
+    if ((long)(now - m_byte_time) < 0) {
+        now = m_byte_time;
+    }
+    if (m_run_len > 0 && (dir != m_dir || m_run_len == sizeof(m_run) 
+        || now - m_byte_time > ESP8266TRACE_GAP_US)) {
+        end();
+    }
+    if (m_run_len == 0) {
+        m_dir = dir;
+        m_run_time = now;
+    }
+    m_run[m_run_len++] = c;
+    m_byte_time = now;
+}
+
+/*----------------------------------------------------------------------------*/
+
+ESP8266TraceReplay::ESP8266TraceReplay(Stream &trace, uint16_t speed): m_trace(&trace), m_speed(speed),
+    m_loaded(false), m_eof(false), m_dir(ESP8266TRACE_RX), m_run_len(0), m_run_pos(0), m_time(0),
+    m_anchor_trace(0), m_anchor_real(0), m_last_poll(0), m_last_idle(false)
+{
+    resetStats();
+    m_anchor_real = micros();
+}
+
+bool ESP8266TraceReplay::done(void)
+{
+    return !load();
+}
+
+const ESP8266ReplayStats &ESP8266TraceReplay::getStats(void)
+{
+    return m_stats;
+}
+
+void ESP8266TraceReplay::resetStats(void)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_last_idle = false;
+}
+
+int ESP8266TraceReplay::available(void)
+{
+    int n = 0;
+    if (load() && m_dir == ESP8266TRACE_RX && due()) {
+        n = m_run_len - m_run_pos;
+    }
+    poll(n == 0);
+    return n;
+}
+
+int ESP8266TraceReplay::read(void)
+{
+    uint8_t c;
+    if (available() <= 0) {
+        return -1;
+    }
+    c = m_run[m_run_pos++];
+    m_stats.rx_bytes++;
+    if (m_run_pos == m_run_len) {
+        m_loaded = false;
+    }
+    return c;
+}
+
+int ESP8266TraceReplay::peek(void)
+{
+    if (available() <= 0) {
+        return -1;
+    }
+    return m_run[m_run_pos];
+}
+
+size_t ESP8266TraceReplay::write(uint8_t c)
+{
+    m_stats.tx_bytes++;
+    /* Bytes due from ESP8266 before this write were never read, skip them */
+    while (load() && m_dir == ESP8266TRACE_RX && due()) {
+        m_loaded = false;
+    }
+    if (!load() || m_dir != ESP8266TRACE_TX) {
+        m_stats.tx_mismatch++;
+        return 1;
+    }
+    if (m_run[m_run_pos++] != c) {
+        m_stats.tx_mismatch++;
+    }
+    if (m_run_pos == m_run_len) {
+        /* ESP8266 answers relative to the end of the command */
+        m_anchor_trace = m_time;
+        m_anchor_real = micros();
+        m_loaded = false;
+    }
+    return 1;
+}
+
+void ESP8266TraceReplay::flush(void)
+{
+}
+
+bool ESP8266TraceReplay::load(void)
+{
+    int c;
+    uint8_t header;
+    uint32_t delta = 0;
+    uint8_t shift = 0;
+    uint8_t i;
+    
+    if (m_loaded) {
+        return true;
+    }
+    if (m_eof) {
+        return false;
+    }
+    m_trace->setTimeout(0);
+    c = m_trace->read();
+    if (c < 0) {
+        m_eof = true;
+        return false;
+    }
+    header = c;
+    do {
+        c = m_trace->read();
+        if (c < 0) {
+            m_eof = true;
+            return false;
+        }
+        delta |= (uint32_t)(c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    m_dir = header & 0x80;
+    m_run_len = (header & 0x7F) + 1;
+    for (i = 0; i < m_run_len; i++) {
+        c = m_trace->read();
+        if (c < 0) {
+            m_eof = true;
+            return false;
+        }
+        m_run[i] = c;
+    }
+    m_run_pos = 0;
+    m_time += delta;
+    m_loaded = true;
+    return true;
+}
+
+bool ESP8266TraceReplay::due(void)
+{
+    uint32_t wait;
+    if (m_speed == 0) {
+        return true;
+    }
+    wait = (m_time - m_anchor_trace) / m_speed;
+    if (micros() - m_anchor_real < wait) {
+        return false;
+    }
+    /* Keep the pace of the trace from here, without drifting */
+    m_anchor_real += wait;
+    m_anchor_trace = m_time;
+    return true;
+}
+
+void ESP8266TraceReplay::poll(bool idle)
+{
+    unsigned long now = micros();
+    if (idle && m_last_idle) {
+        m_stats.idle_us += now - m_last_poll;
+    }
+    m_last_poll = now;
+    m_last_idle = idle;
+}
@@ -0,0 +1,205 @@
+/**
+ * @file ESP8266Trace.h
+ * @brief The definition of classes ESP8266TraceRecorder and ESP8266TraceReplay. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ESP8266TRACE_H__
+#define __ESP8266TRACE_H__
+
+#include "Arduino.h"
+
+
+#define ESP8266TRACE_RUN_SIZE   (32)    /* Bytes of one record at most */
+#define ESP8266TRACE_ARRIVALS   (8)     /* Arrivals of bytes not read yet, timed apart */
+
+#define ESP8266TRACE_RX         (0x00)  /* ESP8266 to mainboard */
+#define ESP8266TRACE_TX         (0x80)  /* Mainboard to ESP8266 */
+
+
+/*
+ * Trace format: a sequence of records, each being
+ *
+ *   header  - 1 byte: bit 7 is the direction(ESP8266TRACE_RX/TX), 
+ *             bits 0-6 are the number of data bytes minus 1. 
+ *   delta   - microseconds since the previous record, unsigned LEB128. 
+ *   data    - the bytes. 
+ *
+ * Consecutive bytes in one direction within ESP8266TRACE_GAP_US are 
+ * merged into one record. 
+ */
+#define ESP8266TRACE_GAP_US     (500)
+
+
+/**
+ * Records every byte crossing the uart of ESP8266 with timestamps. 
+ *
+ * Bytes from ESP8266 are stamped when available() first reports them, the 
+ * nearest to their arrival the library can see, and recorded when read, so 
+ * the time the library takes to read them does not count as the module's. 
+ * Bytes written are recorded when written. The trace is written to any 
+ * Print(an SD card file, a spare serial port, a RAM buffer). 
+ *
+ * @see ESP8266::setTrace
+ */
+class ESP8266TraceRecorder : public Stream {
+ public:
+    /**
+     * Constuctor. 
+     *
+     * @param sink - where the trace is written. 
+     */
+    ESP8266TraceRecorder(Print &sink);
+    
+    /*
+     * Called by ESP8266::setTrace with the stream to record. 
+     */
+    void attach(Stream &io);
+    
+    /**
+     * Write the pending record to sink. 
+     */
+    void end(void);
+    
+    virtual int available(void);
+    virtual int read(void);
+    virtual int peek(void);
+    virtual size_t write(uint8_t c);
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    virtual void flush(void);
+    
+    using Print::write;
+
+ private:
+    
+    void record(uint8_t dir, uint8_t c, unsigned long now);
+    
+    /*
+     * Stamp the bytes available beyond those seen before with the time now. 
+     */
+    void arrive(int available);
+    
+    /*
+     * Take the arrival time of the byte read next(now if not seen). 
+     */
+    unsigned long depart(void);
+    
+    struct Arrival {
+        uint16_t count;
+        unsigned long time;
+    };
+    
+    Print *m_sink;
+    Stream *m_io;
+    uint8_t m_dir;
+    uint8_t m_run[ESP8266TRACE_RUN_SIZE];
+    uint8_t m_run_len;
+    unsigned long m_run_time;       /* micros() of the first byte of run */
+    unsigned long m_last_time;      /* micros() of the previous record */
+    unsigned long m_byte_time;      /* micros() of the last byte */
+    Arrival m_arrivals[ESP8266TRACE_ARRIVALS];
+    uint8_t m_arrival_len;
+    int m_seen;                     /* Bytes stamped and not read yet */
+};
+
+
+/**
+ * Statistics of a replay. 
+ */
+struct ESP8266ReplayStats {
+    uint32_t rx_bytes;      /**< Bytes delivered to the library */
+    uint32_t tx_bytes;      /**< Bytes written by the library */
+    uint32_t tx_mismatch;   /**< Bytes written which differ from the trace */
+    uint32_t idle_us;       /**< Time the library polled without data(waiting) */
+};
+
+
+/**
+ * Feeds a trace back into the library in place of ESP8266. 
+ *
+ * Construct ESP8266 on the replay(ESP8266(Stream &)) and call the same 
+ * methods as in the trace. Bytes from ESP8266 are released with the recorded 
+ * timing, relative to the moment the library wrote the preceding command, 
+ * scaled by speed. Around each call, the latency is the wall time and the 
+ * CPU time is the wall time minus the idle time reported by getStats. 
+ */
+class ESP8266TraceReplay : public Stream {
+ public:
+    /**
+     * Constuctor. 
+     *
+     * @param trace - the trace recorded by ESP8266TraceRecorder. 
+     * @param speed - 1 for the original pace, N for N times faster, 0 for no delay. 
+     */
+    ESP8266TraceReplay(Stream &trace, uint16_t speed = 1);
+    
+    /**
+     * Whether the whole trace has been replayed. 
+     */
+    bool done(void);
+    
+    /**
+     * Get the statistics. 
+     */
+    const ESP8266ReplayStats &getStats(void);
+    
+    /**
+     * Reset the statistics(e.g. before each call measured). 
+     */
+    void resetStats(void);
+    
+    virtual int available(void);
+    virtual int read(void);
+    virtual int peek(void);
+    virtual size_t write(uint8_t c);
+    virtual void flush(void);
+    
+    using Print::write;
+
+ private:
+    
+    /*
+     * Load the next record header and its bytes. 
+     */
+    bool load(void);
+    
+    /*
+     * Whether the current RX record is due. 
+     */
+    bool due(void);
+    
+    /*
+     * Account the idle time between polls. 
+     */
+    void poll(bool idle);
+    
+    Stream *m_trace;
+    uint16_t m_speed;
+    bool m_loaded;
+    bool m_eof;
+    uint8_t m_dir;
+    uint8_t m_run[128];
+    uint8_t m_run_len;
+    uint8_t m_run_pos;
+    uint32_t m_time;            /* Trace time of the current record(us) */
+    uint32_t m_anchor_trace;    /* Trace time matched to m_anchor_real */
+    unsigned long m_anchor_real;
+    unsigned long m_last_poll;
+    bool m_last_idle;
+    ESP8266ReplayStats m_stats;
+};
+
+#endif /* #ifndef __ESP8266TRACE_H__ */
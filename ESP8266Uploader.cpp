@@ -0,0 +1,317 @@
+/**
+ * @file ESP8266Uploader.cpp
+ * @brief The implementation of class ESP8266Uploader. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266Uploader.h"
+
+#define EE_MAGIC            (0xE8)
+#define EE_HEADER_SIZE      (10)    /* Magic, record size, head(2), count(2), sequence number(4) */
+
+ESP8266Uploader::ESP8266Uploader(ESP8266 &wifi, uint8_t mux_id, uint8_t record_size): m_wifi(&wifi), 
+    m_mux_id(mux_id), m_record_size(record_size), m_type(ESP8266_LINK_TCP), m_port(0), 
+    m_interval(60000), m_ack(false), m_oldest_time(0), m_failed_time(0), m_failed(false), m_seq(0), 
+    m_ram_head(0), m_ram_count(0), m_ee_base(0), m_ee_slots(0), m_ee_head(0), m_ee_count(0), 
+    m_batch(this)
+{
+    if (m_record_size == 0 || m_record_size > ESP8266UPLOADER_RAM_SIZE) {
+        m_record_size = ESP8266UPLOADER_RAM_SIZE;
+    }
+    m_ram_slots = ESP8266UPLOADER_RAM_SIZE / m_record_size;
+    m_threshold = m_ram_slots;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void ESP8266Uploader::setTarget(uint8_t type, String addr, uint32_t port)
+{
+    m_type = type;
+    m_addr = addr;
+    m_port = port;
+}
+
+void ESP8266Uploader::setThreshold(uint16_t records, uint32_t interval)
+{
+    m_threshold = records;
+    m_interval = interval;
+}
+
+void ESP8266Uploader::setEEPROM(uint16_t base, uint16_t size)
+{
+    uint16_t head;
+    uint16_t count;
+    uint8_t i;
+    
+    m_ee_base = base;
+    m_ee_slots = size > EE_HEADER_SIZE ? (size - EE_HEADER_SIZE) / m_record_size : 0;
+    m_ee_head = 0;
+    m_ee_count = 0;
+    if (m_ee_slots == 0) {
+        return;
+    }
+    
+    /* Restore what was left before reset */
+    head = ((uint16_t)EEPROM.read(base + 2) << 8) | EEPROM.read(base + 3);
+    count = ((uint16_t)EEPROM.read(base + 4) << 8) | EEPROM.read(base + 5);
+    if (EEPROM.read(base) == EE_MAGIC && EEPROM.read(base + 1) == m_record_size 
+        && head < m_ee_slots && count <= m_ee_slots) {
+        m_ee_head = head;
+        m_ee_count = count;
+        m_seq = 0;
+        for (i = 0; i < 4; i++) {
+            m_seq = (m_seq << 8) | EEPROM.read(base + 6 + i);
+        }
+        if (m_ee_count > 0) {
+            m_oldest_time = millis();
+        }
+    }
+    save();
+}
+
+void ESP8266Uploader::setAck(bool enabled)
+{
+    m_ack = enabled;
+}
+
+void ESP8266Uploader::append(const uint8_t *record)
+{
+    if (m_ram_count == m_ram_slots) {
+        if (m_ee_slots > 0) {
+            spill();
+        } else {
+            m_ram_head = (m_ram_head + 1) % m_ram_slots;
+            m_ram_count--;
+            m_seq++;
+            m_stats.dropped++;
+        }
+    }
+    if (getCount() == 0) {
+        m_oldest_time = millis();
+    }
+    memcpy(m_ram + ((m_ram_head + m_ram_count) % m_ram_slots) * m_record_size, record, m_record_size);
+    m_ram_count++;
+    m_stats.appended++;
+}
+
+bool ESP8266Uploader::run(void)
+{
+    uint16_t count = getCount();
+    
+    if (count == 0) {
+        return true;
+    }
+    if (m_failed && millis() - m_failed_time < (m_interval ? m_interval : ESP8266UPLOADER_RETRY_MS)) {
+        return false;
+    }
+    if (count < m_threshold && count < m_ram_slots + m_ee_slots 
+        && (m_interval == 0 || millis() - m_oldest_time < m_interval)) {
+        return true;
+    }
+    return flush();
+}
+
+bool ESP8266Uploader::flush(void)
+{
+    uint16_t batch = (ESP8266_SEND_MAX - ESP8266UPLOADER_HEADER_SIZE) / m_record_size;
+    bool ret;
+    
+    if (getCount() == 0) {
+        return true;
+    }
+    m_stats.connects++;
+    if (m_type == ESP8266_LINK_UDP) {
+        ret = m_wifi->registerUDP(m_mux_id, m_addr, m_port);
+    } else {
+        ret = m_wifi->createTCP(m_mux_id, m_addr, m_port);
+    }
+    if (ret) {
+        while (ret && getCount() > 0) {
+            ret = deliver(getCount() < batch ? getCount() : batch);
+        }
+        if (m_type == ESP8266_LINK_UDP) {
+            m_wifi->unregisterUDP(m_mux_id);
+        } else {
+            m_wifi->releaseTCP(m_mux_id);
+        }
+    }
+    m_failed = !ret;
+    if (!ret) {
+        m_stats.failures++;
+        m_failed_time = millis();
+    }
+    return ret;
+}
+
+uint16_t ESP8266Uploader::getCount(void)
+{
+    return m_ee_count + m_ram_count;
+}
+
+const ESP8266UploaderStats &ESP8266Uploader::getStats(void)
+{
+    return m_stats;
+}
+
+uint8_t ESP8266Uploader::record_byte(uint16_t index, uint8_t offset)
+{
+    if (index < m_ee_count) {
+        return EEPROM.read(m_ee_base + EE_HEADER_SIZE 
+            + ((m_ee_head + index) % m_ee_slots) * m_record_size + offset);
+    }
+    index -= m_ee_count;
+    return m_ram[((m_ram_head + index) % m_ram_slots) * m_record_size + offset];
+}
+
+void ESP8266Uploader::remove(uint16_t count)
+{
+    uint16_t n;
+    
+    n = count < m_ee_count ? count : m_ee_count;
+    if (n > 0) {
+        m_ee_head = (m_ee_head + n) % m_ee_slots;
+        m_ee_count -= n;
+        m_seq += n;
+        count -= n;
+    }
+    n = count < m_ram_count ? count : m_ram_count;
+    m_ram_head = (m_ram_head + n) % m_ram_slots;
+    m_ram_count -= n;
+    m_seq += n;
+    save();
+}
+
+void ESP8266Uploader::spill(void)
+{
+    uint16_t addr;
+    uint8_t i;
+    
+    if (m_ee_count == m_ee_slots) {
+        m_ee_head = (m_ee_head + 1) % m_ee_slots;
+        m_ee_count--;
+        m_seq++;
+        m_stats.dropped++;
+    }
+    addr = m_ee_base + EE_HEADER_SIZE + ((m_ee_head + m_ee_count) % m_ee_slots) * m_record_size;
+    for (i = 0; i < m_record_size; i++) {
+        EEPROM.update(addr + i, m_ram[m_ram_head * m_record_size + i]);
+    }
+    m_ee_count++;
+    m_ram_head = (m_ram_head + 1) % m_ram_slots;
+    m_ram_count--;
+    save();
+}
+
+bool ESP8266Uploader::deliver(uint16_t count)
+{
+    uint32_t len = ESP8266UPLOADER_HEADER_SIZE + (uint32_t)count * m_record_size;
+    uint8_t reply[4];
+    uint8_t got = 0;
+    uint32_t acked = count;
+    unsigned long start;
+    
+    m_batch.begin(count);
+    m_stats.sends++;
+    if (!m_wifi->send(m_mux_id, m_batch, len)) {
+        return false;
+    }
+    m_stats.bytes += len;
+    if (m_ack) {
+        start = millis();
+        while (got < sizeof(reply) && millis() - start < ESP8266UPLOADER_ACK_TIMEOUT) {
+            got += m_wifi->recv(m_mux_id, reply + got, sizeof(reply) - got, 100);
+        }
+        if (got < sizeof(reply)) {
+            return false;
+        }
+        acked = (((uint32_t)reply[0] << 24) | ((uint32_t)reply[1] << 16) 
+            | ((uint32_t)reply[2] << 8) | reply[3]) - m_seq;
+        if (acked > count) {
+            return false;
+        }
+    }
+    remove(acked);
+    m_stats.delivered += acked;
+    return acked == count;
+}
+
+void ESP8266Uploader::save(void)
+{
+    uint8_t i;
+    
+    if (m_ee_slots == 0) {
+        return;
+    }
+    /* 
+     * Records in RAM are lost by reset. They were never acknowledged, so 
+     * reusing their sequence numbers does not confuse the server. 
+     */
+    EEPROM.update(m_ee_base, EE_MAGIC);
+    EEPROM.update(m_ee_base + 1, m_record_size);
+    EEPROM.update(m_ee_base + 2, m_ee_head >> 8);
+    EEPROM.update(m_ee_base + 3, m_ee_head & 0xFF);
+    EEPROM.update(m_ee_base + 4, m_ee_count >> 8);
+    EEPROM.update(m_ee_base + 5, m_ee_count & 0xFF);
+    for (i = 0; i < 4; i++) {
+        EEPROM.update(m_ee_base + 6 + i, (m_seq >> (24 - 8 * i)) & 0xFF);
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
+ESP8266Uploader::Batch::Batch(ESP8266Uploader *owner): m_owner(owner), m_count(0), m_pos(0)
+{
+}
+
+void ESP8266Uploader::Batch::begin(uint16_t count)
+{
+    m_count = count;
+    m_pos = 0;
+}
+
+int ESP8266Uploader::Batch::available(void)
+{
+    return ESP8266UPLOADER_HEADER_SIZE + (uint32_t)m_count * m_owner->m_record_size - m_pos;
+}
+
+int ESP8266Uploader::Batch::read(void)
+{
+    int c = peek();
+    if (c >= 0) {
+        m_pos++;
+    }
+    return c;
+}
+
+int ESP8266Uploader::Batch::peek(void)
+{
+    uint32_t offset;
+    
+    if (available() <= 0) {
+        return -1;
+    }
+    if (m_pos < 4) {
+        return (m_owner->m_seq >> (24 - 8 * m_pos)) & 0xFF;
+    } else if (m_pos < ESP8266UPLOADER_HEADER_SIZE) {
+        return m_pos == 4 ? m_count >> 8 : m_count & 0xFF;
+    }
+    offset = m_pos - ESP8266UPLOADER_HEADER_SIZE;
+    return m_owner->record_byte(offset / m_owner->m_record_size, offset % m_owner->m_record_size);
+}
+
+size_t ESP8266Uploader::Batch::write(uint8_t)
+{
+    return 0;
+}
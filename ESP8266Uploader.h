@@ -0,0 +1,208 @@
+/**
+ * @file ESP8266Uploader.h
+ * @brief The definition of class ESP8266Uploader. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ESP8266UPLOADER_H__
+#define __ESP8266UPLOADER_H__
+
+#include "Arduino.h"
+#include "ESP8266.h"
+#include <EEPROM.h>
+
+
+#define ESP8266UPLOADER_RAM_SIZE        (128)   /* Bytes of records kept in RAM */
+#define ESP8266UPLOADER_HEADER_SIZE     (6)     /* Sequence number(4) and count(2) before each batch */
+#define ESP8266UPLOADER_ACK_TIMEOUT     (3000)  /* Waiting the acknowledgement of a batch */
+#define ESP8266UPLOADER_RETRY_MS        (10000) /* Least time between a failed flush and the next */
+
+
+/**
+ * Metrics of the uploader. 
+ */
+struct ESP8266UploaderStats {
+    uint32_t appended;      /**< Records appended */
+    uint32_t delivered;     /**< Records acknowledged */
+    uint32_t dropped;       /**< Oldest records overwritten for lack of room */
+    uint32_t sends;         /**< "AT+CIPSEND" of batches */
+    uint32_t connects;      /**< Links opened for flushes */
+    uint32_t failures;      /**< Flushes which did not deliver everything */
+    uint32_t bytes;         /**< Bytes of batches sent, headers included */
+};
+
+
+/**
+ * Store-and-forward uploader of fixed-size records. 
+ *
+ * Records are appended to a ring in RAM. When it is full the oldest move to 
+ * a ring in EEPROM(if given), which also survives resets. When enough 
+ * records are stored, or the oldest waited long enough, they are flushed on 
+ * one link as batches of as many records as one "AT+CIPSEND" takes. 
+ *
+ * Each batch starts with the sequence number of its first record(4 bytes) 
+ * and the number of records(2 bytes), big-endian. With acknowledgement 
+ * enabled the server replies the sequence number it expects next(4 bytes, 
+ * big-endian), and only the records before it are removed. Otherwise a 
+ * batch is done when "SEND OK". Either way a failed flush resumes from the 
+ * first record not acknowledged. A gap in sequence numbers tells the server 
+ * that records were dropped. 
+ *
+ * @note enableMUX must be called before. 
+ */
+class ESP8266Uploader {
+ public:
+    /**
+     * Constuctor. 
+     *
+     * @param wifi - the ESP8266 to use. 
+     * @param mux_id - the identifier of link used for flushes(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
+     * @param record_size - the size of every record(1 ~ ESP8266UPLOADER_RAM_SIZE). 
+     */
+    ESP8266Uploader(ESP8266 &wifi, uint8_t mux_id, uint8_t record_size);
+    
+    /**
+     * Set the target of records. 
+     *
+     * @param type - ESP8266_LINK_TCP or ESP8266_LINK_UDP. 
+     * @param addr - the IP or domain name of the target host. 
+     * @param port - the port number of the target host. 
+     */
+    void setTarget(uint8_t type, String addr, uint32_t port);
+    
+    /**
+     * Set when to flush. 
+     *
+     * @param records - flush when so many records are stored. 
+     * @param interval - flush when the oldest record waited so long(milliseconds, 0 for never). 
+     */
+    void setThreshold(uint16_t records, uint32_t interval);
+    
+    /**
+     * Use a region of EEPROM for records overflowing RAM. 
+     *
+     * Records left there before a reset are restored. 
+     *
+     * @param base - the first address of the region. 
+     * @param size - the size of the region(0 to stop using EEPROM). 
+     */
+    void setEEPROM(uint16_t base, uint16_t size);
+    
+    /**
+     * Enable or disable the acknowledgement of batches by the server. 
+     */
+    void setAck(bool enabled);
+    
+    /**
+     * Append a record. The oldest record is dropped when full. 
+     *
+     * @param record - record_size bytes. 
+     */
+    void append(const uint8_t *record);
+    
+    /**
+     * Flush if a threshold is reached or the storage is full. Should be called in loop(). 
+     *
+     * @retval true - nothing due or delivered.
+     * @retval false - the flush failed(records kept for the next). 
+     */
+    bool run(void);
+    
+    /**
+     * Flush now. 
+     *
+     * @retval true - all delivered.
+     * @retval false - failure(records not acknowledged kept). 
+     */
+    bool flush(void);
+    
+    /**
+     * Get the number of records stored. 
+     */
+    uint16_t getCount(void);
+    
+    /**
+     * Get the metrics. 
+     */
+    const ESP8266UploaderStats &getStats(void);
+
+ private:
+    
+    /*
+     * Stream reading one batch: the header, then records from EEPROM and RAM. 
+     */
+    class Batch : public Stream {
+     public:
+        Batch(ESP8266Uploader *owner);
+        void begin(uint16_t count);
+        int available(void);
+        int read(void);
+        int peek(void);
+        size_t write(uint8_t c);
+        
+     private:
+        ESP8266Uploader *m_owner;
+        uint16_t m_count;
+        uint32_t m_pos;
+    };
+    
+    /*
+     * The byte at offset of the record index(0 for the oldest). 
+     */
+    uint8_t record_byte(uint16_t index, uint8_t offset);
+    
+    /*
+     * Remove the count oldest records. 
+     */
+    void remove(uint16_t count);
+    
+    /*
+     * Move the oldest record in RAM to the end of EEPROM. 
+     */
+    void spill(void);
+    
+    bool deliver(uint16_t count);
+    void save(void);
+    
+    ESP8266 *m_wifi;
+    uint8_t m_mux_id;
+    uint8_t m_record_size;
+    uint8_t m_type;
+    String m_addr;
+    uint32_t m_port;
+    uint16_t m_threshold;
+    uint32_t m_interval;
+    bool m_ack;
+    unsigned long m_oldest_time;    /* When the oldest record was stored */
+    unsigned long m_failed_time;    /* When the last flush failed */
+    bool m_failed;
+    uint32_t m_seq;                 /* Sequence number of the oldest record */
+    
+    uint8_t m_ram[ESP8266UPLOADER_RAM_SIZE];
+    uint8_t m_ram_head;             /* Slot of the oldest record in RAM */
+    uint8_t m_ram_count;
+    uint8_t m_ram_slots;
+    
+    uint16_t m_ee_base;             /* Header, then slots */
+    uint16_t m_ee_slots;
+    uint16_t m_ee_head;
+    uint16_t m_ee_count;
+    
+    Batch m_batch;
+    ESP8266UploaderStats m_stats;
+};
+
+#endif /* #ifndef __ESP8266UPLOADER_H__ */
@@ -0,0 +1,498 @@
+/**
+ * @file ESP8266WebSocket.cpp
+ * @brief The implementation of class ESP8266WebSocket. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266WebSocket.h"
+
+#define WS_CONTINUATION     (0x0)
+#define WS_CLOSE            (0x8)
+#define WS_PING             (0x9)
+#define WS_PONG             (0xA)
+
+#define WS_FIN              (0x80)
+#define WS_MASK             (0x80)
+
+#define WS_GUID             "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+static uint32_t rol(uint32_t v, uint8_t n)
+{
+    return (v << n) | (v >> (32 - n));
+}
+
+static void sha1_block(uint32_t h[5], const uint8_t *p)
+{
+    uint32_t w[16];     /* Rolling schedule, 64 bytes instead of 320 */
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    uint32_t f, k, t;
+    uint8_t i;
+    
+    for (i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) 
+            | ((uint32_t)p[4 * i + 2] << 8) | p[4 * i + 3];
+    }
+    for (i = 0; i < 80; i++) {
+        if (i >= 16) {
+            w[i & 15] = rol(w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15], 1);
+        }
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        t = rol(a, 5) + f + e + k + w[i & 15];
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+static void sha1(const uint8_t *data, uint16_t len, uint8_t digest[20])
+{
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    uint8_t block[64];
+    uint16_t pos = 0;
+    uint8_t rest;
+    uint8_t i;
+    
+    for (; len - pos >= 64; pos += 64) {
+        sha1_block(h, data + pos);
+    }
+    rest = len - pos;
+    memset(block, 0, sizeof(block));
+    memcpy(block, data + pos, rest);
+    block[rest] = 0x80;
+    if (rest >= 56) {
+        sha1_block(h, block);
+        memset(block, 0, sizeof(block));
+    }
+    block[62] = ((uint32_t)len * 8) >> 8;
+    block[63] = ((uint32_t)len * 8) & 0xFF;
+    block[61] = ((uint32_t)len * 8) >> 16;
+    sha1_block(h, block);
+    for (i = 0; i < 20; i++) {
+        digest[i] = h[i / 4] >> (24 - 8 * (i % 4));
+    }
+}
+
+static void base64(const uint8_t *in, uint8_t len, char *out)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint32_t v;
+    uint8_t i;
+    
+    for (i = 0; i < len; i += 3) {
+        v = (uint32_t)in[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < len) v |= in[i + 2];
+        *out++ = table[(v >> 18) & 0x3F];
+        *out++ = table[(v >> 12) & 0x3F];
+        *out++ = i + 1 < len ? table[(v >> 6) & 0x3F] : '=';
+        *out++ = i + 2 < len ? table[v & 0x3F] : '=';
+    }
+    *out = '\0';
+}
+
+ESP8266WebSocket::ESP8266WebSocket(ESP8266 &wifi, uint8_t mux_id): m_wifi(&wifi), m_mux_id(mux_id),
+    m_connected(false), m_close_sent(false), m_ping_pending(false), m_close_code(0), 
+    m_ping_interval(ESP8266WS_PING_MS), m_last_in(0), m_callback(NULL), 
+    m_hdr_len(0), m_hdr_need(2), m_frame_len(0), m_frame_pos(0), m_msg_opcode(0), m_msg_len(0)
+{
+}
+
+bool ESP8266WebSocket::connect(String host, uint32_t port, const char *path, const char *protocol)
+{
+    uint8_t nonce[16];
+    char key[25];
+    char accept[29];
+    uint8_t digest[20];
+    String req;
+    uint16_t len = 0;
+    uint16_t n;
+    unsigned long start;
+    char *end = NULL;
+    char *line;
+    uint8_t i;
+    
+    m_connected = false;
+    m_close_sent = false;
+    m_ping_pending = false;
+    m_close_code = 0;
+    m_hdr_len = 0;
+    m_hdr_need = 2;
+    m_msg_opcode = 0;
+    m_msg_len = 0;
+    if (!m_wifi->createTCP(m_mux_id, host, port)) {
+        return false;
+    }
+    
+    for (i = 0; i < sizeof(nonce); i++) {
+        nonce[i] = random(0x100);
+    }
+    base64(nonce, sizeof(nonce), key);
+    req = "GET ";
+    req += path;
+    req += " HTTP/1.1\r\nHost: ";
+    req += host;
+    req += ":";
+    req += String(port);
+    req += "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: ";
+    req += key;
+    req += "\r\nSec-WebSocket-Version: 13\r\n";
+    if (protocol) {
+        req += "Sec-WebSocket-Protocol: ";
+        req += protocol;
+        req += "\r\n";
+    }
+    req += "\r\n";
+    if (!m_wifi->send(m_mux_id, (const uint8_t *)req.c_str(), req.length())) {
+        m_wifi->releaseTCP(m_mux_id);
+        return false;
+    }
+    
+    /* The expected Sec-WebSocket-Accept: base64(SHA-1(key + GUID)) */
+    req = key;
+    req += WS_GUID;
+    sha1((const uint8_t *)req.c_str(), req.length(), digest);
+    base64(digest, sizeof(digest), accept);
+    
+    /* The response headers, in m_msg which is free until connected */
+    start = millis();
+    while (millis() - start < ESP8266WS_TIMEOUT_MS && len < ESP8266WS_MESSAGE_SIZE) {
+        len += m_wifi->recv(m_mux_id, m_msg + len, ESP8266WS_MESSAGE_SIZE - len, 100);
+        m_msg[len] = '\0';
+        end = strstr((char *)m_msg, "\r\n\r\n");
+        if (end) {
+            break;
+        }
+    }
+    if (end == NULL || strncmp((char *)m_msg, "HTTP/1.1 101", 12) != 0) {
+        m_wifi->releaseTCP(m_mux_id);
+        return false;
+    }
+    *end = '\0';
+    for (line = strstr((char *)m_msg, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, "Sec-WebSocket-Accept:", 21) == 0) {
+            line += 21;
+            while (*line == ' ') {
+                line++;
+            }
+            if (strncmp(line, accept, 28) == 0) {
+                m_connected = true;
+            }
+            break;
+        }
+    }
+    if (!m_connected) {
+        m_wifi->releaseTCP(m_mux_id);
+        return false;
+    }
+    m_last_in = millis();
+    
+    /* 
+     * Frames right behind the headers, through m_rx by slices: parse writes 
+     * messages from the beginning of m_msg, never past what was taken. 
+     */
+    end += 4;
+    len = m_msg + len - (uint8_t *)end;
+    while (len > 0 && m_connected) {
+        n = len < sizeof(m_rx) ? len : sizeof(m_rx);
+        memcpy(m_rx, end, n);
+        end += n;
+        len -= n;
+        parse(m_rx, n);
+    }
+    return m_connected;
+}
+
+void ESP8266WebSocket::disconnect(uint16_t code)
+{
+    unsigned long start;
+    uint8_t payload[2];
+    
+    if (!m_connected) {
+        return;
+    }
+    payload[0] = code >> 8;
+    payload[1] = code & 0xFF;
+    if (send_frame(WS_FIN | WS_CLOSE, payload, sizeof(payload))) {
+        m_close_sent = true;
+        /* Wait for the close reply, the server closes TCP first */
+        start = millis();
+        while (m_connected && millis() - start < ESP8266WS_TIMEOUT_MS) {
+            parse(m_rx, m_wifi->recv(m_mux_id, m_rx, sizeof(m_rx), 100));
+        }
+    }
+    if (m_connected) {
+        m_wifi->releaseTCP(m_mux_id);
+        m_connected = false;
+    }
+}
+
+bool ESP8266WebSocket::connected(void)
+{
+    return m_connected;
+}
+
+bool ESP8266WebSocket::send(uint8_t opcode, const uint8_t *payload, uint32_t len)
+{
+    uint32_t offset = 0;
+    uint16_t n;
+    
+    do {
+        n = len - offset > ESP8266WS_FRAGMENT_SIZE ? ESP8266WS_FRAGMENT_SIZE : len - offset;
+        if (!send_frame((offset + n == len ? WS_FIN : 0) | (offset == 0 ? opcode : WS_CONTINUATION), 
+            payload + offset, n)) {
+            return false;
+        }
+        offset += n;
+    } while (offset < len);
+    return true;
+}
+
+bool ESP8266WebSocket::sendText(const char *text)
+{
+    return send(ESP8266WS_TEXT, (const uint8_t *)text, strlen(text));
+}
+
+bool ESP8266WebSocket::sendBinary(const uint8_t *payload, uint32_t len)
+{
+    return send(ESP8266WS_BINARY, payload, len);
+}
+
+bool ESP8266WebSocket::ping(void)
+{
+    if (!send_frame(WS_FIN | WS_PING, NULL, 0)) {
+        return false;
+    }
+    m_ping_pending = true;
+    return true;
+}
+
+void ESP8266WebSocket::setPingInterval(uint32_t interval)
+{
+    m_ping_interval = interval;
+}
+
+void ESP8266WebSocket::setCallback(ESP8266WebSocketCallback callback)
+{
+    m_callback = callback;
+}
+
+bool ESP8266WebSocket::loop(uint32_t timeout)
+{
+    unsigned long now;
+    uint32_t n;
+    
+    if (!m_connected) {
+        return false;
+    }
+    /* A frame longer than m_rx comes by slices, all that arrived */
+    do {
+        n = m_wifi->recv(m_mux_id, m_rx, sizeof(m_rx), timeout);
+        parse(m_rx, n);
+        timeout = 0;
+    } while (n == sizeof(m_rx) && m_connected);
+    if (n == 0 && m_connected && !m_wifi->isConnected(m_mux_id)) {
+        /* Closed by the server without a close frame */
+        m_connected = false;
+        return false;
+    }
+    
+    now = millis();
+    if (m_connected && m_ping_interval && now - m_last_in >= m_ping_interval) {
+        if (m_ping_pending) {
+            /* Nothing back in a whole interval, the server is gone */
+            m_wifi->releaseTCP(m_mux_id);
+            m_connected = false;
+            return false;
+        }
+        ping();
+        m_last_in = now;
+    }
+    return m_connected;
+}
+
+uint16_t ESP8266WebSocket::getCloseCode(void)
+{
+    return m_close_code;
+}
+
+/*----------------------------------------------------------------------------*/
+
+bool ESP8266WebSocket::send_frame(uint8_t header, const uint8_t *payload, uint16_t len)
+{
+    uint8_t *mask;
+    uint16_t pos = 0;
+    uint16_t i;
+    
+    if (!m_connected || m_close_sent) {
+        return false;
+    }
+    m_tx[pos++] = header;
+    if (len < 126) {
+        m_tx[pos++] = WS_MASK | len;
+    } else {
+        m_tx[pos++] = WS_MASK | 126;
+        m_tx[pos++] = len >> 8;
+        m_tx[pos++] = len & 0xFF;
+    }
+    mask = m_tx + pos;
+    for (i = 0; i < 4; i++) {
+        m_tx[pos++] = random(0x100);
+    }
+    for (i = 0; i < len; i++) {
+        m_tx[pos++] = payload[i] ^ mask[i & 3];
+    }
+    return m_wifi->send(m_mux_id, m_tx, pos);
+}
+
+void ESP8266WebSocket::parse(const uint8_t *data, uint32_t len)
+{
+    uint8_t opcode;
+    uint8_t len7;
+    uint8_t *dst;
+    uint32_t n;
+    uint32_t i;
+    
+    while (len > 0 && m_connected) {
+        if (m_hdr_len < m_hdr_need) {
+            m_hdr[m_hdr_len++] = *data++;
+            len--;
+            if (m_hdr_len == 2) {
+                len7 = m_hdr[1] & 0x7F;
+                m_hdr_need = 2 + (len7 == 126 ? 2 : (len7 == 127 ? 8 : 0)) + (m_hdr[1] & WS_MASK ? 4 : 0);
+            }
+            if (m_hdr_len < m_hdr_need) {
+                continue;
+            }
+            
+            /* Header complete */
+            opcode = m_hdr[0] & 0x0F;
+            len7 = m_hdr[1] & 0x7F;
+            if (len7 == 126) {
+                m_frame_len = ((uint16_t)m_hdr[2] << 8) | m_hdr[3];
+            } else if (len7 == 127) {
+                if (m_hdr[2] | m_hdr[3] | m_hdr[4] | m_hdr[5]) {
+                    fail(1009);
+                    return;
+                }
+                m_frame_len = ((uint32_t)m_hdr[6] << 24) | ((uint32_t)m_hdr[7] << 16) 
+                    | ((uint32_t)m_hdr[8] << 8) | m_hdr[9];
+            } else {
+                m_frame_len = len7;
+            }
+            m_frame_pos = 0;
+            if (opcode & 0x08) {
+                if (m_frame_len > sizeof(m_ctrl) || !(m_hdr[0] & WS_FIN)) {
+                    fail(1002);
+                    return;
+                }
+            } else if ((opcode == WS_CONTINUATION) != (m_msg_opcode != 0)) {
+                fail(1002); /* Continuation without a start, or a start inside a message */
+                return;
+            } else if (m_frame_len > (uint32_t)(ESP8266WS_MESSAGE_SIZE - m_msg_len)) {
+                fail(1009);
+                return;
+            } else if (opcode != WS_CONTINUATION) {
+                m_msg_opcode = opcode;
+            }
+        } else {
+            /* Payload, unmasked in place if masked(servers should not) */
+            n = m_frame_len - m_frame_pos < len ? m_frame_len - m_frame_pos : len;
+            dst = (m_hdr[0] & 0x08) ? m_ctrl + m_frame_pos : m_msg + m_msg_len + m_frame_pos;
+            for (i = 0; i < n; i++) {
+                dst[i] = data[i];
+                if (m_hdr[1] & WS_MASK) {
+                    dst[i] ^= m_hdr[m_hdr_need - 4 + ((m_frame_pos + i) & 3)];
+                }
+            }
+            m_frame_pos += n;
+            data += n;
+            len -= n;
+        }
+        if (m_hdr_len == m_hdr_need && m_frame_pos == m_frame_len) {
+            handle_frame();
+            m_hdr_len = 0;
+            m_hdr_need = 2;
+        }
+    }
+}
+
+void ESP8266WebSocket::handle_frame(void)
+{
+    uint8_t opcode = m_hdr[0] & 0x0F;
+    
+    m_last_in = millis();
+    switch (opcode) {
+    case WS_PING:
+        send_frame(WS_FIN | WS_PONG, m_ctrl, m_frame_len);
+        break;
+    case WS_PONG:
+        m_ping_pending = false;
+        break;
+    case WS_CLOSE:
+        m_close_code = m_frame_len >= 2 ? ((uint16_t)m_ctrl[0] << 8) | m_ctrl[1] : 1005;
+        if (!m_close_sent) {
+            send_frame(WS_FIN | WS_CLOSE, m_ctrl, m_frame_len >= 2 ? 2 : 0);
+        }
+        m_wifi->releaseTCP(m_mux_id);
+        m_connected = false;
+        break;
+    default:
+        m_msg_len += m_frame_len;
+        if (m_hdr[0] & WS_FIN) {
+            m_msg[m_msg_len] = '\0';
+            if (m_callback) {
+                m_callback(m_msg_opcode, m_msg, m_msg_len);
+            }
+            m_msg_opcode = 0;
+            m_msg_len = 0;
+        }
+        break;
+    }
+}
+
+void ESP8266WebSocket::fail(uint16_t code)
+{
+    uint8_t payload[2];
+    
+    if (!m_close_sent) {
+        payload[0] = code >> 8;
+        payload[1] = code & 0xFF;
+        send_frame(WS_FIN | WS_CLOSE, payload, sizeof(payload));
+        m_close_sent = true;
+    }
+    m_wifi->releaseTCP(m_mux_id);
+    m_connected = false;
+}
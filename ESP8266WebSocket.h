@@ -0,0 +1,199 @@
+/**
+ * @file ESP8266WebSocket.h
+ * @brief The definition of class ESP8266WebSocket. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ESP8266WEBSOCKET_H__
+#define __ESP8266WEBSOCKET_H__
+
+#include "Arduino.h"
+#include "ESP8266.h"
+
+
+#define ESP8266WS_RX_BUFFER_SIZE    (64)    /* Bytes pulled from ESP8266 at a time */
+#define ESP8266WS_MESSAGE_SIZE      (256)   /* Largest message received(and the handshake response) */
+#define ESP8266WS_FRAGMENT_SIZE     (128)   /* Larger messages are sent in fragments */
+#define ESP8266WS_PING_MS           (30000) /* Ping when nothing received for so long, 0 to disable */
+#define ESP8266WS_TIMEOUT_MS        (5000)  /* Waiting the handshake response or the close reply */
+
+#define ESP8266WS_TEXT              (0x1)
+#define ESP8266WS_BINARY            (0x2)
+
+/**
+ * Called for every message received(fragments already reassembled). 
+ *
+ * @param opcode - ESP8266WS_TEXT or ESP8266WS_BINARY. 
+ * @param payload - the payload(NUL terminated for convenience), valid only during the call. 
+ * @param len - the length of payload. 
+ */
+typedef void (*ESP8266WebSocketCallback)(uint8_t opcode, const uint8_t *payload, uint16_t len);
+
+
+/**
+ * WebSocket(RFC 6455) client on one TCP link of ESP8266(multiple mode). 
+ *
+ * After the upgrade handshake the link stays open and the server pushes 
+ * messages whenever it likes, so they arrive with the one-way latency instead 
+ * of a polling interval. Frames are parsed incrementally, a few bytes at a 
+ * time, as they come out of "+IPD": a "+IPD" longer than ESP8266WS_RX_BUFFER_SIZE 
+ * is read by slices, so frames need not fit in it. Outgoing frames are masked, 
+ * messages larger than ESP8266WS_FRAGMENT_SIZE are fragmented and pings are 
+ * answered. The buffers are fixed-size members of each object sized by the 
+ * ESP8266WS_* macros(596 bytes by default: rx 64, message 257, control 125, 
+ * tx 136 and header 14), no heap. 
+ */
+class ESP8266WebSocket {
+ public:
+    /**
+     * Constuctor. 
+     *
+     * @param wifi - the ESP8266 to use. 
+     * @param mux_id - the identifier of the TCP link(available value: 0 ~ ESP8266_MAX_LINKS - 1). 
+     */
+    ESP8266WebSocket(ESP8266 &wifi, uint8_t mux_id);
+    
+    /**
+     * Connect to a server and upgrade to WebSocket. 
+     * 
+     * @param host - the IP or domain name of the server. 
+     * @param port - the port number of the server. 
+     * @param path - the resource(default: "/"). 
+     * @param protocol - the subprotocol requested(NULL for none). 
+     * @retval true - success(101 with a valid Sec-WebSocket-Accept).
+     * @retval false - failure.
+     */
+    bool connect(String host, uint32_t port, const char *path = "/", const char *protocol = NULL);
+    
+    /**
+     * Close the connection(close handshake) and release the TCP link. 
+     *
+     * @param code - the status code(default: 1000, normal closure). 
+     */
+    void disconnect(uint16_t code = 1000);
+    
+    /**
+     * Whether connected to the server. 
+     */
+    bool connected(void);
+    
+    /**
+     * Send a message, fragmented if larger than ESP8266WS_FRAGMENT_SIZE. 
+     * 
+     * @param opcode - ESP8266WS_TEXT or ESP8266WS_BINARY. 
+     * @param payload - the payload. 
+     * @param len - the length of payload. 
+     * @retval true - success.
+     * @retval false - failure.
+     */
+    bool send(uint8_t opcode, const uint8_t *payload, uint32_t len);
+    
+    /**
+     * Send a text message. 
+     * 
+     * @see send
+     */
+    bool sendText(const char *text);
+    
+    /**
+     * Send a binary message. 
+     * 
+     * @see send
+     */
+    bool sendBinary(const uint8_t *payload, uint32_t len);
+    
+    /**
+     * Send a ping. The pong is awaited by loop. 
+     *
+     * @retval true - success.
+     * @retval false - failure.
+     */
+    bool ping(void);
+    
+    /**
+     * Set the interval of keepalive pings. 
+     *
+     * A ping is sent when nothing was received for interval, and the connection 
+     * is dropped when nothing comes back for another interval. 
+     *
+     * @param interval - in milliseconds, 0 to disable(default: ESP8266WS_PING_MS). 
+     */
+    void setPingInterval(uint32_t interval);
+    
+    /**
+     * Set the callback for messages received. 
+     */
+    void setCallback(ESP8266WebSocketCallback callback);
+    
+    /**
+     * Process incoming frames and keepalive. 
+     *
+     * Should be called frequently in loop(). 
+     *
+     * @param timeout - the time waiting for data(default: 10ms). 
+     * @retval true - still connected.
+     * @retval false - disconnected.
+     */
+    bool loop(uint32_t timeout = 10);
+    
+    /**
+     * Get the status code of the close frame received(0 if none). 
+     */
+    uint16_t getCloseCode(void);
+
+ private:
+    
+    /*
+     * Send one frame, masked, of at most ESP8266WS_FRAGMENT_SIZE bytes. 
+     */
+    bool send_frame(uint8_t header, const uint8_t *payload, uint16_t len);
+    
+    /*
+     * Feed received bytes to the frame parser. 
+     */
+    void parse(const uint8_t *data, uint32_t len);
+    void handle_frame(void);
+    
+    /*
+     * Send a close frame(if not sent yet) and release the link. 
+     */
+    void fail(uint16_t code);
+    
+    ESP8266 *m_wifi;
+    uint8_t m_mux_id;
+    bool m_connected;
+    bool m_close_sent;
+    bool m_ping_pending;
+    uint16_t m_close_code;
+    uint32_t m_ping_interval;
+    unsigned long m_last_in;
+    ESP8266WebSocketCallback m_callback;
+    
+    uint8_t m_hdr[14];              /* Header of the frame being parsed */
+    uint8_t m_hdr_len;
+    uint8_t m_hdr_need;
+    uint32_t m_frame_len;           /* Payload length of the frame being parsed */
+    uint32_t m_frame_pos;
+    uint8_t m_msg_opcode;           /* 0 when no message in progress */
+    uint16_t m_msg_len;
+    
+    uint8_t m_rx[ESP8266WS_RX_BUFFER_SIZE];
+    uint8_t m_msg[ESP8266WS_MESSAGE_SIZE + 1];
+    uint8_t m_ctrl[125];            /* Payload of a control frame */
+    uint8_t m_tx[ESP8266WS_FRAGMENT_SIZE + 8];
+};
+
+#endif /* #ifndef __ESP8266WEBSOCKET_H__ */
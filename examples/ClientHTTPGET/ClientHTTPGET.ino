@@ -0,0 +1,91 @@
+/**
+ * @example ClientHTTPGET.ino
+ * @brief The ClientHTTPGET demo of library WeeESP8266. 
+ * @date 2015.02
+ * 
+ * ESP8266Client is an Arduino Client on one link, so code written for 
+ * Client(here a plain HTTP request) runs on ESP8266 unchanged. 
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266.h"
+#include "ESP8266Client.h"
+
+#define SSID        "ITEAD"
+#define PASSWORD    "12345678"
+#define HOST_NAME   "www.baidu.com"
+#define HOST_PORT   (80)
+
+ESP8266 wifi(Serial1);
+ESP8266Client client(wifi, 0);
+
+/* Any code taking a Client works on ESP8266Client */
+void httpGet(Client &c, const char *host)
+{
+    c.print("GET / HTTP/1.1\r\nHost: ");
+    c.print(host);
+    c.print("\r\nConnection: close\r\n\r\n");
+    c.flush();
+    
+    unsigned long start = millis();
+    while (c.connected() && millis() - start < 10000) {
+        while (c.available() > 0) {
+            Serial.print((char)c.read());
+            start = millis();
+        }
+    }
+    Serial.print("\r\n");
+}
+
+void setup(void)
+{
+    Serial.begin(9600);
+    Serial.print("setup begin\r\n");
+
+    if (wifi.setOprToStation()) {
+        Serial.print("to station ok\r\n");
+    } else {
+        Serial.print("to station err\r\n");
+    }
+
+    if (wifi.joinAP(SSID, PASSWORD)) {
+        Serial.print("Join AP success\r\n");
+        Serial.print("IP: ");
+        Serial.println(wifi.getLocalIP().c_str());
+    } else {
+        Serial.print("Join AP failure\r\n");
+    }
+    
+    if (wifi.enableMUX()) {
+        Serial.print("multiple ok\r\n");
+    } else {
+        Serial.print("multiple err\r\n");
+    }
+    
+    Serial.print("setup end\r\n");
+}
+
+void loop(void)
+{
+    if (client.connect(HOST_NAME, HOST_PORT)) {
+        Serial.print("connect ok\r\n");
+        httpGet(client, HOST_NAME);
+        client.stop();
+    } else {
+        Serial.print("connect err\r\n");
+    }
+    
+    delay(10000);
+}
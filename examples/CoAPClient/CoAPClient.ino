@@ -0,0 +1,102 @@
+/**
+ * @example CoAPClient.ino
+ * @brief The CoAPClient demo of library WeeESP8266. 
+ * @date 2015.02
+ * 
+ * A CoAP client on UDP link 0: PUT the value of A0 to a sensor resource, 
+ * then GET it back, each being one datagram and its response. 
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266.h"
+#include "ESP8266Pool.h"
+#include "ESP8266.h"
+#include "ESP8266CoAP.h"
+
+#define SSID        "ITEAD"
+#define PASSWORD    "12345678"
+#define HOST_NAME   "172.16.5.12"
+#define HOST_PORT   (5683)
+
+ESP8266 wifi(Serial1);
+ESP8266CoAP coap(wifi, 0);
+
+void printCode(uint8_t code)
+{
+    /* e.g. 0x45 is printed as 2.05 */
+    Serial.print(code >> 5);
+    Serial.print((code & 0x1F) < 10 ? ".0" : ".");
+    Serial.println(code & 0x1F);
+}
+
+void setup(void)
+{
+    Serial.begin(9600);
+    Serial.print("setup begin\r\n");
+
+    if (wifi.setOprToStation()) {
+        Serial.print("to station ok\r\n");
+    } else {
+        Serial.print("to station err\r\n");
+    }
+
+    if (wifi.joinAP(SSID, PASSWORD)) {
+        Serial.print("Join AP success\r\n");
+    } else {
+        Serial.print("Join AP failure\r\n");
+    }
+    
+    if (wifi.enableMUX()) {
+        Serial.print("multiple ok\r\n");
+    } else {
+        Serial.print("multiple err\r\n");
+    }
+    
+    if (coap.begin(HOST_NAME, HOST_PORT)) {
+        Serial.print("register udp ok\r\n");
+    } else {
+        Serial.print("register udp err\r\n");
+    }
+    
+    Serial.print("setup end\r\n");
+}
+
+void loop(void)
+{
+    uint8_t buffer[ESP8266COAP_BLOCK_SIZE];
+    uint16_t len = 0;
+    uint8_t code;
+    char value[8];
+    
+    itoa(analogRead(A0), value, 10);
+    code = coap.put("sensors/a0", (const uint8_t *)value, strlen(value));
+    Serial.print("PUT ");
+    printCode(code);
+    
+    code = coap.get("sensors/a0", buffer, sizeof(buffer), &len);
+    Serial.print("GET ");
+    printCode(code);
+    if (code == ESP8266COAP_CODE(2, 5)) {
+        Serial.print("Received:[");
+        for (uint16_t i = 0; i < len; i++) {
+            Serial.print((char)buffer[i]);
+        }
+        Serial.print("]\r\n");
+    }
+    
+    Serial.print("retransmissions:");
+    Serial.println(coap.getRetransmissions());
+    delay(5000);
+}
@@ -0,0 +1,109 @@
+/**
+ * @example LZSend.ino
+ * @brief The LZSend demo of library WeeESP8266. 
+ * @date 2015.02
+ * 
+ * A JSON report is compressed on the fly while sent on link 0, and the reply, 
+ * compressed the same way by the server, is decompressed to Serial. 
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266.h"
+#include "ESP8266Pool.h"
+#include "ESP8266.h"
+#include "ESP8266LZ.h"
+
+#define SSID        "ITEAD"
+#define PASSWORD    "12345678"
+#define HOST_NAME   "172.16.5.12"
+#define HOST_PORT   (8090)
+
+ESP8266 wifi(Serial1);
+ESP8266LZEncoder encoder;
+ESP8266LZDecoder decoder(Serial);
+
+char report[256];
+
+void setup(void)
+{
+    Serial.begin(9600);
+    Serial.print("setup begin\r\n");
+
+    if (wifi.setOprToStation()) {
+        Serial.print("to station ok\r\n");
+    } else {
+        Serial.print("to station err\r\n");
+    }
+
+    if (wifi.joinAP(SSID, PASSWORD)) {
+        Serial.print("Join AP success\r\n");
+    } else {
+        Serial.print("Join AP failure\r\n");
+    }
+    
+    if (wifi.enableMUX()) {
+        Serial.print("multiple ok\r\n");
+    } else {
+        Serial.print("multiple err\r\n");
+    }
+    
+    Serial.print("setup end\r\n");
+}
+
+void loop(void)
+{
+    uint8_t mux_id = 0;
+    uint8_t buffer[128];
+    uint32_t len;
+    uint32_t total = 0;
+    
+    if (!wifi.createTCP(mux_id, HOST_NAME, HOST_PORT)) {
+        Serial.print("create tcp err\r\n");
+        delay(5000);
+        return;
+    }
+    
+    /* Repeated keys compress well */
+    strcpy(report, "[");
+    for (uint8_t i = 0; i < 4; i++) {
+        sprintf(report + strlen(report), "%s{\"sensor\":%u,\"value\":%u}", 
+            i == 0 ? "" : ",", i, analogRead(A0));
+    }
+    strcat(report, "]");
+    
+    len = encoder.begin((const uint8_t *)report, strlen(report));
+    Serial.print("compressed ");
+    Serial.print(strlen(report));
+    Serial.print(" to ");
+    Serial.println(len);
+    if (!wifi.send(mux_id, encoder, len)) {
+        Serial.print("send err\r\n");
+    }
+    
+    decoder.reset();
+    Serial.print("Received:[");
+    while ((len = wifi.recv(mux_id, buffer, sizeof(buffer), 2000)) > 0) {
+        decoder.write(buffer, len);
+        total += len;
+    }
+    Serial.print("]\r\n");
+    Serial.print("decompressed ");
+    Serial.print(total);
+    Serial.print(" to ");
+    Serial.println(decoder.getLength());
+    
+    wifi.releaseTCP(mux_id);
+    delay(5000);
+}
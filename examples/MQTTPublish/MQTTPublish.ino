@@ -0,0 +1,106 @@
+/**
+ * @example MQTTPublish.ino
+ * @brief The MQTTPublish demo of library WeeESP8266. 
+ * @date 2015.02
+ * 
+ * Publishes a reading every 10 seconds(QoS 1, kept until PUBACK), batching 
+ * two messages into one "AT+CIPSEND", and prints the messages received on 
+ * the topic subscribed. 
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266.h"
+#include "ESP8266MQTT.h"
+
+#define SSID        "ITEAD"
+#define PASSWORD    "12345678"
+#define BROKER_NAME "172.16.5.12"
+#define BROKER_PORT (1883)
+
+ESP8266 wifi(Serial1);
+ESP8266MQTT mqtt(wifi, 0);
+
+void received(const char *topic, const uint8_t *payload, uint16_t len)
+{
+    Serial.print("Received on ");
+    Serial.print(topic);
+    Serial.print(":[");
+    for (uint16_t i = 0; i < len; i++) {
+        Serial.print((char)payload[i]);
+    }
+    Serial.print("]\r\n");
+}
+
+void setup(void)
+{
+    Serial.begin(9600);
+    Serial.print("setup begin\r\n");
+
+    if (wifi.setOprToStation()) {
+        Serial.print("to station ok\r\n");
+    } else {
+        Serial.print("to station err\r\n");
+    }
+
+    if (wifi.joinAP(SSID, PASSWORD)) {
+        Serial.print("Join AP success\r\n");
+    } else {
+        Serial.print("Join AP failure\r\n");
+    }
+    
+    if (wifi.enableMUX()) {
+        Serial.print("multiple ok\r\n");
+    } else {
+        Serial.print("multiple err\r\n");
+    }
+    
+    mqtt.setCallback(received);
+    Serial.print("setup end\r\n");
+}
+
+void loop(void)
+{
+    static unsigned long last = 0;
+    char value[8];
+    
+    if (!mqtt.connected()) {
+        if (mqtt.connect(BROKER_NAME, BROKER_PORT, "weeesp8266") 
+            && mqtt.subscribe("weeesp8266/cmd")) {
+            Serial.print("mqtt connect ok\r\n");
+        } else {
+            Serial.print("mqtt connect err\r\n");
+            delay(5000);
+            return;
+        }
+    }
+    
+    if (millis() - last >= 10000) {
+        last = millis();
+        /* Both messages go out in one "AT+CIPSEND" */
+        mqtt.beginBatch();
+        itoa(analogRead(A0), value, 10);
+        mqtt.publish("weeesp8266/a0", value, 1);
+        itoa(millis() / 1000, value, 10);
+        mqtt.publish("weeesp8266/uptime", value);
+        if (mqtt.endBatch()) {
+            Serial.print("publish ok\r\n");
+        } else {
+            Serial.print("publish err\r\n");
+        }
+    }
+    
+    /* Incoming messages, PUBACK, keepalive and retransmission */
+    mqtt.loop();
+}
@@ -0,0 +1,93 @@
+/**
+ * @example PoolSpread.ino
+ * @brief The PoolSpread demo of library WeeESP8266. 
+ * @date 2015.02
+ * 
+ * Two ESP8266 on Serial1 and Serial2 work as one pool: datagrams are spread 
+ * across both modules in turn, so one transmits while the other is written, 
+ * and a TCP link is opened on the module with fewer links. 
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266.h"
+#include "ESP8266Pool.h"
+
+#define SSID        "ITEAD"
+#define PASSWORD    "12345678"
+#define HOST_NAME   "172.16.5.12"
+#define HOST_PORT   (8090)
+
+ESP8266 wifi1(Serial1);
+ESP8266 wifi2(Serial2);
+ESP8266Pool pool;
+
+bool setupModule(ESP8266 &wifi)
+{
+    return wifi.setOprToStation() && wifi.joinAP(SSID, PASSWORD) 
+        && wifi.enableMUX() && pool.add(wifi);
+}
+
+void setup(void)
+{
+    Serial.begin(9600);
+    Serial.print("setup begin\r\n");
+
+    if (setupModule(wifi1) && setupModule(wifi2)) {
+        Serial.print("pool of 2 ok\r\n");
+    } else {
+        Serial.print("pool err\r\n");
+    }
+    
+    Serial.print("UDP spread on ");
+    Serial.print(pool.registerUDPSpread(HOST_NAME, HOST_PORT));
+    Serial.print(" modules\r\n");
+    
+    Serial.print("setup end\r\n");
+}
+
+void loop(void)
+{
+    uint8_t buffer[128];
+    uint8_t link;
+    uint32_t len;
+    
+    /* Each datagram goes out on the next module */
+    for (uint8_t i = 0; i < 16; i++) {
+        memset(buffer, 'a' + i, sizeof(buffer));
+        pool.sendSpread(buffer, sizeof(buffer));
+    }
+    if (pool.flush()) {
+        Serial.print("spread ok\r\n");
+    } else {
+        Serial.print("spread err\r\n");
+    }
+    
+    link = pool.createTCP(HOST_NAME, HOST_PORT);
+    if (link != ESP8266POOL_NONE) {
+        const char *hello = "Hello, this is client!";
+        pool.send(link, (const uint8_t *)hello, strlen(hello));
+        len = pool.recv(&link, buffer, sizeof(buffer), 10000);
+        if (len > 0) {
+            Serial.print("Received:[");
+            for (uint32_t i = 0; i < len; i++) {
+                Serial.print((char)buffer[i]);
+            }
+            Serial.print("]\r\n");
+        }
+        pool.release(link);
+    }
+    
+    delay(5000);
+}
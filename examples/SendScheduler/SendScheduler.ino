@@ -0,0 +1,105 @@
+/**
+ * @example SendScheduler.ino
+ * @brief The SendScheduler demo of library WeeESP8266. 
+ * @date 2015.02
+ * 
+ * Two TCP links share the uart through the send scheduler: a bulk transfer 
+ * on link 0 is cut into chunks, and the short status messages of link 1, 
+ * being of higher priority, wait for one chunk at most. 
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266.h"
+#include "ESP8266Pool.h"
+#include "ESP8266.h"
+#include "ESP8266SendScheduler.h"
+
+#define SSID        "ITEAD"
+#define PASSWORD    "12345678"
+#define HOST_NAME   "172.16.5.12"
+#define HOST_PORT   (8090)
+
+#define BULK_LINK   (0)
+#define STATUS_LINK (1)
+
+ESP8266 wifi(Serial1);
+ESP8266SendScheduler scheduler(wifi);
+
+uint8_t bulk[1024];
+char status[32];
+
+void setup(void)
+{
+    Serial.begin(9600);
+    Serial.print("setup begin\r\n");
+
+    if (wifi.setOprToStation()) {
+        Serial.print("to station ok\r\n");
+    } else {
+        Serial.print("to station err\r\n");
+    }
+
+    if (wifi.joinAP(SSID, PASSWORD)) {
+        Serial.print("Join AP success\r\n");
+    } else {
+        Serial.print("Join AP failure\r\n");
+    }
+    
+    if (wifi.enableMUX()) {
+        Serial.print("multiple ok\r\n");
+    } else {
+        Serial.print("multiple err\r\n");
+    }
+    
+    if (wifi.createTCP(BULK_LINK, HOST_NAME, HOST_PORT) 
+        && wifi.createTCP(STATUS_LINK, HOST_NAME, HOST_PORT)) {
+        Serial.print("create tcp ok\r\n");
+    } else {
+        Serial.print("create tcp err\r\n");
+    }
+    
+    scheduler.setLink(BULK_LINK, 3, 128);
+    scheduler.setLink(STATUS_LINK, 0);
+    memset(bulk, 'a', sizeof(bulk));
+    
+    Serial.print("setup end\r\n");
+}
+
+void loop(void)
+{
+    static unsigned long last = 0;
+    
+    /* Queue the bulk data again once sent */
+    if (scheduler.getQueued(BULK_LINK) == 0) {
+        scheduler.queue(BULK_LINK, bulk, sizeof(bulk));
+    }
+    
+    /* The status message must be kept until sent */
+    if (millis() - last > 1000 && scheduler.getQueued(STATUS_LINK) == 0) {
+        last = millis();
+        sprintf(status, "uptime %lu\r\n", last);
+        scheduler.queue(STATUS_LINK, (const uint8_t *)status, strlen(status));
+        
+        const ESP8266SendStats &stats = scheduler.getStats(STATUS_LINK);
+        Serial.print("status sent:");
+        Serial.print(stats.messages);
+        Serial.print(" max delay(ms):");
+        Serial.println(stats.max_delay_ms);
+    }
+    
+    if (!scheduler.run()) {
+        Serial.print("chunk err\r\n");
+    }
+}
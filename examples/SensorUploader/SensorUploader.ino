@@ -0,0 +1,100 @@
+/**
+ * @example SensorUploader.ino
+ * @brief The SensorUploader demo of library WeeESP8266. 
+ * @date 2015.02
+ * 
+ * Samples of A0 are stored as 6-byte records and uploaded in batches on TCP 
+ * link 0 every 32 records or minute, acknowledged by the server. Records 
+ * overflowing RAM are kept in EEPROM, so none is lost while the AP is away. 
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266.h"
+#include "ESP8266Pool.h"
+#include "ESP8266.h"
+#include "ESP8266Uploader.h"
+
+#define SSID        "ITEAD"
+#define PASSWORD    "12345678"
+#define HOST_NAME   "172.16.5.12"
+#define HOST_PORT   (8090)
+
+#define RECORD_SIZE (6)     /* Time(4) and value(2) */
+
+ESP8266 wifi(Serial1);
+ESP8266Uploader uploader(wifi, 0, RECORD_SIZE);
+
+void setup(void)
+{
+    Serial.begin(9600);
+    Serial.print("setup begin\r\n");
+
+    if (wifi.setOprToStation()) {
+        Serial.print("to station ok\r\n");
+    } else {
+        Serial.print("to station err\r\n");
+    }
+
+    if (wifi.joinAP(SSID, PASSWORD)) {
+        Serial.print("Join AP success\r\n");
+    } else {
+        Serial.print("Join AP failure\r\n");
+    }
+    
+    if (wifi.enableMUX()) {
+        Serial.print("multiple ok\r\n");
+    } else {
+        Serial.print("multiple err\r\n");
+    }
+    
+    uploader.setTarget(ESP8266_LINK_TCP, HOST_NAME, HOST_PORT);
+    uploader.setThreshold(32, 60000);
+    uploader.setEEPROM(0, 512);
+    uploader.setAck(true);
+    Serial.print("records restored:");
+    Serial.println(uploader.getCount());
+    
+    Serial.print("setup end\r\n");
+}
+
+void loop(void)
+{
+    static unsigned long last = 0;
+    uint8_t record[RECORD_SIZE];
+    unsigned long now = millis();
+    uint16_t value;
+    
+    if (now - last >= 1000) {
+        last = now;
+        value = analogRead(A0);
+        record[0] = now >> 24;
+        record[1] = now >> 16;
+        record[2] = now >> 8;
+        record[3] = now;
+        record[4] = value >> 8;
+        record[5] = value;
+        uploader.append(record);
+    }
+    
+    if (!uploader.run()) {
+        const ESP8266UploaderStats &stats = uploader.getStats();
+        Serial.print("flush err, stored:");
+        Serial.print(uploader.getCount());
+        Serial.print(" delivered:");
+        Serial.print(stats.delivered);
+        Serial.print(" dropped:");
+        Serial.println(stats.dropped);
+    }
+}
@@ -0,0 +1,92 @@
+/**
+ * @example SleepScheduler.ino
+ * @brief The SleepScheduler demo of library WeeESP8266. 
+ * @date 2015.02
+ * 
+ * Takes a reading every 5 seconds and uploads the readings queued once a 
+ * minute by UDP, with ESP8266 in modem sleep between uploads. 
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266.h"
+#include "ESP8266Scheduler.h"
+
+#define SSID        "ITEAD"
+#define PASSWORD    "12345678"
+#define HOST_NAME   "172.16.5.12"
+#define HOST_PORT   (8090)
+
+ESP8266 wifi(Serial1);
+ESP8266Scheduler scheduler(wifi, 0);
+
+void setup(void)
+{
+    Serial.begin(9600);
+    Serial.print("setup begin\r\n");
+
+    if (wifi.setOprToStation()) {
+        Serial.print("to station ok\r\n");
+    } else {
+        Serial.print("to station err\r\n");
+    }
+
+    if (wifi.joinAP(SSID, PASSWORD)) {
+        Serial.print("Join AP success\r\n");
+    } else {
+        Serial.print("Join AP failure\r\n");
+    }
+    
+    if (wifi.enableMUX()) {
+        Serial.print("multiple ok\r\n");
+    } else {
+        Serial.print("multiple err\r\n");
+    }
+    
+    scheduler.setTarget(ESP8266_LINK_UDP, HOST_NAME, HOST_PORT);
+    scheduler.setInterval(60000, ESP8266_SLEEP_MODEM);
+    
+    Serial.print("setup end\r\n");
+}
+
+void loop(void)
+{
+    static unsigned long last = 0;
+    static uint32_t windows = 0;
+    uint8_t reading[4];
+    uint16_t value;
+    
+    if (millis() - last >= 5000) {
+        last = millis();
+        value = analogRead(A0);
+        reading[0] = 'A';
+        reading[1] = '0';
+        reading[2] = value >> 8;
+        reading[3] = value & 0xFF;
+        if (!scheduler.queue(reading, sizeof(reading))) {
+            Serial.print("queue full\r\n");
+        }
+    }
+    
+    /* Wakes ESP8266, sends all queued and puts it to sleep once a minute */
+    if (!scheduler.run()) {
+        Serial.print("upload err\r\n");
+    }
+    
+    if (scheduler.getStats().windows != windows) {
+        windows = scheduler.getStats().windows;
+        Serial.print("radio on us per byte: ");
+        Serial.println(scheduler.getRadioOnPerByte());
+    }
+}
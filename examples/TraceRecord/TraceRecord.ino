@@ -0,0 +1,82 @@
+/**
+ * @example TraceRecord.ino
+ * @brief The TraceRecord demo of library WeeESP8266. 
+ * @date 2015.02
+ * 
+ * Records every byte between the mainboard and ESP8266 during a TCP 
+ * exchange to Serial2(e.g. a USB-UART on a PC saving it to a file). The 
+ * trace can be replayed by ESP8266TraceReplay to measure the latency and 
+ * the CPU time of each call, see extras/posix/tools/TraceReplay.cpp. 
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266.h"
+#include "ESP8266Trace.h"
+
+#define SSID        "ITEAD"
+#define PASSWORD    "12345678"
+#define HOST_NAME   "172.16.5.12"
+#define HOST_PORT   (8090)
+
+ESP8266 wifi(Serial1);
+ESP8266TraceRecorder recorder(Serial2);
+
+void setup(void)
+{
+    Serial.begin(9600);
+    Serial2.begin(115200);
+    Serial.print("setup begin\r\n");
+
+    if (wifi.setOprToStation()) {
+        Serial.print("to station ok\r\n");
+    } else {
+        Serial.print("to station err\r\n");
+    }
+
+    if (wifi.joinAP(SSID, PASSWORD)) {
+        Serial.print("Join AP success\r\n");
+    } else {
+        Serial.print("Join AP failure\r\n");
+    }
+    
+    if (wifi.enableMUX()) {
+        Serial.print("multiple ok\r\n");
+    } else {
+        Serial.print("multiple err\r\n");
+    }
+    
+    Serial.print("setup end\r\n");
+}
+
+void loop(void)
+{
+    uint8_t buffer[128];
+    const char *hello = "Hello, this is client!";
+    uint8_t mux_id = 0;
+    
+    /* Everything from here to setTrace(NULL) goes to the trace */
+    wifi.setTrace(&recorder);
+    if (wifi.createTCP(mux_id, HOST_NAME, HOST_PORT)) {
+        for (uint8_t i = 0; i < 10; i++) {
+            wifi.send(mux_id, (const uint8_t *)hello, strlen(hello));
+            wifi.recv(mux_id, buffer, sizeof(buffer), 1000);
+        }
+        wifi.releaseTCP(mux_id);
+    }
+    wifi.setTrace(NULL);
+    Serial.print("trace done\r\n");
+    
+    while(1);
+}
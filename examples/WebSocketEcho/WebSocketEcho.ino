@@ -0,0 +1,103 @@
+/**
+ * @example WebSocketEcho.ino
+ * @brief The WebSocketEcho demo of library WeeESP8266. 
+ * @date 2015.02
+ * 
+ * A WebSocket client on TCP link 0 sending the value of A0 every few seconds 
+ * and printing every message pushed by the server, reconnecting when dropped. 
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "ESP8266.h"
+#include "ESP8266Pool.h"
+#include "ESP8266.h"
+#include "ESP8266WebSocket.h"
+
+#define SSID        "ITEAD"
+#define PASSWORD    "12345678"
+#define HOST_NAME   "172.16.5.12"
+#define HOST_PORT   (8090)
+
+ESP8266 wifi(Serial1);
+ESP8266WebSocket ws(wifi, 0);
+
+void onMessage(uint8_t opcode, const uint8_t *payload, uint16_t len)
+{
+    if (opcode == ESP8266WS_TEXT) {
+        Serial.print("Received:[");
+        Serial.print((const char *)payload);
+        Serial.print("]\r\n");
+    } else {
+        Serial.print("Received ");
+        Serial.print(len);
+        Serial.print(" bytes\r\n");
+    }
+}
+
+void setup(void)
+{
+    Serial.begin(9600);
+    Serial.print("setup begin\r\n");
+
+    if (wifi.setOprToStation()) {
+        Serial.print("to station ok\r\n");
+    } else {
+        Serial.print("to station err\r\n");
+    }
+
+    if (wifi.joinAP(SSID, PASSWORD)) {
+        Serial.print("Join AP success\r\n");
+    } else {
+        Serial.print("Join AP failure\r\n");
+    }
+    
+    if (wifi.enableMUX()) {
+        Serial.print("multiple ok\r\n");
+    } else {
+        Serial.print("multiple err\r\n");
+    }
+    
+    ws.setCallback(onMessage);
+    Serial.print("setup end\r\n");
+}
+
+void loop(void)
+{
+    static unsigned long last = 0;
+    char text[16];
+    
+    if (!ws.connected()) {
+        if (ws.connect(HOST_NAME, HOST_PORT, "/echo")) {
+            Serial.print("connect ok\r\n");
+        } else {
+            Serial.print("connect err\r\n");
+            delay(5000);
+            return;
+        }
+    }
+    
+    if (millis() - last > 5000) {
+        last = millis();
+        itoa(analogRead(A0), text, 10);
+        if (!ws.sendText(text)) {
+            Serial.print("send err\r\n");
+        }
+    }
+    
+    if (!ws.loop()) {
+        Serial.print("disconnected, close code:");
+        Serial.println(ws.getCloseCode());
+    }
+}
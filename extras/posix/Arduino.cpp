@@ -0,0 +1,153 @@
+/**
+ * @file Arduino.cpp
+ * @brief The implementation of the minimal Arduino core on Linux. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "Arduino.h"
+
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static struct timespec start_time;
+
+static uint64_t elapsed_us(void)
+{
+    struct timespec now;
+    if (start_time.tv_sec == 0 && start_time.tv_nsec == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - start_time.tv_sec) * 1000000 
+        + (now.tv_nsec - start_time.tv_nsec) / 1000;
+}
+
+unsigned long millis(void)
+{
+    return (unsigned long)(elapsed_us() / 1000);
+}
+
+unsigned long micros(void)
+{
+    return (unsigned long)elapsed_us();
+}
+
+void delay(unsigned long ms)
+{
+    struct timespec t;
+    t.tv_sec = ms / 1000;
+    t.tv_nsec = (ms % 1000) * 1000000L;
+    while (nanosleep(&t, &t) < 0 && errno == EINTR) {
+    }
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    struct timespec t;
+    t.tv_sec = us / 1000000;
+    t.tv_nsec = (us % 1000000) * 1000L;
+    while (nanosleep(&t, &t) < 0 && errno == EINTR) {
+    }
+}
+
+void yield(void)
+{
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void digitalWrite(uint8_t, uint8_t)
+{
+}
+
+int digitalRead(uint8_t)
+{
+    return LOW;
+}
+
+void randomSeed(unsigned long seed)
+{
+    srandom(seed);
+}
+
+long random(long max)
+{
+    return max > 0 ? ::random() % max : 0;
+}
+
+long random(long min, long max)
+{
+    return min < max ? min + ::random() % (max - min) : min;
+}
+
+/*----------------------------------------------------------------------------*/
+
+class ConsoleSerial : public HardwareSerial {
+ public:
+    ConsoleSerial() : m_peek(-1) {}
+    
+    int available(void)
+    {
+        return peek() >= 0 ? 1 : 0;
+    }
+    
+    int read(void)
+    {
+        int c = peek();
+        m_peek = -1;
+        return c;
+    }
+    
+    int peek(void)
+    {
+        uint8_t c;
+        int flags;
+        if (m_peek < 0) {
+            flags = fcntl(STDIN_FILENO, F_GETFL);
+            fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
+            if (::read(STDIN_FILENO, &c, 1) == 1) {
+                m_peek = c;
+            }
+            fcntl(STDIN_FILENO, F_SETFL, flags);
+        }
+        return m_peek;
+    }
+    
+    size_t write(uint8_t c)
+    {
+        return fwrite(&c, 1, 1, stdout);
+    }
+    
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+        return fwrite(buffer, 1, size, stdout);
+    }
+    
+    void flush(void)
+    {
+        fflush(stdout);
+    }
+    
+ private:
+    int m_peek;
+};
+
+static ConsoleSerial console;
+HardwareSerial &Serial = console;
@@ -0,0 +1,205 @@
+/**
+ * @file Arduino.h
+ * @brief A minimal Arduino core for building WeeESP8266 on Linux. 
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ARDUINO_POSIX_H__
+#define __ARDUINO_POSIX_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <string>
+
+/*
+ * Only what the library uses: flash access(plain memory here), time, 
+ * pins(no-ops), random, String, Print, Stream and HardwareSerial. 
+ */
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH                0x1
+#define LOW                 0x0
+#define INPUT               0x0
+#define OUTPUT              0x1
+
+#define DEC                 10
+#define HEX                 16
+
+#define PROGMEM
+#define PSTR(s)             (s)
+#define pgm_read_byte(p)    (*(const uint8_t *)(p))
+#define pgm_read_word(p)    (*(const uint16_t *)(p))
+#define pgm_read_dword(p)   (*(const uint32_t *)(p))
+#define pgm_read_ptr(p)     (*(void * const *)(p))
+#define strlen_P            strlen
+#define strcmp_P            strcmp
+#define strncmp_P           strncmp
+#define strstr_P            strstr
+#define memcpy_P            memcpy
+
+class __FlashStringHelper;
+#define F(s)                (reinterpret_cast<const __FlashStringHelper *>(s))
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void randomSeed(unsigned long seed);
+long random(long max);
+long random(long min, long max);
+
+class String {
+ public:
+    String(const char *s = "") : m_s(s ? s : "") {}
+    String(const __FlashStringHelper *s) : m_s((const char *)s) {}
+    String(char c) : m_s(1, c) {}
+    String(int v) : m_s(std::to_string(v)) {}
+    String(unsigned int v) : m_s(std::to_string(v)) {}
+    String(long v) : m_s(std::to_string(v)) {}
+    String(unsigned long v) : m_s(std::to_string(v)) {}
+    
+    unsigned int length(void) const { return m_s.size(); }
+    const char *c_str(void) const { return m_s.c_str(); }
+    bool reserve(unsigned int size) { m_s.reserve(size); return true; }
+    
+    char charAt(unsigned int i) const { return i < m_s.size() ? m_s[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+    int indexOf(char c, unsigned int from = 0) const { return pos(m_s.find(c, from)); }
+    int indexOf(const String &s, unsigned int from = 0) const { return pos(m_s.find(s.m_s, from)); }
+    int lastIndexOf(char c) const { return pos(m_s.rfind(c)); }
+    bool startsWith(const String &s) const { return m_s.compare(0, s.m_s.size(), s.m_s) == 0; }
+    bool endsWith(const String &s) const {
+        return m_s.size() >= s.m_s.size() && m_s.compare(m_s.size() - s.m_s.size(), s.m_s.size(), s.m_s) == 0;
+    }
+    String substring(unsigned int begin) const { return substring(begin, m_s.size()); }
+    String substring(unsigned int begin, unsigned int end) const {
+        if (end > m_s.size()) end = m_s.size();
+        return begin < end ? String(m_s.substr(begin, end - begin).c_str()) : String("");
+    }
+    long toInt(void) const { return atol(m_s.c_str()); }
+    void trim(void) {
+        size_t b = m_s.find_first_not_of(" \t\r\n");
+        m_s = b == std::string::npos ? "" : m_s.substr(b, m_s.find_last_not_of(" \t\r\n") - b + 1);
+    }
+    void remove(unsigned int index) { if (index < m_s.size()) m_s.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < m_s.size()) m_s.erase(index, count); }
+    
+    bool equals(const String &s) const { return m_s == s.m_s; }
+    bool operator==(const String &s) const { return m_s == s.m_s; }
+    bool operator!=(const String &s) const { return m_s != s.m_s; }
+    bool concat(const String &s) { m_s += s.m_s; return true; }
+    bool concat(char c) { m_s += c; return true; }
+    String &operator+=(const String &s) { m_s += s.m_s; return *this; }
+    String &operator+=(const char *s) { m_s += s; return *this; }
+    String &operator+=(char c) { m_s += c; return *this; }
+    String &operator+=(int v) { m_s += std::to_string(v); return *this; }
+    String &operator+=(unsigned int v) { m_s += std::to_string(v); return *this; }
+    String &operator+=(long v) { m_s += std::to_string(v); return *this; }
+    String &operator+=(unsigned long v) { m_s += std::to_string(v); return *this; }
+    friend String operator+(const String &a, const String &b) { String r(a); r += b; return r; }
+    
+ private:
+    static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+    std::string m_s;
+};
+
+class Print {
+ public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+        size_t n = 0;
+        while (size--) {
+            n += write(*buffer++);
+        }
+        return n;
+    }
+    size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+    virtual int availableForWrite(void) { return 0; }
+    virtual void flush(void) {}
+    
+    size_t print(const char *s) { return write(s); }
+    size_t print(const __FlashStringHelper *s) { return write((const char *)s); }
+    size_t print(const String &s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+    size_t print(int v, int base = DEC) { return print((long)v, base); }
+    size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+    size_t print(long v, int base = DEC) {
+        char s[24];
+        snprintf(s, sizeof(s), base == HEX ? "%lx" : "%ld", v);
+        return write(s);
+    }
+    size_t print(unsigned long v, int base = DEC) {
+        char s[24];
+        snprintf(s, sizeof(s), base == HEX ? "%lx" : "%lu", v);
+        return write(s);
+    }
+    size_t println(void) { return write("\r\n"); }
+    template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+    template <typename T> size_t println(T v, int base) { size_t n = print(v, base); return n + println(); }
+};
+
+class Stream : public Print {
+ public:
+    Stream() : _timeout(1000) {}
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    virtual int peek(void) = 0;
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    size_t readBytes(uint8_t *buffer, size_t length) {
+        size_t n = 0;
+        unsigned long start = millis();
+        int c;
+        while (n < length && millis() - start < _timeout) {
+            if ((c = read()) >= 0) {
+                buffer[n++] = c;
+            }
+        }
+        return n;
+    }
+    size_t readBytes(char *buffer, size_t length) { return readBytes((uint8_t *)buffer, length); }
+    
+ protected:
+    unsigned long _timeout;
+};
+
+/*
+ * The base of serial ports: PosixSerial(see PosixSerial.h) for real ones. 
+ */
+class HardwareSerial : public Stream {
+ public:
+    virtual void begin(unsigned long) {}
+    virtual void end(void) {}
+};
+
+/*
+ * The console: stdout, and stdin without blocking. 
+ */
+extern HardwareSerial &Serial;
+
+#endif /* #ifndef __ARDUINO_POSIX_H__ */
@@ -0,0 +1,42 @@
+/**
+ * @file Client.h
+ * @brief The Client interface of the Arduino core on Linux.  
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __CLIENT_POSIX_H__
+#define __CLIENT_POSIX_H__
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+class Client : public Stream {
+ public:
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char *host, uint16_t port) = 0;
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    virtual int read(uint8_t *buffer, size_t size) = 0;
+    virtual int peek(void) = 0;
+    virtual void flush(void) = 0;
+    virtual void stop(void) = 0;
+    virtual uint8_t connected(void) = 0;
+    virtual operator bool(void) = 0;
+};
+
+#endif /* #ifndef __CLIENT_POSIX_H__ */
@@ -0,0 +1,74 @@
+/**
+ * @file EEPROM.cpp
+ * @brief The implementation of EEPROM on Linux.  
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "EEPROM.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+EEPROMClass EEPROM;
+
+EEPROMClass::EEPROMClass(): m_fd(-1)
+{
+    memset(m_data, 0xFF, sizeof(m_data)); /* Erased */
+}
+
+bool EEPROMClass::begin(const char *path)
+{
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+    m_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        return false;
+    }
+    if (pread(m_fd, m_data, sizeof(m_data), 0) != (ssize_t)sizeof(m_data)) {
+        memset(m_data, 0xFF, sizeof(m_data));
+        if (pwrite(m_fd, m_data, sizeof(m_data), 0) != (ssize_t)sizeof(m_data)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint8_t EEPROMClass::read(int address)
+{
+    if (address < 0 || address >= EEPROM_POSIX_SIZE) {
+        return 0xFF;
+    }
+    return m_data[address];
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+    if (address < 0 || address >= EEPROM_POSIX_SIZE) {
+        return;
+    }
+    m_data[address] = value;
+    if (m_fd >= 0) {
+        pwrite(m_fd, &value, 1, address);
+    }
+}
+
+void EEPROMClass::update(int address, uint8_t value)
+{
+    if (read(address) != value) {
+        write(address, value);
+    }
+}
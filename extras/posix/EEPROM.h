@@ -0,0 +1,48 @@
+/**
+ * @file EEPROM.h
+ * @brief EEPROM of the Arduino core on Linux, kept in a file.  
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __EEPROM_POSIX_H__
+#define __EEPROM_POSIX_H__
+
+#include "Arduino.h"
+
+
+#define EEPROM_POSIX_SIZE   (4096)
+
+/*
+ * In memory. After begin(path) it is loaded from the file and every change 
+ * is written through. 
+ */
+class EEPROMClass {
+ public:
+    EEPROMClass();
+    bool begin(const char *path);
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    void update(int address, uint8_t value);
+    uint16_t length(void) { return EEPROM_POSIX_SIZE; }
+    
+ private:
+    uint8_t m_data[EEPROM_POSIX_SIZE];
+    int m_fd;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif /* #ifndef __EEPROM_POSIX_H__ */
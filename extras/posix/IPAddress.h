@@ -0,0 +1,41 @@
+/**
+ * @file IPAddress.h
+ * @brief A minimal IPAddress of the Arduino core on Linux.  
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __IPADDRESS_POSIX_H__
+#define __IPADDRESS_POSIX_H__
+
+#include "Arduino.h"
+
+class IPAddress {
+ public:
+    IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0)
+    {
+        m_octets[0] = a;
+        m_octets[1] = b;
+        m_octets[2] = c;
+        m_octets[3] = d;
+    }
+    uint8_t operator[](int index) const { return m_octets[index]; }
+    uint8_t &operator[](int index) { return m_octets[index]; }
+    
+ private:
+    uint8_t m_octets[4];
+};
+
+#endif /* #ifndef __IPADDRESS_POSIX_H__ */
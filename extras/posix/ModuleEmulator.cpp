@@ -0,0 +1,236 @@
+/**
+ * @file ModuleEmulator.cpp 
+ * @brief The implementation of class ModuleEmulator. 
+ * @date 2015.02 
+ * 
+ * @par Copyright: 
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n 
+ * This program is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU General Public License as 
+ * published by the Free Software Foundation; either version 2 of 
+ * the License, or (at your option) any later version. \n\n 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE. 
+ */
+#include "ModuleEmulator.h"
+
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+ModuleEmulator::ModuleEmulator(uint32_t baud, uint32_t send_us): m_master(-1), m_slave(-1),
+    m_pid(-1), m_baud(baud), m_send_us(send_us), m_mux(false)
+{
+    m_name[0] = '\0';
+}
+
+ModuleEmulator::~ModuleEmulator()
+{
+    stop();
+}
+
+bool ModuleEmulator::start(void)
+{
+    struct termios tio;
+    
+    if (m_pid > 0) {
+        return true;
+    }
+    if (openpty(&m_master, &m_slave, m_name, NULL, NULL) < 0) {
+        return false;
+    }
+    /* Raw on both sides: no echo, no CR/LF translation */
+    if (tcgetattr(m_slave, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(m_slave, TCSANOW, &tio);
+    }
+    m_pid = fork();
+    if (m_pid < 0) {
+        stop();
+        return false;
+    }
+    if (m_pid == 0) {
+        close(m_slave);
+        run();
+        _exit(0);
+    }
+    /* The slave stays open here so the pty lives until stop() */
+    close(m_master);
+    m_master = -1;
+    return true;
+}
+
+void ModuleEmulator::stop(void)
+{
+    if (m_pid > 0) {
+        kill(m_pid, SIGTERM);
+        waitpid(m_pid, NULL, 0);
+        m_pid = -1;
+    }
+    if (m_master >= 0) {
+        close(m_master);
+        m_master = -1;
+    }
+    if (m_slave >= 0) {
+        close(m_slave);
+        m_slave = -1;
+    }
+}
+
+const char *ModuleEmulator::name(void)
+{
+    return m_name;
+}
+
+bool ModuleEmulator::command(const char *)
+{
+    return false;
+}
+
+void ModuleEmulator::data(uint8_t, const uint8_t *, size_t)
+{
+}
+
+void ModuleEmulator::reply(const char *s)
+{
+    reply((const uint8_t *)s, strlen(s));
+}
+
+void ModuleEmulator::reply(const uint8_t *buf, size_t len)
+{
+    size_t n;
+    ssize_t ret;
+    
+    /* In slices, so the library sees bytes trickle in like on a wire */
+    while (len > 0) {
+        n = len < 16 ? len : 16;
+        wire(n);
+        while (n > 0) {
+            ret = ::write(m_master, buf, n);
+            if (ret <= 0) {
+                return;
+            }
+            buf += ret;
+            len -= ret;
+            n -= ret;
+        }
+    }
+}
+
+void ModuleEmulator::ipd(uint8_t mux_id, const uint8_t *buf, size_t len)
+{
+    char head[32];
+    if (m_mux) {
+        snprintf(head, sizeof(head), "\r\n+IPD,%u,%u:", mux_id, (unsigned)len);
+    } else {
+        snprintf(head, sizeof(head), "\r\n+IPD,%u:", (unsigned)len);
+    }
+    reply(head);
+    reply(buf, len);
+}
+
+void ModuleEmulator::wire(size_t n)
+{
+    if (m_baud > 0) {
+        delayMicroseconds((uint64_t)n * 10 * 1000000 / m_baud);
+    }
+}
+
+void ModuleEmulator::run(void)
+{
+    char line[MODULEEMULATOR_LINE_SIZE];
+    size_t len = 0;
+    char c;
+    
+    while (::read(m_master, &c, 1) == 1) {
+        if (len < sizeof(line) - 1) {
+            line[len++] = c;
+        }
+        if (len < 2 || line[len - 2] != '\r' || line[len - 1] != '\n') {
+            continue;
+        }
+        wire(len);
+        line[len - 2] = '\0';
+        len = 0;
+        handle(line);
+    }
+}
+
+void ModuleEmulator::handle(char *cmd)
+{
+    static uint8_t payload[MODULEEMULATOR_SEND_MAX];
+    char resp[64];
+    char *comma;
+    uint32_t baud = 0;
+    uint8_t id = 0;
+    size_t n;
+    size_t got;
+    ssize_t ret;
+    
+    if (strncmp(cmd, "AT+CIPSEND=", 11) == 0) {
+        comma = strchr(cmd + 11, ',');
+        if (comma) {
+            id = atoi(cmd + 11);
+        }
+        n = atol(comma ? comma + 1 : cmd + 11);
+        reply(cmd);
+        if (n == 0 || n > sizeof(payload)) {
+            reply("\r\r\nERROR\r\n");
+            return;
+        }
+        reply("\r\r\n\r\nOK\r\n> ");
+        for (got = 0; got < n; got += ret) {
+            ret = ::read(m_master, payload + got, n - got);
+            if (ret <= 0) {
+                return;
+            }
+        }
+        wire(n);
+        delayMicroseconds(m_send_us);
+        snprintf(resp, sizeof(resp), "\r\nRecv %u bytes\r\n\r\nSEND OK\r\n", (unsigned)n);
+        reply(resp);
+        data(id, payload, n);
+        return;
+    }
+    if (command(cmd)) {
+        return;
+    }
+    reply(cmd);
+    if (strncmp(cmd, "AT+GMR", 6) == 0) {
+        reply("\r\r\nAT version:1.2.0.0(Jul  1 2016 20:04:45)\r\nSDK version:2.0.0(656edbf)\r\n\r\nOK\r\n");
+    } else if (strncmp(cmd, "AT+CIPSTART=", 12) == 0) {
+        if (m_mux) {
+            snprintf(resp, sizeof(resp), "\r\r\n%d,CONNECT\r\n\r\nOK\r\n", atoi(cmd + 12));
+            reply(resp);
+        } else {
+            reply("\r\r\nCONNECT\r\n\r\nOK\r\n");
+        }
+    } else if (strncmp(cmd, "AT+CIPCLOSE", 11) == 0) {
+        if (cmd[11] == '=') {
+            snprintf(resp, sizeof(resp), "\r\r\n%d,CLOSED\r\n\r\nOK\r\n", atoi(cmd + 12));
+            reply(resp);
+        } else {
+            reply("\r\r\nCLOSED\r\n\r\nOK\r\n");
+        }
+    } else {
+        if (strncmp(cmd, "AT+CIPMUX=", 10) == 0) {
+            m_mux = atoi(cmd + 10) == 1;
+        } else if (strncmp(cmd, "AT+UART_CUR=", 12) == 0) {
+            baud = atol(cmd + 12);
+        } else if (strncmp(cmd, "AT+CIOBAUD=", 11) == 0) {
+            baud = atol(cmd + 11);
+        }
+        reply("\r\r\n\r\nOK\r\n");
+        if (baud > 0 && m_baud > 0) {
+            m_baud = baud; /* After the answer, like the module */
+        }
+    }
+}
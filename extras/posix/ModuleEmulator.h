@@ -0,0 +1,134 @@
+/**
+ * @file ModuleEmulator.h 
+ * @brief The definition of class ModuleEmulator. 
+ * @date 2015.02 
+ * 
+ * @par Copyright: 
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n 
+ * This program is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU General Public License as 
+ * published by the Free Software Foundation; either version 2 of 
+ * the License, or (at your option) any later version. \n\n 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE. 
+ */
+#ifndef __MODULEEMULATOR_H__
+#define __MODULEEMULATOR_H__
+
+#include "Arduino.h"
+
+#include <sys/types.h>
+
+
+#define MODULEEMULATOR_LINE_SIZE    (256)   /* Longest command line */
+#define MODULEEMULATOR_SEND_MAX     (2048)  /* Most bytes of one "AT+CIPSEND" */
+
+
+/**
+ * An ESP8266 module emulated on a pty pair, to run and measure the library 
+ * on a host without hardware. 
+ * 
+ * start() forks a process answering AT commands on the master side of the 
+ * pty, and the library opens name() with PosixSerial. "AT+CIPSEND" takes 
+ * the payload after "> " and answers "SEND OK" after the time on the wire 
+ * and the radio time, then passes the payload to data(), where a subclass 
+ * may answer by ipd() like a server. 
+ * 
+ * A pty has no baud rate: given one(also changed by "AT+UART_CUR" or 
+ * "AT+CIOBAUD"), the emulator takes the time every byte needs on a wire of 
+ * that rate(10 bits per byte) in both directions. Flow control lines are 
+ * not emulated. 
+ */
+class ModuleEmulator {
+ public:
+    /**
+     * Constuctor. 
+     * 
+     * @param baud - the baud rate emulated(0 for no wire time). 
+     * @param send_us - the radio time of each "AT+CIPSEND" in microseconds. 
+     */
+    ModuleEmulator(uint32_t baud = 115200, uint32_t send_us = 2000);
+    
+    virtual ~ModuleEmulator();
+    
+    /**
+     * Open the pty pair and fork the emulator. 
+     * 
+     * @retval true - running, open name() to talk to it. 
+     * @retval false - failure. 
+     */
+    bool start(void);
+    
+    /**
+     * Stop the emulator and close the pty pair. 
+     */
+    void stop(void);
+    
+    /**
+     * Get the path of the pty to open(e.g. "/dev/pts/3"). 
+     */
+    const char *name(void);
+
+ protected:
+
+    /**
+     * Answer a command other than the built-in ones, in the emulator process. 
+     * 
+     * @param cmd - the command line without CR LF. 
+     * @retval true - answered by reply(). 
+     * @retval false - answer the echo and "OK". 
+     */
+    virtual bool command(const char *cmd);
+    
+    /**
+     * Receive the payload of "AT+CIPSEND", in the emulator process. 
+     * 
+     * @param mux_id - the identifier of the link(0 in single mode). 
+     * @param buf - the payload. 
+     * @param len - the length of payload. 
+     */
+    virtual void data(uint8_t mux_id, const uint8_t *buf, size_t len);
+    
+    /**
+     * Write to the library, taking the time on the wire. 
+     */
+    void reply(const char *s);
+    void reply(const uint8_t *buf, size_t len);
+    
+    /**
+     * Deliver data from a link to the library as "+IPD". 
+     */
+    void ipd(uint8_t mux_id, const uint8_t *buf, size_t len);
+
+ private:
+
+    /*
+     * Serve the library until the pty is closed. 
+     */
+    void run(void);
+    
+    /*
+     * Handle a command line. 
+     */
+    void handle(char *cmd);
+    
+    /*
+     * Sleep the time n bytes take on the wire. 
+     */
+    void wire(size_t n);
+    
+    int m_master;
+    int m_slave;
+    pid_t m_pid;
+    char m_name[64];
+    uint32_t m_baud;
+    uint32_t m_send_us;
+    bool m_mux;
+};
+
+#endif /* #ifndef __MODULEEMULATOR_H__ */
@@ -0,0 +1,194 @@
+/**
+ * @file PosixSerial.cpp
+ * @brief The implementation of class PosixSerial.  
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "PosixSerial.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+PosixSerial *PosixSerial::s_active = NULL;
+
+static speed_t baud_to_speed(unsigned long baud)
+{
+    switch (baud) {
+    case 9600:      return B9600;
+    case 19200:     return B19200;
+    case 38400:     return B38400;
+    case 57600:     return B57600;
+    case 230400:    return B230400;
+    case 460800:    return B460800;
+    case 921600:    return B921600;
+    default:        return B115200;
+    }
+}
+
+PosixSerial::PosixSerial(const char *path): m_path(path), m_fd(-1), m_rx_head(0), m_rx_tail(0)
+{
+}
+
+PosixSerial::~PosixSerial()
+{
+    end();
+}
+
+void PosixSerial::begin(unsigned long baud)
+{
+    struct termios tio;
+    
+    if (m_fd < 0) {
+        m_fd = open(m_path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+        if (m_fd < 0) {
+            return;
+        }
+    }
+    if (tcgetattr(m_fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        cfsetispeed(&tio, baud_to_speed(baud));
+        cfsetospeed(&tio, baud_to_speed(baud));
+        tcsetattr(m_fd, TCSANOW, &tio);
+    }
+    m_rx_head = 0;
+    m_rx_tail = 0;
+    s_active = this;
+}
+
+void PosixSerial::end(void)
+{
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    if (s_active == this) {
+        s_active = NULL;
+    }
+}
+
+bool PosixSerial::isOpen(void)
+{
+    return m_fd >= 0;
+}
+
+int PosixSerial::fd(void)
+{
+    return m_fd;
+}
+
+int PosixSerial::available(void)
+{
+    return fill();
+}
+
+int PosixSerial::read(void)
+{
+    if (fill() == 0) {
+        return -1;
+    }
+    return m_rx[m_rx_head++];
+}
+
+int PosixSerial::peek(void)
+{
+    if (fill() == 0) {
+        return -1;
+    }
+    return m_rx[m_rx_head];
+}
+
+size_t PosixSerial::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t PosixSerial::write(const uint8_t *buffer, size_t size)
+{
+    struct pollfd pfd;
+    size_t done = 0;
+    ssize_t n;
+    
+    if (m_fd < 0) {
+        return 0;
+    }
+    while (done < size) {
+        n = ::write(m_fd, buffer + done, size - done);
+        if (n > 0) {
+            done += n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            /* Kernel buffer full, wait for room */
+            pfd.fd = m_fd;
+            pfd.events = POLLOUT;
+            poll(&pfd, 1, 100);
+        } else {
+            break;
+        }
+    }
+    return done;
+}
+
+void PosixSerial::flush(void)
+{
+    if (m_fd >= 0) {
+        tcdrain(m_fd);
+    }
+}
+
+bool PosixSerial::wait(uint32_t max_ms)
+{
+    struct pollfd pfd;
+    
+    if (m_fd < 0) {
+        return false;
+    }
+    if (m_rx_head < m_rx_tail) {
+        return true;
+    }
+    pfd.fd = m_fd;
+    pfd.events = POLLIN;
+    return poll(&pfd, 1, max_ms) > 0 && (pfd.revents & POLLIN);
+}
+
+void PosixSerial::waitHook(uint32_t max_ms)
+{
+    if (s_active) {
+        s_active->wait(max_ms);
+    } else {
+        delay(max_ms);
+    }
+}
+
+int PosixSerial::fill(void)
+{
+    ssize_t n;
+    
+    if (m_rx_head == m_rx_tail && m_fd >= 0) {
+        m_rx_head = 0;
+        m_rx_tail = 0;
+        n = ::read(m_fd, m_rx, sizeof(m_rx));
+        if (n > 0) {
+            m_rx_tail = n;
+        }
+    }
+    return m_rx_tail - m_rx_head;
+}
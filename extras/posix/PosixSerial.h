@@ -0,0 +1,112 @@
+/**
+ * @file PosixSerial.h
+ * @brief The definition of class PosixSerial.  
+ * @date 2015.02
+ * 
+ * @par Copyright:
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version. \n\n
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __POSIXSERIAL_H__
+#define __POSIXSERIAL_H__
+
+#include "Arduino.h"
+
+
+#define POSIXSERIAL_RX_BUFFER_SIZE  (512)   /* Bytes taken from the kernel at a time */
+
+/**
+ * A serial port of Linux(e.g. /dev/ttyUSB0 or a pty) as HardwareSerial. 
+ *
+ * The port is opened raw(8N1, no flow control) and non-blocking. Reads are 
+ * served from an internal buffer refilled by one read(2) each time it is 
+ * empty. waitHook, given to ESP8266::setWaitHook, sleeps in poll(2) until 
+ * data arrives instead of spinning on available(). 
+ */
+class PosixSerial : public HardwareSerial {
+ public:
+    /**
+     * Constuctor. 
+     *
+     * @param path - the device(e.g. "/dev/ttyUSB0"), kept by reference. 
+     */
+    PosixSerial(const char *path);
+    
+    ~PosixSerial();
+    
+    /**
+     * Open the port(if not yet) and set the baud rate. 
+     *
+     * @param baud - one of the standard rates, 9600 ~ 921600. 
+     */
+    void begin(unsigned long baud);
+    
+    /**
+     * Close the port. 
+     */
+    void end(void);
+    
+    /**
+     * Whether the port is open. 
+     */
+    bool isOpen(void);
+    
+    /**
+     * Get the file descriptor(-1 if closed), for poll(2) or epoll(7) of the application. 
+     */
+    int fd(void);
+    
+    int available(void);
+    int read(void);
+    int peek(void);
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    
+    /**
+     * Wait until all written is transmitted. 
+     */
+    void flush(void);
+    
+    /**
+     * Wait until data is readable. 
+     *
+     * @param max_ms - the longest time to wait in milliseconds. 
+     * @retval true - data readable.
+     * @retval false - timeout or closed.
+     */
+    bool wait(uint32_t max_ms);
+    
+    /**
+     * ESP8266WaitHook waiting on the port begun last. 
+     *
+     * @see ESP8266::setWaitHook
+     */
+    static void waitHook(uint32_t max_ms);
+
+ private:
+    /*
+     * Refill the buffer if empty. Return the bytes buffered. 
+     */
+    int fill(void);
+    
+    const char *m_path;
+    int m_fd;
+    uint8_t m_rx[POSIXSERIAL_RX_BUFFER_SIZE];
+    uint16_t m_rx_head;
+    uint16_t m_rx_tail;
+    
+    static PosixSerial *s_active;
+};
+
+#endif /* #ifndef __POSIXSERIAL_H__ */
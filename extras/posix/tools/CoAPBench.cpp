@@ -0,0 +1,209 @@
+/**
+ * @file CoAPBench.cpp 
+ * @brief Compare a CoAP GET by ESP8266CoAP with an HTTP GET on ModuleEmulator. 
+ * @date 2015.02 
+ * 
+ * @par Usage: 
+ * CoAPBench [baud] [count] \n\n 
+ * Reads a 4-byte resource count(default:50) times from a server emulated 
+ * behind the module running at baud(default:115200), by CoAP on a UDP link 
+ * and by HTTP/1.1 on a TCP link opened and closed for each request, printing 
+ * for one request the latency, the AT commands and the bytes on the uart. 
+ * 
+ * @par Copyright: 
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n 
+ * This program is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU General Public License as 
+ * published by the Free Software Foundation; either version 2 of 
+ * the License, or (at your option) any later version. \n\n 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE. 
+ */
+#include "ESP8266.h"
+#include "ESP8266.h"
+#include "ESP8266CoAP.h"
+#include "PosixSerial.h"
+#include "ModuleEmulator.h"
+
+#include <stdio.h>
+
+
+#define COAP_LINK   (0)
+#define HTTP_LINK   (1)
+
+/*
+ * A server answering CoAP on link 0(piggybacked 2.05) and HTTP on link 1, 
+ * closing the connection after the response. 
+ */
+class Server : public ModuleEmulator {
+ public:
+    Server(uint32_t baud): ModuleEmulator(baud) {}
+
+ protected:
+    void data(uint8_t mux_id, const uint8_t *buf, size_t len)
+    {
+        static const char http[] = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"
+            "Content-Length: 4\r\nConnection: close\r\n\r\n21.5";
+        uint8_t resp[16];
+        uint8_t tkl;
+        size_t n;
+        
+        if (mux_id == COAP_LINK && len >= 4) {
+            tkl = buf[0] & 0x0F;
+            resp[0] = 0x60 | tkl;   /* ACK */
+            resp[1] = 0x45;         /* 2.05 Content */
+            resp[2] = buf[2];
+            resp[3] = buf[3];
+            memcpy(resp + 4, buf + 4, tkl);
+            n = 4 + tkl;
+            resp[n++] = 0xFF;
+            memcpy(resp + n, "21.5", 4);
+            ipd(mux_id, resp, n + 4);
+        } else if (mux_id == HTTP_LINK) {
+            ipd(mux_id, (const uint8_t *)http, sizeof(http) - 1);
+            reply("\r\n1,CLOSED\r\n");
+        }
+    }
+};
+
+/*
+ * The port counting the bytes and the AT commands crossing it. 
+ */
+class CountingStream : public Stream {
+ public:
+    CountingStream(Stream &base): m_base(&base), tx(0), rx(0), commands(0), m_match(0) {}
+    int available(void) {
+        return m_base->available();
+    }
+    int read(void) {
+        int c = m_base->read();
+        rx += c < 0 ? 0 : 1;
+        return c;
+    }
+    int peek(void) {
+        return m_base->peek();
+    }
+    size_t write(uint8_t c) {
+        /* "AT+" or "AT\r" starts a command */
+        m_match = (m_match == 0 && c == 'A') || (m_match == 1 && c == 'T') ? m_match + 1 : (c == 'A');
+        if (m_match == 2) {
+            commands++;
+            m_match = 0;
+        }
+        tx++;
+        return m_base->write(c);
+    }
+    using Print::write;
+    
+    Stream *m_base;
+    uint32_t tx;
+    uint32_t rx;
+    uint32_t commands;
+
+ private:
+    uint8_t m_match;
+};
+
+struct Result {
+    uint32_t ok;
+    unsigned long ms;
+    uint32_t commands;
+    uint32_t bytes;
+};
+
+static bool coap_get(ESP8266CoAP &coap)
+{
+    uint8_t buf[16];
+    uint16_t len = 0;
+    return coap.get("sensors/temp", buf, sizeof(buf), &len) == ESP8266COAP_CODE(2, 5) && len == 4;
+}
+
+static bool http_get(ESP8266 &wifi)
+{
+    static const char req[] = "GET /sensors/temp HTTP/1.1\r\nHost: 192.168.1.2\r\n"
+        "Connection: close\r\n\r\n";
+    uint8_t buf[128];
+    uint32_t got = 0;
+    uint32_t n;
+    bool ok;
+    
+    if (!wifi.createTCP(HTTP_LINK, "192.168.1.2", 80)) {
+        return false;
+    }
+    ok = wifi.send(HTTP_LINK, (const uint8_t *)req, sizeof(req) - 1);
+    while (ok && got < 4 && (n = wifi.recv(HTTP_LINK, buf, sizeof(buf), 1000)) > 0) {
+        got += n;
+    }
+    wifi.releaseTCP(HTTP_LINK);
+    return ok && got > 4 && memcmp(buf + n - 4, "21.5", 4) == 0;
+}
+
+static void print(const char *name, const Result &r, uint32_t count)
+{
+    printf("%-6s %u/%u requests, %.1f ms, %.1f AT commands, %.0f uart bytes per request\n", name,
+        (unsigned)r.ok, (unsigned)count, (double)r.ms / count, (double)r.commands / count,
+        (double)r.bytes / count);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t baud = argc > 1 ? atol(argv[1]) : 115200;
+    uint32_t count = argc > 2 ? atol(argv[2]) : 50;
+    Server server(baud);
+    Result coap_result;
+    Result http_result;
+    unsigned long start;
+    uint32_t commands;
+    uint32_t bytes;
+    uint32_t i;
+    
+    if (count == 0 || !server.start()) {
+        fprintf(stderr, "usage: %s [baud] [count>0]\n", argv[0]);
+        return 1;
+    }
+    PosixSerial port(server.name());
+    port.begin(baud);
+    CountingStream counter(port);
+    ESP8266 wifi(counter);
+    ESP8266CoAP coap(wifi, COAP_LINK);
+    wifi.setWaitHook(PosixSerial::waitHook);
+    if (!wifi.enableMUX() || !coap.begin("192.168.1.2")) {
+        fprintf(stderr, "setup failed\n");
+        return 1;
+    }
+    
+    memset(&coap_result, 0, sizeof(coap_result));
+    commands = counter.commands;
+    bytes = counter.tx + counter.rx;
+    start = millis();
+    for (i = 0; i < count; i++) {
+        coap_result.ok += coap_get(coap) ? 1 : 0;
+    }
+    coap_result.ms = millis() - start;
+    coap_result.commands = counter.commands - commands;
+    coap_result.bytes = counter.tx + counter.rx - bytes;
+    
+    memset(&http_result, 0, sizeof(http_result));
+    commands = counter.commands;
+    bytes = counter.tx + counter.rx;
+    start = millis();
+    for (i = 0; i < count; i++) {
+        http_result.ok += http_get(wifi) ? 1 : 0;
+    }
+    http_result.ms = millis() - start;
+    http_result.commands = counter.commands - commands;
+    http_result.bytes = counter.tx + counter.rx - bytes;
+    
+    printf("%lu baud\n", (unsigned long)baud);
+    print("CoAP", coap_result, count);
+    print("HTTP", http_result, count);
+    coap.end();
+    port.end();
+    server.stop();
+    return coap_result.ok == count && http_result.ok == count ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+/**
+ * @file LZBench.cpp 
+ * @brief Measure the compression ratio, the encoding cost and the time saved by ESP8266LZ. 
+ * @date 2015.02 
+ * 
+ * @par Usage: 
+ * LZBench [baud] [count] \n\n 
+ * Compresses a sensor JSON report, a CSV log and random bytes, printing the 
+ * compressed length, the ratio and the time the encoder takes per byte on 
+ * this host(both passes, as send does). Then sends each count(default:20) 
+ * times on a module emulated at baud(default:115200), as is and compressed, 
+ * printing the time of one send each way. 
+ * 
+ * @par Copyright: 
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n 
+ * This program is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU General Public License as 
+ * published by the Free Software Foundation; either version 2 of 
+ * the License, or (at your option) any later version. \n\n 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE. 
+ */
+#include "ESP8266.h"
+#include "ESP8266.h"
+#include "ESP8266LZ.h"
+#include "PosixSerial.h"
+#include "ModuleEmulator.h"
+
+#include <stdio.h>
+#include <time.h>
+
+
+#define SAMPLE_SIZE     (640)
+
+/*
+ * A buffer to decompress into. 
+ */
+class BufferSink : public Print {
+ public:
+    BufferSink(uint8_t *buf, size_t size): m_buf(buf), m_size(size), m_len(0) {}
+    size_t write(uint8_t c) {
+        if (m_len >= m_size) {
+            return 0;
+        }
+        m_buf[m_len++] = c;
+        return 1;
+    }
+    using Print::write;
+    size_t length(void) {
+        return m_len;
+    }
+
+ private:
+    uint8_t *m_buf;
+    size_t m_size;
+    size_t m_len;
+};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * A report of 8 sensors as sent by a sketch. 
+ */
+static size_t make_json(char *buf, size_t size)
+{
+    size_t n = snprintf(buf, size, "{\"device\":\"node-17\",\"readings\":[");
+    for (uint8_t i = 0; i < 8; i++) {
+        n += snprintf(buf + n, size - n, "%s{\"sensor\":\"temp%u\",\"value\":%u.%u,"
+            "\"unit\":\"C\",\"time\":14240%05u}", i == 0 ? "" : ",", i, 18 + i * 7 % 9, 
+            i * 3 % 10, 1000 + i * 10);
+    }
+    n += snprintf(buf + n, size - n, "]}");
+    return n;
+}
+
+/*
+ * A log of 20 rows. 
+ */
+static size_t make_csv(char *buf, size_t size)
+{
+    size_t n = snprintf(buf, size, "time,temperature,humidity,pressure\n");
+    for (uint8_t i = 0; i < 20; i++) {
+        n += snprintf(buf + n, size - n, "14240%05u,%u.%u,%u,%u.%u\n", 1000 + i * 60,
+            20 + i % 3, i * 7 % 10, 40 + i % 5, 1013 - i % 2, i % 10);
+    }
+    return n;
+}
+
+static size_t make_random(char *buf, size_t size)
+{
+    uint32_t x = 12345;
+    for (size_t i = 0; i < size; i++) {
+        x = x * 1103515245 + 12345;
+        buf[i] = x >> 16;
+    }
+    return size;
+}
+
+/*
+ * Encode len bytes as send would(counting pass, then read), rounds times. 
+ * Return ns per input byte. 
+ */
+static double encode_ns(const uint8_t *data, size_t len, uint32_t rounds)
+{
+    ESP8266LZEncoder encoder;
+    volatile int sink = 0;
+    double start = now_ns();
+    
+    for (uint32_t r = 0; r < rounds; r++) {
+        encoder.begin(data, len);
+        while (encoder.available() > 0) {
+            sink += encoder.read();
+        }
+    }
+    return (now_ns() - start) / rounds / len;
+}
+
+static bool round_trip(const uint8_t *data, size_t len)
+{
+    static uint8_t out[SAMPLE_SIZE];
+    ESP8266LZEncoder encoder;
+    BufferSink sink(out, sizeof(out));
+    ESP8266LZDecoder decoder(sink);
+    
+    encoder.begin(data, len);
+    while (encoder.available() > 0) {
+        decoder.write(encoder.read());
+    }
+    return sink.length() == len && memcmp(out, data, len) == 0;
+}
+
+/*
+ * Time of one send in ms, as is or compressed. 
+ */
+static double send_ms(ESP8266 &wifi, const uint8_t *data, size_t len, bool compressed, uint32_t count)
+{
+    ESP8266LZEncoder encoder;
+    unsigned long start = millis();
+    uint32_t ok = 0;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        if (compressed) {
+            ok += wifi.send(1, encoder, encoder.begin(data, len)) ? 1 : 0;
+        } else {
+            ok += wifi.send(1, data, len) ? 1 : 0;
+        }
+    }
+    if (ok != count) {
+        fprintf(stderr, "%u of %u sends failed\n", (unsigned)(count - ok), (unsigned)count);
+    }
+    return (double)(millis() - start) / count;
+}
+
+int main(int argc, char **argv)
+{
+    static char samples[3][SAMPLE_SIZE];
+    static const char *names[3] = {"JSON", "CSV", "random"};
+    uint32_t baud = argc > 1 ? atol(argv[1]) : 115200;
+    uint32_t count = argc > 2 ? atol(argv[2]) : 20;
+    ModuleEmulator module(baud);
+    ESP8266LZEncoder encoder;
+    size_t lens[3];
+    uint32_t packed;
+    double plain;
+    double lz;
+    uint8_t i;
+    
+    lens[0] = make_json(samples[0], SAMPLE_SIZE);
+    lens[1] = make_csv(samples[1], SAMPLE_SIZE);
+    lens[2] = make_random(samples[2], 600);
+    
+    printf("%-8s %6s %6s %6s %10s\n", "data", "bytes", "lz", "ratio", "ns/byte");
+    for (i = 0; i < 3; i++) {
+        packed = encoder.begin((const uint8_t *)samples[i], lens[i]);
+        if (!round_trip((const uint8_t *)samples[i], lens[i])) {
+            fprintf(stderr, "%s does not decompress to itself\n", names[i]);
+            return 1;
+        }
+        printf("%-8s %6u %6u %6.2f %10.0f\n", names[i], (unsigned)lens[i], (unsigned)packed,
+            (double)packed / lens[i], encode_ns((const uint8_t *)samples[i], lens[i], 2000));
+    }
+    
+    if (count == 0 || !module.start()) {
+        fprintf(stderr, "usage: %s [baud] [count>0]\n", argv[0]);
+        return 1;
+    }
+    PosixSerial port(module.name());
+    ESP8266 wifi(port, baud);
+    wifi.setWaitHook(PosixSerial::waitHook);
+    if (!wifi.enableMUX() || !wifi.createTCP(1, "192.168.1.2", 8090)) {
+        fprintf(stderr, "setup failed\n");
+        return 1;
+    }
+    printf("\n%lu baud, %u sends each\n", (unsigned long)baud, (unsigned)count);
+    printf("%-8s %10s %10s %10s\n", "data", "plain(ms)", "lz(ms)", "saved(ms)");
+    for (i = 0; i < 3; i++) {
+        plain = send_ms(wifi, (const uint8_t *)samples[i], lens[i], false, count);
+        lz = send_ms(wifi, (const uint8_t *)samples[i], lens[i], true, count);
+        printf("%-8s %10.1f %10.1f %10.1f\n", names[i], plain, lz, plain - lz);
+    }
+    wifi.releaseTCP(1);
+    port.end();
+    module.stop();
+    return 0;
+}
@@ -0,0 +1,156 @@
+/**
+ * @file MQTTBench.cpp 
+ * @brief Measure the publishes per second of ESP8266MQTT on ModuleEmulator. 
+ * @date 2015.02 
+ * 
+ * @par Usage: 
+ * MQTTBench [baud] [count] \n\n 
+ * Connects to a broker emulated behind the module running at baud(default: 
+ * 115200) and publishes count(default:500) messages of 16 bytes with QoS 0, 
+ * QoS 0 batched by 4, and QoS 1, printing the publishes per second and the 
+ * CPU time used of each. 
+ * 
+ * @par Copyright: 
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n 
+ * This program is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU General Public License as 
+ * published by the Free Software Foundation; either version 2 of 
+ * the License, or (at your option) any later version. \n\n 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE. 
+ */
+#include "ESP8266.h"
+#include "ESP8266MQTT.h"
+#include "PosixSerial.h"
+#include "ModuleEmulator.h"
+
+#include <stdio.h>
+#include <sys/resource.h>
+
+/*
+ * A broker answering CONNECT, QoS 1 PUBLISH and PINGREQ, with the acks of 
+ * one "AT+CIPSEND" in one "+IPD". 
+ */
+class Broker : public ModuleEmulator {
+ public:
+    Broker(uint32_t baud): ModuleEmulator(baud)
+    {
+    }
+
+ protected:
+    void data(uint8_t mux_id, const uint8_t *buf, size_t len)
+    {
+        uint8_t acks[MODULEEMULATOR_SEND_MAX];
+        size_t n = 0;
+        size_t i = 0;
+        uint32_t remaining;
+        uint16_t topic;
+        uint8_t k;
+        
+        while (i + 2 <= len) {
+            remaining = 0;
+            for (k = 1; k < 5 && i + k < len; k++) {
+                remaining |= (uint32_t)(buf[i + k] & 0x7F) << (7 * (k - 1));
+                if (!(buf[i + k] & 0x80)) {
+                    break;
+                }
+            }
+            const uint8_t *body = buf + i + 1 + k;
+            switch (buf[i] & 0xF0) {
+            case 0x10: /* CONNECT */
+                acks[n++] = 0x20;
+                acks[n++] = 2;
+                acks[n++] = 0;
+                acks[n++] = 0;
+                break;
+            case 0x30: /* PUBLISH */
+                if (buf[i] & 0x06) {
+                    topic = (body[0] << 8) | body[1];
+                    acks[n++] = 0x40;
+                    acks[n++] = 2;
+                    acks[n++] = body[2 + topic];
+                    acks[n++] = body[3 + topic];
+                }
+                break;
+            case 0xC0: /* PINGREQ */
+                acks[n++] = 0xD0;
+                acks[n++] = 0;
+                break;
+            }
+            i += 1 + k + remaining;
+        }
+        if (n > 0) {
+            ipd(mux_id, acks, n);
+        }
+    }
+};
+
+static double cpu_ms(void)
+{
+    struct rusage r;
+    getrusage(RUSAGE_SELF, &r);
+    return (r.ru_utime.tv_sec + r.ru_stime.tv_sec) * 1000.0
+        + (r.ru_utime.tv_usec + r.ru_stime.tv_usec) / 1000.0;
+}
+
+static void run(ESP8266MQTT &mqtt, const char *name, uint32_t count, uint8_t qos, uint8_t batch)
+{
+    unsigned long start = millis();
+    unsigned long elapsed;
+    double cpu = cpu_ms();
+    uint32_t ok = 0;
+    uint32_t i;
+    
+    for (i = 0; i < count; i++) {
+        if (batch > 1 && i % batch == 0) {
+            mqtt.beginBatch();
+        }
+        while (qos > 0 && mqtt.inflight() >= ESP8266MQTT_MAX_INFLIGHT && mqtt.loop(10)) {
+        }
+        ok += mqtt.publish("bench/t", "0123456789abcdef", qos) ? 1 : 0;
+        if (batch > 1 && (i % batch == batch - 1u || i == count - 1)) {
+            mqtt.endBatch();
+        }
+    }
+    while (mqtt.inflight() > 0 && millis() - start < 60000 && mqtt.loop(10)) {
+    }
+    elapsed = millis() - start;
+    cpu = cpu_ms() - cpu;
+    printf("%-16s %u/%u publishes, %lu ms, %.0f/s, cpu %.0f ms (%.0f%%)\n", name,
+        (unsigned)ok, (unsigned)count, elapsed, elapsed > 0 ? count * 1000.0 / elapsed : 0.0,
+        cpu, elapsed > 0 ? 100 * cpu / elapsed : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t baud = argc > 1 ? atol(argv[1]) : 115200;
+    uint32_t count = argc > 2 ? atol(argv[2]) : 500;
+    Broker broker(baud);
+    
+    if (!broker.start()) {
+        fprintf(stderr, "usage: %s [baud] [count]\n", argv[0]);
+        return 1;
+    }
+    PosixSerial port(broker.name());
+    ESP8266 wifi(port, baud);
+    ESP8266MQTT mqtt(wifi, 0);
+    wifi.setWaitHook(PosixSerial::waitHook);
+    if (!wifi.enableMUX() || !mqtt.connect("192.168.1.2", 1883, "bench")) {
+        fprintf(stderr, "connect failed\n");
+        return 1;
+    }
+    
+    run(mqtt, "QoS 0", count, 0, 1);
+    run(mqtt, "QoS 0, batch 4", count, 0, 4);
+    run(mqtt, "QoS 1", count, 1, 1);
+    
+    mqtt.disconnect();
+    port.end();
+    broker.stop();
+    return 0;
+}
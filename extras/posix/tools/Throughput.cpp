@@ -0,0 +1,90 @@
+/**
+ * @file Throughput.cpp 
+ * @brief Measure the sending rate and CPU use of the library on ModuleEmulator. 
+ * @date 2015.02 
+ * 
+ * @par Usage: 
+ * Throughput [baud] [none|software] [spin|hook] [count] [size] \n\n 
+ * Opens link 1 to the emulated module running at baud(default:115200) with 
+ * the flow control given(default:none), sends count(default:200) messages 
+ * of size(default:1024) bytes, waiting by spinning or by the wait hook 
+ * (default:hook), and prints the rate and the CPU time used. 
+ * 
+ * @par Copyright: 
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n 
+ * This program is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU General Public License as 
+ * published by the Free Software Foundation; either version 2 of 
+ * the License, or (at your option) any later version. \n\n 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE. 
+ */
+#include "ESP8266.h"
+#include "PosixSerial.h"
+#include "ModuleEmulator.h"
+
+#include <stdio.h>
+#include <sys/resource.h>
+
+static double cpu_ms(void)
+{
+    struct rusage r;
+    getrusage(RUSAGE_SELF, &r);
+    return (r.ru_utime.tv_sec + r.ru_stime.tv_sec) * 1000.0
+        + (r.ru_utime.tv_usec + r.ru_stime.tv_usec) / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t baud = argc > 1 ? atol(argv[1]) : 115200;
+    uint8_t flow = argc > 2 && strcmp(argv[2], "software") == 0 ? ESP8266_FLOW_SOFTWARE : ESP8266_FLOW_NONE;
+    bool hook = !(argc > 3 && strcmp(argv[3], "spin") == 0);
+    uint32_t count = argc > 4 ? atol(argv[4]) : 200;
+    uint32_t size = argc > 5 ? atol(argv[5]) : 1024;
+    static uint8_t buf[MODULEEMULATOR_SEND_MAX];
+    ModuleEmulator module(115200);
+    unsigned long start;
+    unsigned long elapsed;
+    double cpu;
+    uint32_t ok = 0;
+    
+    if (size == 0 || size > sizeof(buf) || !module.start()) {
+        fprintf(stderr, "usage: %s [baud] [none|software] [spin|hook] [count] [size<=%u]\n",
+            argv[0], (unsigned)sizeof(buf));
+        return 1;
+    }
+    memset(buf, 'a', size);
+    
+    PosixSerial port(module.name());
+    ESP8266 wifi(port, 115200);
+    if (hook) {
+        wifi.setWaitHook(PosixSerial::waitHook);
+    }
+    if (!wifi.setUART(baud, flow) || !wifi.enableMUX()
+        || !wifi.createTCP(1, "192.168.1.2", 8090)) {
+        fprintf(stderr, "setup failed\n");
+        return 1;
+    }
+    
+    cpu = cpu_ms();
+    start = millis();
+    for (uint32_t i = 0; i < count; i++) {
+        ok += wifi.send(1, buf, size) ? 1 : 0;
+    }
+    elapsed = millis() - start;
+    cpu = cpu_ms() - cpu;
+    
+    printf("%lu baud, flow %s, %s: %u/%u sends of %u bytes, %lu ms, %.1f KB/s, cpu %.0f ms (%.0f%%)\n",
+        (unsigned long)baud, flow == ESP8266_FLOW_SOFTWARE ? "software" : "none",
+        hook ? "wait hook" : "spinning", (unsigned)ok, (unsigned)count, (unsigned)size,
+        elapsed, elapsed > 0 ? count * size / 1.024 / elapsed : 0.0,
+        cpu, elapsed > 0 ? 100 * cpu / elapsed : 0.0);
+    port.end();
+    module.stop();
+    return ok == count ? 0 : 1;
+}
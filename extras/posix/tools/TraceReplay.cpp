@@ -0,0 +1,258 @@
+/**
+ * @file TraceReplay.cpp 
+ * @brief Record a session on ModuleEmulator and replay it with per-call latency and CPU. 
+ * @date 2015.02 
+ * 
+ * @par Usage: 
+ * TraceReplay record <file> [baud] [count] [size] \n 
+ * TraceReplay replay <file> [speed] [count] [size] \n\n 
+ * record runs a session against an echoing module emulated at baud 
+ * (default:115200): kick, getVersion, enableMUX, createTCP, then count 
+ * (default:20) send and recv of size(default:256) bytes, then releaseTCP. 
+ * Its trace is written to file. \n\n 
+ * replay runs the same session on the trace by ESP8266TraceReplay at speed 
+ * (default:1, 0 for no delay) and prints, for each kind of call, the latency 
+ * (wall time) and the CPU time(wall time minus the time the library waited 
+ * for bytes due from the trace). count and size must be those recorded. 
+ * 
+ * @par Copyright: 
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n 
+ * This program is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU General Public License as 
+ * published by the Free Software Foundation; either version 2 of 
+ * the License, or (at your option) any later version. \n\n 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE. 
+ */
+#include "ESP8266.h"
+#include "ESP8266Trace.h"
+#include "PosixSerial.h"
+#include "ModuleEmulator.h"
+
+#include <stdio.h>
+
+
+#define CALL_KICK       (0)
+#define CALL_VERSION    (1)
+#define CALL_MUX        (2)
+#define CALL_CREATE     (3)
+#define CALL_SEND       (4)
+#define CALL_RECV       (5)
+#define CALL_RELEASE    (6)
+#define CALL_COUNT      (7)
+
+static const char *call_names[CALL_COUNT] = {
+    "kick", "getVersion", "enableMUX", "createTCP", "send", "recv", "releaseTCP",
+};
+
+struct CallStats {
+    uint32_t calls;
+    uint32_t failed;
+    uint32_t wall_us;
+    uint32_t wall_max_us;
+    uint32_t cpu_us;
+};
+
+/*
+ * The module echoing what is sent on a link. 
+ */
+class EchoModule : public ModuleEmulator {
+ public:
+    EchoModule(uint32_t baud): ModuleEmulator(baud) {}
+
+ protected:
+    void data(uint8_t mux_id, const uint8_t *buf, size_t len) {
+        ipd(mux_id, buf, len);
+    }
+};
+
+/*
+ * A trace file to write. 
+ */
+class FileSink : public Print {
+ public:
+    FileSink(FILE *file): m_file(file) {}
+    size_t write(uint8_t c) {
+        return fputc(c, m_file) == EOF ? 0 : 1;
+    }
+    using Print::write;
+
+ private:
+    FILE *m_file;
+};
+
+/*
+ * A trace file to read. 
+ */
+class FileSource : public Stream {
+ public:
+    FileSource(FILE *file): m_file(file) {}
+    int available(void) {
+        int c = peek();
+        return c < 0 ? 0 : 1;
+    }
+    int read(void) {
+        return fgetc(m_file);
+    }
+    int peek(void) {
+        int c = fgetc(m_file);
+        if (c != EOF) {
+            ungetc(c, m_file);
+        }
+        return c;
+    }
+    size_t write(uint8_t) {
+        return 0;
+    }
+    using Print::write;
+
+ private:
+    FILE *m_file;
+};
+
+/*
+ * Make the call of the session at step, the same when recording and replaying. 
+ */
+static uint8_t call(ESP8266 &wifi, uint32_t step, uint32_t count, uint8_t *buf, uint32_t size, bool *ok)
+{
+    uint8_t id;
+    
+    if (step < CALL_SEND) {
+        id = step;
+    } else if (step < CALL_SEND + 2 * count) {
+        id = (step - CALL_SEND) % 2 == 0 ? CALL_SEND : CALL_RECV;
+    } else {
+        id = CALL_RELEASE;
+    }
+    switch (id) {
+        case CALL_KICK:
+            *ok = wifi.kick();
+            break;
+        case CALL_VERSION:
+            *ok = wifi.getVersion().length() > 0;
+            break;
+        case CALL_MUX:
+            *ok = wifi.enableMUX();
+            break;
+        case CALL_CREATE:
+            *ok = wifi.createTCP(1, "192.168.1.2", 8090);
+            break;
+        case CALL_SEND:
+            memset(buf, 'a' + step % 26, size);
+            *ok = wifi.send(1, buf, size);
+            break;
+        case CALL_RECV:
+            *ok = wifi.recv(1, buf, size, 1000) == size;
+            break;
+        default:
+            *ok = wifi.releaseTCP(1);
+            break;
+    }
+    return id;
+}
+
+static int record(const char *path, uint32_t baud, uint32_t count, uint32_t size, uint8_t *buf)
+{
+    FILE *file = fopen(path, "wb");
+    EchoModule module(baud);
+    uint32_t steps = CALL_SEND + 2 * count + 1;
+    uint32_t failed = 0;
+    bool ok;
+    
+    if (file == NULL || !module.start()) {
+        fprintf(stderr, "cannot open %s or start the emulator\n", path);
+        return 1;
+    }
+    PosixSerial port(module.name());
+    ESP8266 wifi(port, baud);
+    FileSink sink(file);
+    ESP8266TraceRecorder recorder(sink);
+    wifi.setWaitHook(PosixSerial::waitHook);
+    wifi.setTrace(&recorder);
+    for (uint32_t step = 0; step < steps; step++) {
+        call(wifi, step, count, buf, size, &ok);
+        failed += ok ? 0 : 1;
+    }
+    wifi.setTrace(NULL);
+    fclose(file);
+    port.end();
+    module.stop();
+    printf("recorded %u calls(%u failed) to %s\n", (unsigned)steps, (unsigned)failed, path);
+    return failed == 0 ? 0 : 1;
+}
+
+static int replay(const char *path, uint16_t speed, uint32_t count, uint32_t size, uint8_t *buf)
+{
+    FILE *file = fopen(path, "rb");
+    CallStats stats[CALL_COUNT];
+    uint32_t steps = CALL_SEND + 2 * count + 1;
+    uint32_t mismatch = 0;
+    unsigned long start;
+    uint32_t wall;
+    uint32_t idle;
+    uint8_t id;
+    bool ok;
+    
+    if (file == NULL) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+    FileSource source(file);
+    ESP8266TraceReplay trace(source, speed);
+    ESP8266 wifi(trace);
+    memset(stats, 0, sizeof(stats));
+    for (uint32_t step = 0; step < steps; step++) {
+        trace.resetStats();
+        start = micros();
+        id = call(wifi, step, count, buf, size, &ok);
+        wall = micros() - start;
+        idle = trace.getStats().idle_us;
+        mismatch += trace.getStats().tx_mismatch;
+        stats[id].calls++;
+        stats[id].failed += ok ? 0 : 1;
+        stats[id].wall_us += wall;
+        stats[id].cpu_us += idle < wall ? wall - idle : 0;
+        if (wall > stats[id].wall_max_us) {
+            stats[id].wall_max_us = wall;
+        }
+    }
+    fclose(file);
+    
+    printf("%-12s %6s %6s %12s %12s %12s\n", "call", "calls", "failed", "latency(us)", "max(us)", "cpu(us)");
+    for (id = 0; id < CALL_COUNT; id++) {
+        if (stats[id].calls == 0) {
+            continue;
+        }
+        printf("%-12s %6u %6u %12u %12u %12u\n", call_names[id], (unsigned)stats[id].calls,
+            (unsigned)stats[id].failed, (unsigned)(stats[id].wall_us / stats[id].calls),
+            (unsigned)stats[id].wall_max_us, (unsigned)(stats[id].cpu_us / stats[id].calls));
+    }
+    printf("bytes written differing from the trace: %u, trace %s\n", (unsigned)mismatch,
+        trace.done() ? "done" : "not done");
+    return mismatch == 0 && trace.done() ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t buf[MODULEEMULATOR_SEND_MAX];
+    bool recording = argc > 2 && strcmp(argv[1], "record") == 0;
+    uint32_t count = argc > 4 ? atol(argv[4]) : 20;
+    uint32_t size = argc > 5 ? atol(argv[5]) : 256;
+    
+    if (argc < 3 || (!recording && strcmp(argv[1], "replay") != 0)
+        || size == 0 || size > sizeof(buf)) {
+        fprintf(stderr, "usage: %s record <file> [baud] [count] [size<=%u]\n"
+            "       %s replay <file> [speed] [count] [size]\n",
+            argv[0], (unsigned)sizeof(buf), argv[0]);
+        return 1;
+    }
+    if (recording) {
+        return record(argv[2], argc > 3 ? atol(argv[3]) : 115200, count, size, buf);
+    }
+    return replay(argv[2], argc > 3 ? atoi(argv[3]) : 1, count, size, buf);
+}
@@ -0,0 +1,131 @@
+/**
+ * @file UploaderBench.cpp 
+ * @brief Count what ESP8266Uploader costs on ModuleEmulator for an hour of readings. 
+ * @date 2015.02 
+ * 
+ * @par Usage: 
+ * UploaderBench [baud] [readings] \n\n 
+ * Appends readings(default:360, an hour of one every 10 s) records of 8 bytes 
+ * and delivers them, acknowledged, to a server emulated behind the module 
+ * running at baud(default:115200): one connection per reading, batches from 
+ * the RAM ring and batches from EEPROM. 
+ * 
+ * @par Copyright: 
+ * Copyright (c) 2015 ITEAD Intelligent Systems Co., Ltd. \n\n 
+ * This program is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU General Public License as 
+ * published by the Free Software Foundation; either version 2 of 
+ * the License, or (at your option) any later version. \n\n 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE. 
+ */
+#include "ESP8266.h"
+#include "ESP8266.h"
+#include "ESP8266Uploader.h"
+#include "EEPROM.h"
+#include "PosixSerial.h"
+#include "ModuleEmulator.h"
+
+#include <stdio.h>
+
+
+#define RECORD_SIZE     (8)
+#define SEGMENTS_OPEN   (7)     /* Handshake(3) and close(4) of a TCP connection */
+#define SEGMENTS_SEND   (2)     /* A batch and its acknowledgement */
+
+/*
+ * A server acknowledging each batch with the sequence number after it. 
+ */
+class Server : public ModuleEmulator {
+ public:
+    Server(uint32_t baud): ModuleEmulator(baud) {}
+
+ protected:
+    void data(uint8_t mux_id, const uint8_t *buf, size_t len)
+    {
+        uint32_t next;
+        uint8_t ack[4];
+        
+        if (len < ESP8266UPLOADER_HEADER_SIZE) {
+            return;
+        }
+        next = ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+        next += ((uint32_t)buf[4] << 8) | buf[5];
+        ack[0] = next >> 24;
+        ack[1] = next >> 16;
+        ack[2] = next >> 8;
+        ack[3] = next;
+        ipd(mux_id, ack, sizeof(ack));
+    }
+};
+
+static void run(ESP8266 &wifi, const char *name, uint16_t threshold, uint16_t eeprom, 
+    uint32_t readings)
+{
+    ESP8266Uploader uploader(wifi, 0, RECORD_SIZE);
+    uint8_t record[RECORD_SIZE];
+    unsigned long start;
+    unsigned long ms;
+    uint32_t i;
+    
+    uploader.setTarget(ESP8266_LINK_TCP, "192.168.1.2", 8090);
+    uploader.setThreshold(threshold, 0);
+    uploader.setAck(true);
+    if (eeprom > 0) {
+        uploader.setEEPROM(0, eeprom);
+    }
+    start = millis();
+    for (i = 0; i < readings; i++) {
+        memset(record, 0, sizeof(record));
+        record[0] = i >> 24;
+        record[1] = i >> 16;
+        record[2] = i >> 8;
+        record[3] = i;
+        uploader.append(record);
+        uploader.run();
+    }
+    uploader.flush();
+    ms = millis() - start;
+    
+    const ESP8266UploaderStats &stats = uploader.getStats();
+    printf("%-10s %6u %8u %5u %8u %8lu %8lu %8lu ms\n", name, (unsigned)stats.delivered, 
+        (unsigned)stats.connects, (unsigned)stats.sends, (unsigned)stats.bytes, 
+        (unsigned long)(stats.connects * 2 + stats.sends), 
+        (unsigned long)(stats.connects * SEGMENTS_OPEN + stats.sends * SEGMENTS_SEND), ms);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t baud = argc > 1 ? atol(argv[1]) : 115200;
+    uint32_t readings = argc > 2 ? atol(argv[2]) : 360;
+    Server server(baud);
+    
+    if (readings == 0 || !server.start()) {
+        fprintf(stderr, "usage: %s [baud] [readings>0]\n", argv[0]);
+        return 1;
+    }
+    PosixSerial port(server.name());
+    ESP8266 wifi(port, baud);
+    wifi.setWaitHook(PosixSerial::waitHook);
+    if (!wifi.enableMUX()) {
+        fprintf(stderr, "setup failed\n");
+        return 1;
+    }
+    
+    printf("%lu baud, %lu readings\n", (unsigned long)baud, (unsigned long)readings);
+    printf("%-10s %6s %8s %5s %8s %8s %8s %11s\n", "upload", "acked", "connects", "sends", 
+        "bytes", "commands", "segments", "time");
+    run(wifi, "per-record", 1, 0, readings);
+    run(wifi, "RAM", ESP8266UPLOADER_RAM_SIZE / RECORD_SIZE, 0, readings);
+    run(wifi, "EEPROM", 60, 512, readings);
+    printf("commands: createTCP, releaseTCP and a CIPSEND per batch\n");
+    printf("segments: %d per connection and %d per batch, estimated\n", SEGMENTS_OPEN, SEGMENTS_SEND);
+    port.end();
+    server.stop();
+    return 0;
+}